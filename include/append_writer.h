@@ -0,0 +1,221 @@
+#pragma once
+
+#include "config.h"
+#include "object_store.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief 把多个生产者线程的小记录合并成大的append_object写入同一个对象
+ * 记录先拷贝到当前的暂存区, 后台线程在暂存区达到flush_bytes、最早的记录等待超过flush_interval或flush()时
+ * 与正在上传的暂存区交换(双缓冲), 上传期间生产者继续写入另一个暂存区; 暂存区超过max_buffered_bytes时生产者等待.
+ * 每条记录返回一个future, 所在的批次写入成功后得到记录在对象中的结束位置, 失败时得到异常;
+ * 一次追加失败后对象的长度未知, 之后的记录都以同一个异常失败
+ */
+class AppendWriter {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        std::size_t flush_bytes = 4 << 20;
+        std::chrono::nanoseconds flush_interval = std::chrono::milliseconds(10);
+        std::size_t max_buffered_bytes = 16 << 20;
+
+        static Options from_config() {
+            return Options{
+                .flush_bytes = std::max<std::size_t>(1, CONFIG::APPEND_FLUSH_BYTES),
+                .flush_interval = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double, std::milli>(CONFIG::APPEND_FLUSH_INTERVAL_MS)),
+                .max_buffered_bytes = CONFIG::APPEND_MAX_BUFFERED_BYTES,
+            };
+        }
+    };
+
+    // 成功写入的部分
+    struct Stats {
+        std::size_t records = 0;
+        // 成功的append_object次数
+        std::size_t flushes = 0;
+        std::size_t bytes = 0;
+    };
+
+    // start_pos为对象当前的长度(新对象为0)
+    AppendWriter(const ObjectStore &store, std::string key, std::size_t start_pos = 0, const Options &options = Options::from_config())
+        : store_(store), key_(std::move(key)), options_(options), position_(start_pos) {
+        flusher_ = std::thread([this]() { run(); });
+    }
+
+    ~AppendWriter() {
+        close();
+    }
+
+    AppendWriter(const AppendWriter &) = delete;
+    AppendWriter &operator=(const AppendWriter &) = delete;
+
+    // 拷贝record到暂存区, 返回的future在记录写入对象后就绪
+    std::future<std::size_t> append(std::string_view record) {
+        std::promise<std::size_t> promise;
+        std::future<std::size_t> future = promise.get_future();
+        std::unique_lock<std::mutex> lock(mutex_);
+        space_cv_.wait(lock, [&]() { return closing_ || error_ || active_.data.size() < options_.max_buffered_bytes; });
+        if (error_) {
+            promise.set_exception(error_);
+            return future;
+        }
+        if (closing_) {
+            throw ObjectStore::Error(fmt::format("AppendWriter for {} is closed", key_));
+        }
+        if (active_.records.empty()) {
+            active_.first_append = Clock::now();
+        }
+        std::size_t size_before = active_.data.size();
+        active_.data.append(record);
+        active_.records.emplace_back(std::move(promise), active_.data.size());
+        ++appended_records_;
+        // 开始计时或达到大小阈值时唤醒后台线程
+        if (active_.records.size() == 1 || (size_before < options_.flush_bytes && active_.data.size() >= options_.flush_bytes)) {
+            flush_cv_.notify_one();
+        }
+        return future;
+    }
+
+    // 等待此前append的记录全部写入, 写入失败时抛出异常
+    void flush() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        flush_target_ = std::max(flush_target_, appended_records_);
+        flush_cv_.notify_one();
+        durable_cv_.wait(lock, [&]() { return durable_records_ >= flush_target_; });
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+    // 写入剩余的记录并停止后台线程, 之后append抛出异常
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (closing_) {
+                return;
+            }
+            closing_ = true;
+        }
+        flush_cv_.notify_one();
+        space_cv_.notify_all();
+        flusher_.join();
+    }
+
+    // 已经写入的长度
+    std::size_t position() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return position_;
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+  private:
+    struct Batch {
+        std::string data;
+        // 每条记录的promise和在data中的结束位置
+        std::vector<std::pair<std::promise<std::size_t>, std::size_t>> records;
+        Clock::time_point first_append;
+    };
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            auto ready = [&]() {
+                return closing_ || active_.data.size() >= options_.flush_bytes || flush_target_ > durable_records_;
+            };
+            while (!ready()) {
+                if (active_.records.empty()) {
+                    flush_cv_.wait(lock);
+                } else if (flush_cv_.wait_until(lock, active_.first_append + options_.flush_interval) == std::cv_status::timeout) {
+                    break;
+                }
+            }
+            if (active_.records.empty()) {
+                if (closing_) {
+                    return;
+                }
+                continue;
+            }
+
+            std::swap(active_, flushing_);
+            space_cv_.notify_all();
+            std::size_t start_pos = position_;
+            std::exception_ptr error = error_;
+            lock.unlock();
+
+            if (!error) {
+                try {
+                    std::size_t next_pos = store_.append_object(key_, flushing_.data, start_pos);
+                    LOG_DEBUG("append {} records ({} bytes) to {} at {}", flushing_.records.size(), flushing_.data.size(), key_, start_pos);
+                    if (next_pos != start_pos + flushing_.data.size()) {
+                        throw ObjectStore::Error(fmt::format("Error in AppendWriter, key: {}, next position: {} != {} + {}", key_, next_pos, start_pos, flushing_.data.size()));
+                    }
+                } catch (...) {
+                    error = std::current_exception();
+                }
+            }
+            for (auto &[promise, end] : flushing_.records) {
+                if (error) {
+                    promise.set_exception(error);
+                } else {
+                    promise.set_value(start_pos + end);
+                }
+            }
+
+            lock.lock();
+            if (error) {
+                error_ = error;
+                // 等待空间的生产者直接失败
+                space_cv_.notify_all();
+            } else {
+                position_ += flushing_.data.size();
+                ++stats_.flushes;
+                stats_.bytes += flushing_.data.size();
+                stats_.records += flushing_.records.size();
+            }
+            durable_records_ += flushing_.records.size();
+            flushing_.data.clear();
+            flushing_.records.clear();
+            durable_cv_.notify_all();
+        }
+    }
+
+    const ObjectStore &store_;
+    const std::string key_;
+    const Options options_;
+
+    mutable std::mutex mutex_;
+    // 后台线程等待暂存区就绪
+    std::condition_variable flush_cv_;
+    // 生产者等待暂存区有空间
+    std::condition_variable space_cv_;
+    // flush()等待记录写入
+    std::condition_variable durable_cv_;
+    // 生产者写入active_, 后台线程上传flushing_, 两者交换时保留已分配的内存
+    Batch active_;
+    Batch flushing_;
+    std::size_t position_;
+    std::size_t appended_records_ = 0;
+    // 已经完成(成功或失败)的记录数
+    std::size_t durable_records_ = 0;
+    std::size_t flush_target_ = 0;
+    bool closing_ = false;
+    std::exception_ptr error_;
+    Stats stats_;
+    std::thread flusher_;
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief 线程安全的bump分配器, 只分配不释放, 随Arena一起销毁
+ * 当前块上用fetch_add分配, 不加锁; 当前块用完时加锁换一个新块, 块尾不够的部分直接丢弃.
+ * 大于块大小1/4的分配单独分配一块, 不替换当前块, 避免浪费当前块的剩余空间
+ */
+class Arena {
+  public:
+    static constexpr std::size_t ALIGNMENT = 8;
+
+    explicit Arena(std::size_t block_bytes = 1 << 20) : block_bytes_(std::max<std::size_t>(block_bytes, 4096)) {
+        current_.store(new_block(block_bytes_, false), std::memory_order_release);
+    }
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    // 返回按ALIGNMENT对齐的内存
+    char *allocate(std::size_t bytes) {
+        bytes = (bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+        if (bytes > block_bytes_ / 4) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return new_block(bytes, true)->data.get();
+        }
+        while (true) {
+            Block *block = current_.load(std::memory_order_acquire);
+            std::size_t offset = block->used.fetch_add(bytes, std::memory_order_relaxed);
+            if (offset + bytes <= block->size) {
+                return block->data.get() + offset;
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            // 其他线程可能已经换了新块
+            if (current_.load(std::memory_order_relaxed) == block) {
+                current_.store(new_block(block_bytes_, false), std::memory_order_release);
+            }
+        }
+    }
+
+    // 已经向系统申请的内存, 包括块尾未使用的部分
+    std::size_t memory_usage() const {
+        return memory_usage_.load(std::memory_order_relaxed);
+    }
+
+  private:
+    struct Block {
+        std::unique_ptr<char[]> data;
+        std::size_t size;
+        std::atomic<std::size_t> used = 0;
+    };
+
+    // 需要持有mutex_(构造时除外); dedicated的块整块用于一次分配
+    Block *new_block(std::size_t size, bool dedicated) {
+        auto block = std::make_unique<Block>();
+        block->data.reset(new char[size]);
+        block->size = size;
+        block->used.store(dedicated ? size : 0, std::memory_order_relaxed);
+        blocks_.push_back(std::move(block));
+        memory_usage_.fetch_add(size, std::memory_order_relaxed);
+        return blocks_.back().get();
+    }
+
+    const std::size_t block_bytes_;
+    std::atomic<Block *> current_;
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<Block>> blocks_;
+    std::atomic<std::size_t> memory_usage_ = 0;
+};
@@ -0,0 +1,179 @@
+#pragma once
+
+#include "fmt/core.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief 分块Bloom过滤器(split block): 每个key只落在一个256位的块中, 在块的8个32位字中各置1位,
+ * 一次查询只访问一条缓存行, 8个位置用AVX2的一次乘法和移位算出, 一次比较判断.
+ * 批量查询先算出所有key的块并预取, 再逐个比较, 把对块的访存重叠起来
+ *
+ * 序列化格式: [num_blocks: u32][块0]...[块n-1], 每块8个u32, 小端序. key的哈希由hash()计算, 不依赖标准库的实现;
+ * 不依赖ObjectStore, 格式错误时抛出std::invalid_argument, 由调用方(SstReader)先用valid()检查并报告所在的对象
+ */
+class BloomFilter {
+  public:
+    static constexpr std::size_t BLOCK_BITS = 256;
+
+    // 与std::hash不同, 结果写入SST, 需要固定算法
+    static uint64_t hash(std::string_view key) {
+        constexpr uint64_t M = 0x9e3779b97f4a7c15ull;
+        uint64_t h = key.size() * M;
+        std::size_t i = 0;
+        for (; i + 8 <= key.size(); i += 8) {
+            uint64_t v;
+            memcpy(&v, key.data() + i, 8);
+            h = (h ^ mix(v)) * M;
+        }
+        uint64_t tail = 0;
+        if (i < key.size()) {
+            memcpy(&tail, key.data() + i, key.size() - i);
+        }
+        return mix(h ^ mix(tail));
+    }
+
+    // 按bits_per_key为hashes构建, 返回序列化的过滤器
+    static std::string build(const std::vector<uint64_t> &hashes, double bits_per_key) {
+        std::size_t num_blocks = std::max<std::size_t>(1, static_cast<std::size_t>(std::ceil(hashes.size() * bits_per_key / BLOCK_BITS)));
+        std::vector<Block> blocks(num_blocks);
+        for (uint64_t h : hashes) {
+            uint32_t mask[8];
+            block_mask(h, mask);
+            Block &block = blocks[block_index(h, num_blocks)];
+            for (int i = 0; i < 8; ++i) {
+                block.words[i] |= mask[i];
+            }
+        }
+        std::string out(4 + num_blocks * sizeof(Block), '\0');
+        uint32_t count = static_cast<uint32_t>(num_blocks);
+        memcpy(out.data(), &count, 4);
+        memcpy(out.data() + 4, blocks.data(), num_blocks * sizeof(Block));
+        return out;
+    }
+
+    // data的大小与其中的块数一致
+    static bool valid(std::string_view data) {
+        uint32_t num_blocks = block_count(data);
+        return num_blocks > 0 && data.size() == 4 + num_blocks * sizeof(Block);
+    }
+
+    // 拷贝到按块对齐的内存中
+    explicit BloomFilter(std::string_view data) {
+        if (!valid(data)) {
+            throw std::invalid_argument(fmt::format("Error in BloomFilter, size: {} does not match blocks: {}", data.size(), block_count(data)));
+        }
+        uint32_t num_blocks = block_count(data);
+        blocks_.resize(num_blocks);
+        memcpy(blocks_.data(), data.data() + 4, num_blocks * sizeof(Block));
+    }
+
+    bool may_contain(uint64_t h) const {
+        uint32_t mask[8];
+        block_mask(h, mask);
+        const Block &block = blocks_[block_index(h, blocks_.size())];
+        for (int i = 0; i < 8; ++i) {
+            if ((block.words[i] & mask[i]) != mask[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // results[i] = may_contain(hashes[i]); CPU支持AVX2时用AVX2比较
+    void may_contain(const uint64_t *hashes, std::size_t count, bool *results) const {
+#if defined(__x86_64__) || defined(__i386__)
+        static const bool avx2 = __builtin_cpu_supports("avx2");
+        if (avx2) {
+            may_contain_avx2(hashes, count, results);
+            return;
+        }
+#endif
+        may_contain_scalar(hashes, count, results);
+    }
+
+    void may_contain_scalar(const uint64_t *hashes, std::size_t count, bool *results) const {
+        for (std::size_t i = 0; i < count; ++i) {
+            results[i] = may_contain(hashes[i]);
+        }
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    __attribute__((target("avx2"))) void may_contain_avx2(const uint64_t *hashes, std::size_t count, bool *results) const {
+        const __m256i salt = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(SALT));
+        const __m256i ones = _mm256_set1_epi32(1);
+        uint32_t indexes[PROBE_BATCH];
+        for (std::size_t start = 0; start < count; start += PROBE_BATCH) {
+            std::size_t n = std::min(PROBE_BATCH, count - start);
+            for (std::size_t i = 0; i < n; ++i) {
+                indexes[i] = block_index(hashes[start + i], blocks_.size());
+                __builtin_prefetch(&blocks_[indexes[i]]);
+            }
+            for (std::size_t i = 0; i < n; ++i) {
+                __m256i bits = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(static_cast<uint32_t>(hashes[start + i])), salt), 27);
+                __m256i mask = _mm256_sllv_epi32(ones, bits);
+                __m256i block = _mm256_load_si256(reinterpret_cast<const __m256i *>(&blocks_[indexes[i]]));
+                // mask中的位在block中都为1
+                results[start + i] = _mm256_testc_si256(block, mask);
+            }
+        }
+    }
+#endif
+
+    std::size_t bits() const {
+        return blocks_.size() * BLOCK_BITS;
+    }
+
+  private:
+    struct alignas(32) Block {
+        uint32_t words[8] = {};
+    };
+    static_assert(sizeof(Block) * 8 == BLOCK_BITS);
+
+    // 批量查询时一次预取的块数
+    static constexpr std::size_t PROBE_BATCH = 16;
+
+    // 8个奇数乘数, 分别决定块内8个字中置位的位置
+    static constexpr uint32_t SALT[8] = {0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU, 0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+
+    static uint32_t block_count(std::string_view data) {
+        uint32_t num_blocks = 0;
+        if (data.size() >= 4) {
+            memcpy(&num_blocks, data.data(), 4);
+        }
+        return num_blocks;
+    }
+
+    static uint64_t mix(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    // 高32位选择块, 低32位决定块内的位置
+    static uint32_t block_index(uint64_t h, std::size_t num_blocks) {
+        return static_cast<uint32_t>(((h >> 32) * num_blocks) >> 32);
+    }
+
+    static void block_mask(uint64_t h, uint32_t mask[8]) {
+        for (int i = 0; i < 8; ++i) {
+            mask[i] = 1u << ((static_cast<uint32_t>(h) * SALT[i]) >> 27);
+        }
+    }
+
+    std::vector<Block> blocks_;
+};
@@ -0,0 +1,182 @@
+#pragma once
+
+#include "config.h"
+#include "object_store.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief 逐步增加并发时寻找吞吐的拐点
+ * 每一步的并发、吞吐和p99依次传给observe: 吞吐比此前最好的一步增长不到min_gain,
+ * 或p99超过最好一步的max_p99_growth倍, 记为一次停滞, 连续停滞超过patience次即认为到达拐点;
+ * 推荐的并发为最后一次明显提升吞吐的那一步, 更高的并发只会增加排队
+ */
+class KneeFinder {
+  public:
+    struct Step {
+        std::size_t concurrency;
+        double ops_per_s;
+        // 单位ms
+        double lat_p99;
+    };
+
+    KneeFinder(double min_gain, double max_p99_growth, std::size_t patience)
+        : min_gain_(min_gain), max_p99_growth_(max_p99_growth), patience_(patience) {}
+
+    // 返回是否应继续增加并发
+    bool observe(const Step &step) {
+        steps_.push_back(step);
+        if (steps_.size() == 1) {
+            best_ = step;
+            return true;
+        }
+        bool gained = step.ops_per_s >= best_.ops_per_s * (1 + min_gain_);
+        bool latency_ok = max_p99_growth_ <= 0 || step.lat_p99 <= best_.lat_p99 * max_p99_growth_;
+        if (gained && latency_ok) {
+            best_ = step;
+            stalls_ = 0;
+            return true;
+        }
+        return ++stalls_ <= patience_;
+    }
+
+    const Step &best() const { return best_; }
+
+    // 是否观察到拐点; 为false时说明直到最大并发吞吐仍在增长
+    bool reached_knee() const { return stalls_ > patience_; }
+
+    const std::vector<Step> &steps() const { return steps_; }
+
+  private:
+    double min_gain_;
+    double max_p99_growth_;
+    std::size_t patience_;
+    std::vector<Step> steps_;
+    Step best_{};
+    std::size_t stalls_ = 0;
+};
+
+/**
+ * @brief 运行时的AIMD并发限制, 包在HuaweiCloudObs等ObjectStore的调用外面, 让在途请求数停在拐点附近
+ * 请求正常完成时limit每轮(约limit个请求)加1; 遇到限流错误(SlowDown/503/超时)或延迟超过latency_threshold时乘以backoff_ratio,
+ * 同一次拥塞中已经发出的请求陆续失败时只减一次; 调用方本身的并发不到limit一半时不增加, 避免空闲时limit无限增长.
+ * 初始值和延迟阈值可以取tune_concurrency给出的推荐并发和对应的p99
+ */
+class AimdLimiter {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        double initial_limit = 16;
+        double min_limit = 1;
+        double max_limit = 256;
+        double backoff_ratio = 0.7;
+        // 超过该延迟视为拥塞, 0表示只按错误判断
+        std::chrono::nanoseconds latency_threshold{0};
+
+        static Options from_config() {
+            return Options{
+                .initial_limit = CONFIG::AIMD_INITIAL_LIMIT,
+                .min_limit = CONFIG::AIMD_MIN_LIMIT,
+                .max_limit = CONFIG::AIMD_MAX_LIMIT,
+                .backoff_ratio = CONFIG::AIMD_BACKOFF_RATIO,
+                .latency_threshold = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double, std::milli>(CONFIG::AIMD_LATENCY_THRESHOLD_MS)),
+            };
+        }
+    };
+
+    explicit AimdLimiter(const Options &options = Options::from_config())
+        : options_(options), limit_(std::clamp(options.initial_limit, std::max(options.min_limit, 1.0), options.max_limit)) {
+        LOG_ASSERT(options_.backoff_ratio > 0 && options_.backoff_ratio < 1, "backoff_ratio must be in (0, 1): {}", options_.backoff_ratio);
+    }
+
+    AimdLimiter(const AimdLimiter &) = delete;
+    AimdLimiter &operator=(const AimdLimiter &) = delete;
+
+    // 等到在途请求数小于limit, 返回请求开始的时间, 完成后以该时间调用release
+    Clock::time_point acquire() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [&]() { return in_flight_ < limit_; });
+        ++in_flight_;
+        return Clock::now();
+    }
+
+    // overloaded为请求是否遇到限流; 延迟超过latency_threshold同样视为限流
+    void release(Clock::time_point started, bool overloaded = false) {
+        auto now = Clock::now();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --in_flight_;
+            if (options_.latency_threshold.count() > 0 && now - started > options_.latency_threshold) {
+                overloaded = true;
+            }
+            if (overloaded) {
+                // 在上次减小之前发出的请求反映的是减小前的并发, 不再重复减小
+                if (started >= last_decrease_) {
+                    limit_ = std::max(std::max(options_.min_limit, 1.0), limit_ * options_.backoff_ratio);
+                    last_decrease_ = now;
+                    ++decreases_;
+                }
+            } else if ((in_flight_ + 1) * 2 >= limit_) {
+                limit_ = std::min(options_.max_limit, limit_ + 1.0 / limit_);
+            }
+        }
+        cv_.notify_all();
+    }
+
+    // 在limit之内执行f, 按f抛出的ObjectStore::Error判断是否限流, 异常继续向上抛出
+    template <typename F>
+    std::invoke_result_t<F &> call(F &&f) {
+        Clock::time_point started = acquire();
+        try {
+            if constexpr (std::is_void_v<std::invoke_result_t<F &>>) {
+                f();
+                release(started);
+            } else {
+                auto result = f();
+                release(started);
+                return result;
+            }
+        } catch (const ObjectStore::Error &e) {
+            release(started, is_overload(e.status));
+            throw;
+        } catch (...) {
+            release(started);
+            throw;
+        }
+    }
+
+    double limit() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return limit_;
+    }
+
+    std::size_t in_flight() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return in_flight_;
+    }
+
+    std::size_t decreases() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return decreases_;
+    }
+
+    // 服务端过载的信号: 降低并发可以缓解
+    static bool is_overload(obs_status status) {
+        return status == OBS_STATUS_SlowDown || status == OBS_STATUS_ServiceUnavailable || status == OBS_STATUS_RequestTimeout;
+    }
+
+  private:
+    const Options options_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    double limit_;
+    std::size_t in_flight_ = 0;
+    std::size_t decreases_ = 0;
+    Clock::time_point last_decrease_{};
+};
@@ -6,6 +6,11 @@
 struct CONFIG {
     static inline std::string_view ENDPOINT = "obs.cn-east-3.myhuaweicloud.com";
 
+    // 连接本地的obs_server时使用http和path风格(bucket在路径中而不是域名中)
+    static inline std::string_view PROTOCOL = "https";
+
+    static inline std::string_view URI_STYLE = "virtualhost";
+
     static inline std::string_view BUCKET_LOCATION = "cn-east-3";
 
     static inline std::string_view BUCKET_NAME = "hw-obs-bench";
@@ -14,6 +19,210 @@ struct CONFIG {
 
     static inline std::string_view SECRET_ACCESS_KEY = "";
 
+    // put_object大于等于该大小时自动切换为分段上传, 0表示不切换
+    static inline std::size_t MULTIPART_THRESHOLD = 64 << 20;
+
+    static inline std::size_t MULTIPART_PART_SIZE = 16 << 20;
+
+    // 每个对象并发上传的段数
+    static inline std::size_t MULTIPART_CONCURRENCY = 8;
+
+    // async_*接口共享的工作线程数, 即同时在途的最大请求数
+    static inline std::size_t ASYNC_THREADS = 64;
+
+    // list_objects_parallel按<前缀 + 字符>划分key空间, 与key的命名方式相关
+    static inline std::string_view LIST_SHARD_ALPHABET = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+    static inline std::size_t LIST_CONCURRENCY = 16;
+
+    // delete_objects同时在途的批量删除请求数
+    static inline std::size_t DELETE_IN_FLIGHT = 8;
+
+    // HuaweiCloudObs对网络错误、超时和限流(SlowDown/503)的重试, 包括首次请求在内最多RETRY_MAX_ATTEMPTS次
+    static inline std::size_t RETRY_MAX_ATTEMPTS = 3;
+
+    // 第n次重试前随机等待[0, min(RETRY_MAX_DELAY_MS, base * 2^(n-1))], 限流错误的base为RETRY_THROTTLE_DELAY_MS
+    static inline double RETRY_BASE_DELAY_MS = 20;
+
+    static inline double RETRY_THROTTLE_DELAY_MS = 200;
+
+    static inline double RETRY_MAX_DELAY_MS = 2000;
+
+    // 重试预算: 每个成功的请求存入RETRY_BUDGET_RATIO个令牌, 每次重试取走1个, 最多RETRY_BUDGET_CAPACITY个
+    static inline double RETRY_BUDGET_RATIO = 0.1;
+
+    static inline double RETRY_BUDGET_CAPACITY = 100;
+
+    // 非0时HuaweiCloudObs的GET和小的put_object_unique在超过同类请求延迟的HEDGE_PERCENTILE分位数(不低于HEDGE_MIN_DELAY_MS)后发出对冲请求
+    static inline std::size_t HEDGE_ENABLE = 0;
+
+    static inline double HEDGE_PERCENTILE = 0.95;
+
+    static inline double HEDGE_MIN_DELAY_MS = 1;
+
+    // 对冲请求数不超过请求数的HEDGE_MAX_RATIO(另有HEDGE_BURST个的突发)
+    static inline double HEDGE_MAX_RATIO = 0.05;
+
+    static inline double HEDGE_BURST = 10;
+
+    // 超过该大小的PUT不对冲, 避免重复上传大对象
+    static inline std::size_t HEDGE_PUT_MAX_SIZE = 1 << 20;
+
+    // 执行主请求和对冲请求的线程数, 应不少于调用方并发的2倍
+    static inline std::size_t HEDGE_THREADS = 256;
+
+    // HuaweiCloudObs的客户端限流, 每个请求(包括重试和对冲)发出前取令牌, 0表示不限: 整个桶的请求数/s和MB/s
+    static inline double RATE_LIMIT_OPS = 0;
+
+    static inline double RATE_LIMIT_MBPS = 0;
+
+    // 每个key前缀(前RATE_LIMIT_PREFIX_LENGTH个字符)的请求数/s和MB/s, 前缀按哈希分到RATE_LIMIT_PREFIX_SLOTS个令牌桶
+    static inline std::size_t RATE_LIMIT_PREFIX_LENGTH = 0;
+
+    static inline double RATE_LIMIT_PREFIX_OPS = 0;
+
+    static inline double RATE_LIMIT_PREFIX_MBPS = 0;
+
+    static inline std::size_t RATE_LIMIT_PREFIX_SLOTS = 1024;
+
+    // 空闲之后允许的突发, 为RATE_LIMIT_BURST_SECONDS秒的令牌
+    static inline double RATE_LIMIT_BURST_SECONDS = 0.1;
+
+    // AppendWriter的暂存区达到APPEND_FLUSH_BYTES或最早的记录等待APPEND_FLUSH_INTERVAL_MS后合并为一次append_object
+    static inline std::size_t APPEND_FLUSH_BYTES = 4 << 20;
+
+    static inline double APPEND_FLUSH_INTERVAL_MS = 10;
+
+    // 上传期间暂存区超过该大小时生产者等待
+    static inline std::size_t APPEND_MAX_BUFFERED_BYTES = 16 << 20;
+
+    // WAL的段达到该大小后切换到新的段对象, 组提交使用APPEND_FLUSH_*
+    static inline std::size_t WAL_SEGMENT_BYTES = 64 << 20;
+
+    // 回放WAL时每次get_range读取的大小
+    static inline std::size_t WAL_READ_BYTES = 4 << 20;
+
+    // 当前MemTable的Arena达到该大小后冻结并交给flush线程
+    static inline std::size_t MEMTABLE_BYTES = 64 << 20;
+
+    // 等待flush的不可变MemTable达到该数量时写入等待
+    static inline std::size_t MEMTABLE_MAX_IMMUTABLE = 2;
+
+    // SST数据块的大小, 点查时一次get_range读取一个数据块
+    static inline std::size_t SST_BLOCK_BYTES = 64 << 10;
+
+    // 打开SST时从对象末尾读取的大小, 足以容纳过滤器块和索引块时打开只需一次GET
+    static inline std::size_t SST_TAIL_READ_BYTES = 1 << 20;
+
+    // 写入SST时每个key的Bloom过滤器位数, 10位时误判率约1%; 0表示不生成过滤器
+    static inline double SST_BLOOM_BITS_PER_KEY = 10;
+
+    // get_object_store()使用的后端: obs, memory(进程内), fs(本地目录FS_STORE_ROOT)
+    static inline std::string_view OBJECT_STORE = "obs";
+
+    static inline std::string_view FS_STORE_ROOT = "/tmp/hw_obs_store";
+
+    // ---- hw_obs_bench中run_threads的运行方式, 类似fio的number_ios / runtime / ramp_time ----
+
+    // 测量阶段每个线程最多执行的次数, 0表示不限(此时必须设置BENCH_RUNTIME)
+    static inline std::size_t BENCH_NUMBER_IOS = 10;
+
+    // 测量阶段的最长运行时间(秒), 0表示不限
+    static inline double BENCH_RUNTIME = 0;
+
+    // 线程在该时间(秒)内均匀错开启动
+    static inline double BENCH_RAMP_UP = 0;
+
+    // 所有线程启动后继续运行该时间(秒)再开始测量, 期间的请求不计入结果, 只出现在每秒的时间序列中
+    static inline double BENCH_WARMUP = 0;
+
+    // 请求的发起方式: closed(闭环, 每个线程等上一个请求完成后立即发起下一个),
+    // constant(开环, 固定间隔), poisson(开环, 指数分布的间隔); 开环时延迟从计划发起的时间算起
+    static inline std::string_view BENCH_ARRIVAL = "closed";
+
+    // 开环时所有线程合计的目标请求速率(ops/s), 平均分给每个线程
+    static inline double BENCH_RATE = 0;
+
+    // 压测工作线程的CPU绑定: none, compact(按CPU编号依次绑定), numa(依次轮流使用各NUMA节点), 或CPU列表如"0-7,16-23"
+    static inline std::string_view BENCH_CPU_AFFINITY = "none";
+
+    // ---- hw_obs_bench中ycsb混合负载的配置 ----
+
+    // 各操作的比例: get, put(覆盖已有对象), insert(写入新对象), append, list(列举一页), delete
+    static inline std::string_view YCSB_OPS = "get=0.5,put=0.3,append=0.1,list=0.05,delete=0.05";
+
+    // 装载阶段写入的对象数
+    static inline std::size_t YCSB_RECORD_COUNT = 10000;
+
+    // key的热度分布: uniform, zipfian, latest
+    static inline std::string_view YCSB_KEY_DISTRIBUTION = "zipfian";
+
+    static inline double YCSB_ZIPF_THETA = 0.99;
+
+    // 对象大小的分布(字节): fixed:<size>, uniform:<min>:<max>, lognormal:<median>:<sigma>:<max>
+    static inline std::string_view YCSB_VALUE_SIZE = "fixed:4096";
+
+    // append写入的对象数, 按key分布选择
+    static inline std::size_t YCSB_APPEND_KEY_COUNT = 100;
+
+    // ---- hw_obs_bench中replay(回放访问日志)的配置, 格式见TraceRecord ----
+
+    // JSONL格式的访问日志路径, 为空时跳过replay
+    static inline std::string_view REPLAY_TRACE = "";
+
+    // 回放速度相对原始时间的倍数, 0表示尽快回放
+    static inline double REPLAY_SPEED = 1;
+
+    // 读取不存在的对象时按记录的大小补写
+    static inline std::size_t REPLAY_FILL_MISSING = 1;
+
+    // 时间序列的窗口大小(秒)
+    static inline std::size_t REPLAY_WINDOW = 1;
+
+    // ---- hw_obs_bench中tune_concurrency(按object_size寻找吞吐拐点)的配置, 每一步按BENCH_*运行 ----
+
+    // 并发从1开始每步乘以TUNE_STEP_FACTOR, 不超过TUNE_MAX_CONCURRENCY
+    static inline std::size_t TUNE_MAX_CONCURRENCY = 256;
+
+    static inline double TUNE_STEP_FACTOR = 2;
+
+    // 吞吐相对此前最好的一步增长不到该比例记为停滞
+    static inline double TUNE_MIN_GAIN = 0.1;
+
+    // p99超过最好一步的该倍数也记为停滞, 0表示不看延迟
+    static inline double TUNE_MAX_P99_GROWTH = 3;
+
+    // 连续停滞超过该次数即停止
+    static inline std::size_t TUNE_PATIENCE = 1;
+
+    // ---- AimdLimiter(运行时的并发限制)的默认配置 ----
+
+    static inline double AIMD_INITIAL_LIMIT = 16;
+
+    static inline double AIMD_MIN_LIMIT = 1;
+
+    static inline double AIMD_MAX_LIMIT = 256;
+
+    // 遇到限流时limit乘以该比例
+    static inline double AIMD_BACKOFF_RATIO = 0.7;
+
+    // 延迟超过该值(ms)视为限流, 0表示只按SlowDown/503/超时错误判断
+    static inline double AIMD_LATENCY_THRESHOLD_MS = 0;
+
+    // ---- obs_server(本地的OBS替身)的配置, 监听地址为CONFIG::ENDPOINT ----
+
+    // 每个请求在返回响应头之前的附加延迟, 单位us:
+    // none, fixed:<us>, uniform:<min>:<max>, exp:<mean>, lognormal:<median>:<sigma>, pareto:<min>:<alpha>
+    static inline std::string_view SERVER_LATENCY = "none";
+
+    // 所有连接共享的收发带宽上限(字节/秒), 0表示不限
+    static inline std::size_t SERVER_BANDWIDTH = 0;
+
+    // 以该概率直接返回SERVER_ERROR_CODE错误(SlowDown/ServiceUnavailable为503, 其他为500)
+    static inline double SERVER_ERROR_RATE = 0;
+
+    static inline std::string_view SERVER_ERROR_CODE = "SlowDown";
+
     template <typename T>
     inline static void init_config(T &config, std::string_view config_name) {
         std::string_view config_name_sv = config_name.substr(config_name.find("::") + 2);
@@ -22,8 +231,10 @@ struct CONFIG {
         if (env) {
             if constexpr (std::is_same<T, std::string_view>::value) {
                 config = std::string_view(env);
+            } else if constexpr (std::is_floating_point<T>::value) {
+                config = static_cast<T>(std::stod(env));
             } else {
-                config = static_cast<T>(std::stoi(env));
+                config = static_cast<T>(std::stoll(env));
             }
         }
         LOG_PRINT("{} = {}", env_name, config);
@@ -38,8 +249,80 @@ struct CONFIG {
 
 inline void init_all_config() {
     INIT_CONFIG(CONFIG::ENDPOINT);
+    INIT_CONFIG(CONFIG::PROTOCOL);
+    INIT_CONFIG(CONFIG::URI_STYLE);
     INIT_CONFIG(CONFIG::BUCKET_LOCATION);
     INIT_CONFIG(CONFIG::BUCKET_NAME);
     INIT_CONFIG(CONFIG::ACCESS_KEY_ID);
     INIT_CONFIG(CONFIG::SECRET_ACCESS_KEY);
+    INIT_CONFIG(CONFIG::MULTIPART_THRESHOLD);
+    INIT_CONFIG(CONFIG::MULTIPART_PART_SIZE);
+    INIT_CONFIG(CONFIG::MULTIPART_CONCURRENCY);
+    INIT_CONFIG(CONFIG::ASYNC_THREADS);
+    INIT_CONFIG(CONFIG::LIST_SHARD_ALPHABET);
+    INIT_CONFIG(CONFIG::LIST_CONCURRENCY);
+    INIT_CONFIG(CONFIG::DELETE_IN_FLIGHT);
+    INIT_CONFIG(CONFIG::RETRY_MAX_ATTEMPTS);
+    INIT_CONFIG(CONFIG::RETRY_BASE_DELAY_MS);
+    INIT_CONFIG(CONFIG::RETRY_THROTTLE_DELAY_MS);
+    INIT_CONFIG(CONFIG::RETRY_MAX_DELAY_MS);
+    INIT_CONFIG(CONFIG::RETRY_BUDGET_RATIO);
+    INIT_CONFIG(CONFIG::RETRY_BUDGET_CAPACITY);
+    INIT_CONFIG(CONFIG::HEDGE_ENABLE);
+    INIT_CONFIG(CONFIG::HEDGE_PERCENTILE);
+    INIT_CONFIG(CONFIG::HEDGE_MIN_DELAY_MS);
+    INIT_CONFIG(CONFIG::HEDGE_MAX_RATIO);
+    INIT_CONFIG(CONFIG::HEDGE_BURST);
+    INIT_CONFIG(CONFIG::HEDGE_PUT_MAX_SIZE);
+    INIT_CONFIG(CONFIG::HEDGE_THREADS);
+    INIT_CONFIG(CONFIG::RATE_LIMIT_OPS);
+    INIT_CONFIG(CONFIG::RATE_LIMIT_MBPS);
+    INIT_CONFIG(CONFIG::RATE_LIMIT_PREFIX_LENGTH);
+    INIT_CONFIG(CONFIG::RATE_LIMIT_PREFIX_OPS);
+    INIT_CONFIG(CONFIG::RATE_LIMIT_PREFIX_MBPS);
+    INIT_CONFIG(CONFIG::RATE_LIMIT_PREFIX_SLOTS);
+    INIT_CONFIG(CONFIG::RATE_LIMIT_BURST_SECONDS);
+    INIT_CONFIG(CONFIG::APPEND_FLUSH_BYTES);
+    INIT_CONFIG(CONFIG::APPEND_FLUSH_INTERVAL_MS);
+    INIT_CONFIG(CONFIG::APPEND_MAX_BUFFERED_BYTES);
+    INIT_CONFIG(CONFIG::WAL_SEGMENT_BYTES);
+    INIT_CONFIG(CONFIG::WAL_READ_BYTES);
+    INIT_CONFIG(CONFIG::MEMTABLE_BYTES);
+    INIT_CONFIG(CONFIG::MEMTABLE_MAX_IMMUTABLE);
+    INIT_CONFIG(CONFIG::SST_BLOCK_BYTES);
+    INIT_CONFIG(CONFIG::SST_TAIL_READ_BYTES);
+    INIT_CONFIG(CONFIG::SST_BLOOM_BITS_PER_KEY);
+    INIT_CONFIG(CONFIG::OBJECT_STORE);
+    INIT_CONFIG(CONFIG::FS_STORE_ROOT);
+    INIT_CONFIG(CONFIG::BENCH_NUMBER_IOS);
+    INIT_CONFIG(CONFIG::BENCH_RUNTIME);
+    INIT_CONFIG(CONFIG::BENCH_RAMP_UP);
+    INIT_CONFIG(CONFIG::BENCH_WARMUP);
+    INIT_CONFIG(CONFIG::BENCH_ARRIVAL);
+    INIT_CONFIG(CONFIG::BENCH_RATE);
+    INIT_CONFIG(CONFIG::BENCH_CPU_AFFINITY);
+    INIT_CONFIG(CONFIG::YCSB_OPS);
+    INIT_CONFIG(CONFIG::YCSB_RECORD_COUNT);
+    INIT_CONFIG(CONFIG::YCSB_KEY_DISTRIBUTION);
+    INIT_CONFIG(CONFIG::YCSB_ZIPF_THETA);
+    INIT_CONFIG(CONFIG::YCSB_VALUE_SIZE);
+    INIT_CONFIG(CONFIG::YCSB_APPEND_KEY_COUNT);
+    INIT_CONFIG(CONFIG::REPLAY_TRACE);
+    INIT_CONFIG(CONFIG::REPLAY_SPEED);
+    INIT_CONFIG(CONFIG::REPLAY_FILL_MISSING);
+    INIT_CONFIG(CONFIG::REPLAY_WINDOW);
+    INIT_CONFIG(CONFIG::TUNE_MAX_CONCURRENCY);
+    INIT_CONFIG(CONFIG::TUNE_STEP_FACTOR);
+    INIT_CONFIG(CONFIG::TUNE_MIN_GAIN);
+    INIT_CONFIG(CONFIG::TUNE_MAX_P99_GROWTH);
+    INIT_CONFIG(CONFIG::TUNE_PATIENCE);
+    INIT_CONFIG(CONFIG::AIMD_INITIAL_LIMIT);
+    INIT_CONFIG(CONFIG::AIMD_MIN_LIMIT);
+    INIT_CONFIG(CONFIG::AIMD_MAX_LIMIT);
+    INIT_CONFIG(CONFIG::AIMD_BACKOFF_RATIO);
+    INIT_CONFIG(CONFIG::AIMD_LATENCY_THRESHOLD_MS);
+    INIT_CONFIG(CONFIG::SERVER_LATENCY);
+    INIT_CONFIG(CONFIG::SERVER_BANDWIDTH);
+    INIT_CONFIG(CONFIG::SERVER_ERROR_RATE);
+    INIT_CONFIG(CONFIG::SERVER_ERROR_CODE);
 }
\ No newline at end of file
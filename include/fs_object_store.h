@@ -0,0 +1,346 @@
+#pragma once
+
+#include "object_store.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * @brief 本地文件系统上的对象存储, 每个对象一个文件
+ * key经过百分号编码后作为root/objects下的文件名, 超过NAME_MAX时按段拆成以'%'结尾的子目录, PUT先写root/tmp下的临时文件再rename;
+ * append_object按key的hash加分片锁, 保证检查长度和追加之间不被同进程的其他追加打断
+ */
+class FsObjectStore : public ObjectStore {
+  public:
+    using ObjectStore::batch_delete_objects;
+    using ObjectStore::put_object;
+
+    explicit FsObjectStore(std::string root) : root_(std::move(root)), objects_dir_(root_ + "/objects/"), tmp_dir_(root_ + "/tmp/") {
+        for (const auto &dir : {root_, objects_dir_, tmp_dir_}) {
+            LOG_ASSERT(::mkdir(dir.c_str(), 0755) == 0 || errno == EEXIST, "mkdir {} failed: {}", dir, strerror(errno));
+        }
+    }
+
+    void put_object_single(const std::string_view &key, const std::string_view &object) const override {
+        write_file(key, [&](int fd) { write_all(fd, object.data(), object.size(), key); });
+    }
+
+    void put_object(const std::string_view &key, UploadSource &source) const override {
+        write_file(key, [&](int fd) {
+            std::vector<char> chunk(std::min<std::size_t>(source.size(), FEED_CHUNK_SIZE));
+            for (std::size_t offset = 0; offset < source.size();) {
+                std::size_t n = source.feed(offset, chunk.data(), chunk.size());
+                write_all(fd, chunk.data(), n, key);
+                offset += n;
+            }
+        });
+    }
+
+    std::size_t append_object(const std::string_view &key, const std::string_view &object, std::size_t start_pos) const override {
+        std::string path = object_path(key);
+        make_parent_dirs(path, key);
+        std::lock_guard<std::mutex> lock(append_mutexes_[std::hash<std::string_view>{}(key) % APPEND_LOCK_COUNT]);
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd < 0) {
+            throw_errno("append_object", key);
+        }
+        struct stat st;
+        ::fstat(fd, &st);
+        if (start_pos != static_cast<std::size_t>(st.st_size)) {
+            ::close(fd);
+            throw Error(fmt::format("Error in append_object, key: {}, position: {} != length: {}", key, start_pos, st.st_size), OBS_STATUS_HttpErrorConflict);
+        }
+        try {
+            write_all(fd, object.data(), object.size(), key);
+        } catch (...) {
+            ::close(fd);
+            throw;
+        }
+        ::close(fd);
+        return start_pos + object.size();
+    }
+
+    std::size_t get_object(const std::string_view &key, char *buffer, std::size_t buffer_size) const override {
+        int fd = open_for_read(key);
+        std::size_t size = file_size(fd);
+        if (size > buffer_size) {
+            ::close(fd);
+            throw Error(fmt::format("Error in get_object, key: {}, buffer size: {}, content length: {}", key, buffer_size, size), OBS_STATUS_AbortedByCallback);
+        }
+        std::size_t read = read_all(fd, 0, size, buffer, key);
+        ::close(fd);
+        return read;
+    }
+
+    std::size_t get_range(const std::string_view &key, std::size_t offset, std::size_t len, char *buffer) const override {
+        if (len == 0) {
+            return 0;
+        }
+        int fd = open_for_read(key);
+        std::size_t size = file_size(fd);
+        if (offset >= size) {
+            ::close(fd);
+            throw Error(fmt::format("Error in get_object, key: {}, range: [{}, {}), content length: {}", key, offset, offset + len, size), OBS_STATUS_InvalidRange);
+        }
+        std::size_t read = read_all(fd, offset, std::min(len, size - offset), buffer, key);
+        ::close(fd);
+        return read;
+    }
+
+    std::size_t head_object(const std::string_view &key) const override {
+        struct stat st;
+        if (::stat(object_path(key).c_str(), &st) != 0) {
+            throw_errno("head_object", key);
+        }
+        return st.st_size;
+    }
+
+    // 与OBS一致, 删除不存在的key不报错; 长key的子目录删空后保留, 避免与并发的PUT竞争
+    void delete_object(const std::string_view &key) const override {
+        if (::unlink(object_path(key).c_str()) != 0 && errno != ENOENT) {
+            throw_errno("delete_object", key);
+        }
+    }
+
+    void batch_delete_objects(const std::string *keys, std::size_t count, std::vector<DeleteFailure> &failures) const override {
+        for (std::size_t i = 0; i < count; ++i) {
+            if (::unlink(object_path(keys[i]).c_str()) != 0 && errno != ENOENT) {
+                failures.push_back({.key = keys[i], .code = "InternalError", .message = strerror(errno)});
+            }
+        }
+    }
+
+    // 目录没有顺序, 每页扫描一遍objects下的所有文件, 只保留start_key之后最小的LIST_MAX_KEYS个key;
+    // 内存不随对象数增长, 但列举N个对象要扫描N / LIST_MAX_KEYS遍, 只适合本地测试的规模
+    void list_objects_pages(const ListPageCallback &on_page, std::string start_key = "", std::string prefix = "", std::string delimiter = "/", bool report_progress = true) const override {
+        while (true) {
+            // 大顶堆, 堆顶是当前页中最大的key
+            std::vector<std::string> page;
+            page.reserve(LIST_MAX_KEYS);
+            for_each_key(objects_dir_, "", [&](std::string key) {
+                if (key <= start_key || key.compare(0, prefix.size(), prefix) != 0 ||
+                    (!delimiter.empty() && key.find(delimiter, prefix.size()) != std::string::npos)) {
+                    return;
+                }
+                if (page.size() == LIST_MAX_KEYS) {
+                    if (key >= page.front()) {
+                        return;
+                    }
+                    std::pop_heap(page.begin(), page.end());
+                    page.back() = std::move(key);
+                } else {
+                    page.push_back(std::move(key));
+                }
+                std::push_heap(page.begin(), page.end());
+            });
+            if (page.empty()) {
+                break;
+            }
+            std::sort_heap(page.begin(), page.end());
+            bool is_truncated = page.size() == LIST_MAX_KEYS;
+            start_key = page.back();
+            if (!on_page(page) || !is_truncated) {
+                break;
+            }
+        }
+    }
+
+    std::size_t get_approximate_object_count() const override {
+        std::size_t count = 0;
+        for_each_key(objects_dir_, "", [&](std::string) { ++count; });
+        return count;
+    }
+
+  private:
+    static constexpr std::size_t FEED_CHUNK_SIZE = 1 << 20;
+
+    static constexpr std::size_t APPEND_LOCK_COUNT = 64;
+
+    // 文件名的上限(NAME_MAX); 编码后更长的key每MAX_SEGMENT_SIZE字节一段, 除最后一段外都作为目录并加上'%'后缀,
+    // 编码后的文件名不会以'%'结尾, 目录与文件不会重名
+    static constexpr std::size_t MAX_NAME_SIZE = 255;
+    static constexpr std::size_t MAX_SEGMENT_SIZE = MAX_NAME_SIZE - 1;
+
+    // 除[A-Za-z0-9_-]和非首位的'.'外都编码为%XX, 保证文件名合法且不以'.'开头
+    static std::string encode_key(const std::string_view &key) {
+        static constexpr char HEX[] = "0123456789ABCDEF";
+        std::string name;
+        name.reserve(key.size());
+        for (std::size_t i = 0; i < key.size(); ++i) {
+            unsigned char c = key[i];
+            if (std::isalnum(c) || c == '_' || c == '-' || (c == '.' && i > 0)) {
+                name.push_back(c);
+            } else {
+                name.push_back('%');
+                name.push_back(HEX[c >> 4]);
+                name.push_back(HEX[c & 0xf]);
+            }
+        }
+        return name;
+    }
+
+    static std::string decode_key(const std::string_view &name) {
+        std::string key;
+        key.reserve(name.size());
+        for (std::size_t i = 0; i < name.size(); ++i) {
+            if (name[i] == '%' && i + 2 < name.size()) {
+                key.push_back(static_cast<char>(std::stoi(std::string(name.substr(i + 1, 2)), nullptr, 16)));
+                i += 2;
+            } else {
+                key.push_back(name[i]);
+            }
+        }
+        return key;
+    }
+
+    std::string object_path(const std::string_view &key) const {
+        std::string name = encode_key(key);
+        std::string path = objects_dir_;
+        std::size_t offset = 0;
+        while (name.size() - offset > MAX_NAME_SIZE) {
+            // 不拆开%XX
+            std::size_t cut = offset + MAX_SEGMENT_SIZE;
+            if (name[cut - 1] == '%') {
+                cut -= 1;
+            } else if (name[cut - 2] == '%') {
+                cut -= 2;
+            }
+            path.append(name, offset, cut - offset);
+            path.append("%/");
+            offset = cut;
+        }
+        path.append(name, offset);
+        return path;
+    }
+
+    // 长key的对象所在的子目录不存在时逐级创建
+    void make_parent_dirs(const std::string &path, const std::string_view &key) const {
+        for (std::size_t pos = path.find('/', objects_dir_.size()); pos != std::string::npos; pos = path.find('/', pos + 1)) {
+            if (::mkdir(path.substr(0, pos).c_str(), 0755) != 0 && errno != EEXIST) {
+                throw_errno("put_object", key);
+            }
+        }
+    }
+
+    // 递归遍历dir, 以解码后的key回调; encoded为dir对应的编码前缀
+    template <typename F>
+    void for_each_key(const std::string &dir, const std::string &encoded, F &&f) const {
+        std::unique_ptr<DIR, int (*)(DIR *)> handle(::opendir(dir.c_str()), ::closedir);
+        if (!handle) {
+            throw_errno("list_objects", dir);
+        }
+        while (struct dirent *entry = ::readdir(handle.get())) {
+            std::string_view name = entry->d_name;
+            if (name[0] == '.') {
+                continue;
+            }
+            if (name.back() == '%') {
+                name.remove_suffix(1);
+                for_each_key(fmt::format("{}{}/", dir, entry->d_name), encoded + std::string(name), f);
+            } else {
+                f(decode_key(encoded + std::string(name)));
+            }
+        }
+    }
+
+    [[noreturn]] static void throw_errno(const char *op, const std::string_view &key) {
+        int err = errno;
+        throw Error(fmt::format("Error in {}, key: {}, {}", op, key, strerror(err)), err == ENOENT ? OBS_STATUS_NoSuchKey : OBS_STATUS_InternalError);
+    }
+
+    // 写入临时文件后rename, 读者不会看到写了一半的对象
+    template <typename Writer>
+    void write_file(const std::string_view &key, Writer &&writer) const {
+        std::string tmp_path = fmt::format("{}{}.{}", tmp_dir_, ::getpid(), tmp_seq_.fetch_add(1, std::memory_order_relaxed));
+        int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            throw_errno("put_object", key);
+        }
+        try {
+            writer(fd);
+        } catch (...) {
+            ::close(fd);
+            ::unlink(tmp_path.c_str());
+            throw;
+        }
+        ::close(fd);
+        std::string path = object_path(key);
+        make_parent_dirs(path, key);
+        if (::rename(tmp_path.c_str(), path.c_str()) != 0) {
+            int err = errno;
+            ::unlink(tmp_path.c_str());
+            errno = err;
+            throw_errno("put_object", key);
+        }
+    }
+
+    static void write_all(int fd, const char *data, std::size_t len, const std::string_view &key) {
+        while (len > 0) {
+            ssize_t n = ::write(fd, data, len);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw_errno("write", key);
+            }
+            data += n;
+            len -= n;
+        }
+    }
+
+    int open_for_read(const std::string_view &key) const {
+        int fd = ::open(object_path(key).c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw_errno("get_object", key);
+        }
+        return fd;
+    }
+
+    static std::size_t file_size(int fd) {
+        struct stat st;
+        ::fstat(fd, &st);
+        return st.st_size;
+    }
+
+    static std::size_t read_all(int fd, std::size_t offset, std::size_t len, char *buffer, const std::string_view &key) {
+        std::size_t read = 0;
+        while (read < len) {
+            ssize_t n = ::pread(fd, buffer + read, len - read, offset + read);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                int err = errno;
+                ::close(fd);
+                errno = err;
+                throw_errno("read", key);
+            }
+            if (n == 0) {
+                break;
+            }
+            read += n;
+        }
+        return read;
+    }
+
+    const std::string root_;
+    const std::string objects_dir_;
+    const std::string tmp_dir_;
+
+    mutable std::atomic<uint64_t> tmp_seq_ = 0;
+    mutable std::array<std::mutex, APPEND_LOCK_COUNT> append_mutexes_;
+};
@@ -0,0 +1,225 @@
+#pragma once
+
+#include "config.h"
+#include "histogram.h"
+#include "object_store.h"
+#include "retry_policy.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+
+/**
+ * @brief 最近请求延迟的分位数, 按请求大小分级(每4倍一级)统计, 作为对冲请求的等待时间
+ * 每级攒满WINDOW个请求后计算一次分位数并开始新的窗口, 分布随负载变化更新; 查询只读一个原子变量
+ */
+class LatencyTracker {
+  public:
+    static constexpr std::size_t WINDOW = 1024;
+    // 第一个窗口在攒到该数量时先计算一次
+    static constexpr std::size_t MIN_SAMPLES = 64;
+    static constexpr std::size_t SIZE_CLASSES = 16;
+
+    void record(std::size_t size, uint64_t latency_ns, double quantile) {
+        SizeClass &size_class = classes_[size_class_of(size)];
+        std::lock_guard<std::mutex> lock(size_class.mutex);
+        size_class.window.record(latency_ns);
+        std::size_t count = size_class.window.count();
+        if (count == WINDOW || (count == MIN_SAMPLES && size_class.quantile_ns.load(std::memory_order_relaxed) == 0)) {
+            size_class.quantile_ns.store(std::max<uint64_t>(1, size_class.window.value_at_quantile(quantile)), std::memory_order_relaxed);
+            if (count == WINDOW) {
+                size_class.window.reset();
+            }
+        }
+    }
+
+    // 样本不足时返回0
+    uint64_t quantile_ns(std::size_t size) const {
+        return classes_[size_class_of(size)].quantile_ns.load(std::memory_order_relaxed);
+    }
+
+  private:
+    struct SizeClass {
+        std::mutex mutex;
+        Histogram window;
+        std::atomic<uint64_t> quantile_ns = 0;
+    };
+
+    static std::size_t size_class_of(std::size_t size) {
+        return size == 0 ? 0 : std::min<std::size_t>(SIZE_CLASSES - 1, (63 - __builtin_clzll(size)) / 2);
+    }
+
+    std::array<SizeClass, SIZE_CLASSES> classes_;
+};
+
+/**
+ * @brief 主请求与对冲请求共享的状态
+ * 执行请求的线程各持有一份shared_ptr, 调用方返回后落后的请求仍能安全地检查是否已经输掉;
+ * 落后的请求在写入(或读取)调用方的内存前应持有mutex并检查lost(), 胜出方的提交同样在mutex内进行
+ */
+struct HedgeRace {
+    std::mutex mutex;
+    std::condition_variable cv;
+    // 先成功的请求(0为主请求, 1为对冲请求), -1表示尚未决出
+    std::atomic<int> winner = -1;
+    std::size_t launched = 1;
+    std::size_t finished = 0;
+    std::exception_ptr error;
+
+    bool lost(std::size_t attempt) const {
+        int current = winner.load(std::memory_order_acquire);
+        return current >= 0 && static_cast<std::size_t>(current) != attempt;
+    }
+};
+
+/**
+ * @brief 对冲请求: 请求超过同类请求延迟的CONFIG::HEDGE_PERCENTILE分位数仍未完成时, 再发一个相同的请求, 取先完成的结果
+ * 对冲数由RetryBudget式的令牌桶限制在请求数的HEDGE_MAX_RATIO左右; 两个请求都在内部线程池上执行,
+ * 调用方在任一请求成功后立即返回, 输掉的请求在下一次数据回调时中止
+ */
+class Hedger {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    template <typename R>
+    using Attempt = std::function<R(HedgeRace &race, std::size_t attempt)>;
+
+    // 在HedgeRace::mutex内调用, 胜出的请求可以在这里把结果拷贝给调用方
+    template <typename R>
+    using Commit = std::function<void(std::size_t attempt, R &result)>;
+
+    Hedger(double max_ratio, double burst, std::size_t threads) : budget_(max_ratio, burst), threads_(std::max<std::size_t>(2, threads)) {}
+
+    static Hedger from_config() {
+        return Hedger(CONFIG::HEDGE_MAX_RATIO, CONFIG::HEDGE_BURST, CONFIG::HEDGE_THREADS);
+    }
+
+    Hedger(const Hedger &) = delete;
+    Hedger &operator=(const Hedger &) = delete;
+
+    // 每次调用时读取CONFIG, 可以在运行中开关; 大于HEDGE_PUT_MAX_SIZE的PUT不对冲
+    static bool enabled(std::size_t size, bool is_put) {
+        return CONFIG::HEDGE_ENABLE && (!is_put || size <= CONFIG::HEDGE_PUT_MAX_SIZE);
+    }
+
+    // attempt必须可以并发执行两次, 且不引用调用方栈上的对象(调用方返回后输掉的请求可能仍在执行);
+    // 只有主请求失败且没有发出对冲请求, 或两个请求都失败时抛出主请求的异常
+    template <typename R>
+    R run(LatencyTracker &tracker, std::size_t size, Attempt<R> attempt, Commit<R> commit = {}) const {
+        struct Race : HedgeRace {
+            Attempt<R> attempt;
+            Commit<R> commit;
+            std::optional<R> result;
+        };
+        auto race = std::make_shared<Race>();
+        race->attempt = std::move(attempt);
+        race->commit = std::move(commit);
+
+        auto launch = [this](const std::shared_ptr<Race> &race, std::size_t attempt_idx) {
+            pool().submit([race, attempt_idx]() {
+                try {
+                    // 排队期间另一个请求已经胜出, 不再发出
+                    if (race->lost(attempt_idx)) {
+                        throw ObjectStore::Error("hedged request lost before start", OBS_STATUS_AbortedByCallback);
+                    }
+                    R result = race->attempt(*race, attempt_idx);
+                    std::lock_guard<std::mutex> lock(race->mutex);
+                    if (race->winner.load(std::memory_order_relaxed) < 0) {
+                        if (race->commit) {
+                            race->commit(attempt_idx, result);
+                        }
+                        race->result = std::move(result);
+                        race->winner.store(static_cast<int>(attempt_idx), std::memory_order_release);
+                    }
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(race->mutex);
+                    // 主请求的错误优先, 与不对冲时一致
+                    if (!race->error || attempt_idx == 0) {
+                        race->error = std::current_exception();
+                    }
+                }
+                {
+                    std::lock_guard<std::mutex> lock(race->mutex);
+                    ++race->finished;
+                }
+                race->cv.notify_all();
+            });
+        };
+
+        auto start = Clock::now();
+        requests_.fetch_add(1, std::memory_order_relaxed);
+        launch(race, 0);
+
+        std::unique_lock<std::mutex> lock(race->mutex);
+        auto decided = [&]() { return race->winner.load(std::memory_order_relaxed) >= 0 || race->finished == race->launched; };
+        // 样本不足时不对冲
+        uint64_t quantile_ns = tracker.quantile_ns(size);
+        if (quantile_ns > 0) {
+            auto delay = std::max<Clock::duration>(std::chrono::nanoseconds(quantile_ns), std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(CONFIG::HEDGE_MIN_DELAY_MS)));
+            if (!race->cv.wait_for(lock, delay, decided)) {
+                if (budget_.try_withdraw()) {
+                    race->launched = 2;
+                    hedges_.fetch_add(1, std::memory_order_relaxed);
+                    launch(race, 1);
+                } else {
+                    budget_denied_.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        }
+        race->cv.wait(lock, decided);
+        int winner = race->winner.load(std::memory_order_relaxed);
+        if (winner < 0) {
+            std::rethrow_exception(race->error);
+        }
+        R result = std::move(*race->result);
+        lock.unlock();
+
+        budget_.deposit();
+        if (winner == 1) {
+            hedge_wins_.fetch_add(1, std::memory_order_relaxed);
+        }
+        // 记录调用方看到的延迟(对冲后的延迟), 与不对冲时相比分位数略低, 对冲更积极
+        tracker.record(size, std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count(), CONFIG::HEDGE_PERCENTILE);
+        return result;
+    }
+
+    ObjectStore::HedgeStats stats() const {
+        return {
+            .requests = requests_.load(std::memory_order_relaxed),
+            .hedges = hedges_.load(std::memory_order_relaxed),
+            .hedge_wins = hedge_wins_.load(std::memory_order_relaxed),
+            .budget_denied = budget_denied_.load(std::memory_order_relaxed),
+        };
+    }
+
+    // 等待在途的请求(包括输掉的尝试)结束并停止线程; 之后不能再调用run
+    void drain() const {
+        pool_.reset();
+    }
+
+  private:
+    // 每个请求占用一个线程, 对冲时两个; 第一次对冲时创建
+    ThreadPool &pool() const {
+        std::call_once(pool_once_, [this]() { pool_ = std::make_unique<ThreadPool>(threads_); });
+        return *pool_;
+    }
+
+    mutable RetryBudget budget_;
+    const std::size_t threads_;
+    mutable std::once_flag pool_once_;
+    mutable std::unique_ptr<ThreadPool> pool_;
+
+    mutable std::atomic<std::size_t> requests_ = 0;
+    mutable std::atomic<std::size_t> hedges_ = 0;
+    mutable std::atomic<std::size_t> hedge_wins_ = 0;
+    mutable std::atomic<std::size_t> budget_denied_ = 0;
+};
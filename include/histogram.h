@@ -0,0 +1,170 @@
+#pragma once
+
+#include "fmt/core.h"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief HDR风格的对数分桶直方图, 记录非负整数(例如延迟的纳秒数)
+ * 小于SUB_BUCKET_COUNT的值精确记录, 更大的值按最高位分组, 每组SUB_BUCKET_COUNT / 2个线性子桶, 相对误差不超过1/64;
+ * 内存大小固定(约30KB), 与记录次数无关; 每个线程各自记录, 结束后merge, 记录路径上没有锁和原子操作
+ */
+class Histogram {
+  public:
+    static constexpr int SUB_BUCKET_BITS = 7;
+    static constexpr uint64_t SUB_BUCKET_COUNT = 1ULL << SUB_BUCKET_BITS;
+    static constexpr uint64_t SUB_BUCKET_HALF = SUB_BUCKET_COUNT / 2;
+    static constexpr std::size_t BUCKET_COUNT = SUB_BUCKET_COUNT + (64 - SUB_BUCKET_BITS) * SUB_BUCKET_HALF;
+
+    void record(uint64_t value, uint64_t count = 1) {
+        counts_[bucket_index(value)] += count;
+        total_ += count;
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+        sum_ += static_cast<double>(value) * count;
+    }
+
+    void merge(const Histogram &other) {
+        for (std::size_t i = 0; i < BUCKET_COUNT; ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        total_ += other.total_;
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+        sum_ += other.sum_;
+    }
+
+    void reset() { *this = Histogram(); }
+
+    uint64_t count() const { return total_; }
+
+    uint64_t min() const { return total_ ? min_ : 0; }
+
+    uint64_t max() const { return max_; }
+
+    double mean() const { return total_ ? sum_ / total_ : 0.0; }
+
+    // 至少q(0 <= q <= 1)比例的记录不大于返回值; 返回所在桶的上界, 并限制在[min, max]之内
+    uint64_t value_at_quantile(double q) const {
+        if (total_ == 0) {
+            return 0;
+        }
+        uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * total_ + 0.5));
+        rank = std::min(rank, total_);
+        uint64_t seen = 0;
+        for (std::size_t i = 0; i < BUCKET_COUNT; ++i) {
+            seen += counts_[i];
+            if (seen >= rank) {
+                return std::clamp(bucket_upper(i), min_, max_);
+            }
+        }
+        return max_;
+    }
+
+    // 紧凑编码: "h7;min;max;sum;" + 非空桶的"索引增量:次数"(以空格分隔), 不含逗号和引号, 可以直接写入CSV
+    std::string encode() const {
+        std::string out = fmt::format("h{};{};{};{:.0f};", SUB_BUCKET_BITS, min(), max_, sum_);
+        std::size_t last = 0;
+        bool first = true;
+        for (std::size_t i = 0; i < BUCKET_COUNT; ++i) {
+            if (counts_[i] == 0) {
+                continue;
+            }
+            fmt::format_to(std::back_inserter(out), "{}{}:{}", first ? "" : " ", i - last, counts_[i]);
+            last = i;
+            first = false;
+        }
+        return out;
+    }
+
+    static Histogram decode(std::string_view encoded) {
+        Histogram histogram;
+        auto next_field = [&](char delimiter) {
+            std::size_t end = std::min(encoded.find(delimiter), encoded.size());
+            std::string field(encoded.substr(0, end));
+            encoded.remove_prefix(std::min(end + 1, encoded.size()));
+            return field;
+        };
+        if (next_field(';') != fmt::format("h{}", SUB_BUCKET_BITS)) {
+            return histogram;
+        }
+        uint64_t min = std::stoull(next_field(';'));
+        uint64_t max = std::stoull(next_field(';'));
+        double sum = std::stod(next_field(';'));
+        std::size_t index = 0;
+        while (!encoded.empty()) {
+            std::string item = next_field(' ');
+            std::size_t colon = item.find(':');
+            index += std::stoull(item.substr(0, colon));
+            uint64_t count = std::stoull(item.substr(colon + 1));
+            histogram.counts_[index] += count;
+            histogram.total_ += count;
+        }
+        if (histogram.total_) {
+            histogram.min_ = min;
+            histogram.max_ = max;
+            histogram.sum_ = sum;
+        }
+        return histogram;
+    }
+
+    static std::size_t bucket_index(uint64_t value) {
+        if (value < SUB_BUCKET_COUNT) {
+            return value;
+        }
+        int shift = 63 - __builtin_clzll(value) - (SUB_BUCKET_BITS - 1);
+        return SUB_BUCKET_COUNT + (shift - 1) * SUB_BUCKET_HALF + ((value >> shift) - SUB_BUCKET_HALF);
+    }
+
+    // 桶内的最大值
+    static uint64_t bucket_upper(std::size_t index) {
+        if (index < SUB_BUCKET_COUNT) {
+            return index;
+        }
+        int shift = (index - SUB_BUCKET_COUNT) / SUB_BUCKET_HALF + 1;
+        uint64_t sub = (index - SUB_BUCKET_COUNT) % SUB_BUCKET_HALF + SUB_BUCKET_HALF;
+        uint64_t upper = ((sub + 1) << shift) - 1;
+        // 最高的桶会溢出
+        return upper < (sub << shift) ? std::numeric_limits<uint64_t>::max() : upper;
+    }
+
+  private:
+    std::array<uint64_t, BUCKET_COUNT> counts_ = {};
+    uint64_t total_ = 0;
+    uint64_t min_ = std::numeric_limits<uint64_t>::max();
+    uint64_t max_ = 0;
+    double sum_ = 0;
+};
+
+/**
+ * @brief 按时间窗口分桶的直方图序列
+ * 每个线程先记录到自己当前窗口的直方图, 进入下一个窗口时才加锁合并进来, 锁的开销与请求数无关
+ */
+class HistogramSeries {
+  public:
+    void merge(std::size_t window, const Histogram &histogram) {
+        if (histogram.count() == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (windows_.size() <= window) {
+            windows_.resize(window + 1);
+        }
+        windows_[window].merge(histogram);
+    }
+
+    // 所有线程结束后读取
+    const std::vector<Histogram> &windows() const { return windows_; }
+
+  private:
+    std::mutex mutex_;
+    std::vector<Histogram> windows_;
+};
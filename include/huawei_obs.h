@@ -1,13 +1,18 @@
 #pragma once
 
 #include "config.h"
-#include "fmt/core.h"
+#include "hedging.h"
+#include "object_store.h"
+#include "rate_limiter.h"
+#include "retry_policy.h"
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
 #include <eSDKOBS.h>
-#include <iostream>
 #include <log.h>
+#include <memory>
 #include <mutex>
 #include <optional>
 #include <string>
@@ -30,231 +35,265 @@ inline void print_progress(std::size_t iter, std::size_t max_iter, bool force_en
     fflush(stdout);
 }
 
-template <>
-struct fmt::formatter<obs_error_details> : fmt::formatter<std::string_view> {
-    template <typename FormatContext>
-    auto format(const obs_error_details& error, FormatContext& ctx) const {
-        std::string msg;
-        if (error.message) {
-            msg += fmt::format("Error Message: \n   {}\n", error.message);
-        }
-        if (error.resource) {
-            msg += fmt::format("Error Resource: \n  {}\n", error.resource);
-        }
-        if (error.further_details) {
-            msg += fmt::format("Error further_details: \n   {}\n", error.further_details);
-        }
-        if (error.extra_details_count) {
-            int i;
-            for (i = 0; i < error.extra_details_count; i++) {
-                msg += fmt::format("Error Extra Detail({}):\n   {}:{}\n", i, error.extra_details[i].name, error.extra_details[i].value);
-            }
-        }
-        if (error.error_headers_count) {
-            int i;
-            for (i = 0; i < error.error_headers_count; i++) {
-                const char *errorHeader = error.error_headers[i];
-                msg += fmt::format("Error Headers({}):\n    {}\n", i, errorHeader == NULL ? "NULL Header" : errorHeader);
-            }
-        }
-
-        auto out = ctx.out();
-        out = fmt::format_to(out, "{}", msg);
-        return out;
-    }
-};
-
-class HuaweiCloudObs {
-    HuaweiCloudObs() {
+class HuaweiCloudObs : public ObjectStore {
+    HuaweiCloudObs() : endpoint_(CONFIG::ENDPOINT), owns_sdk_(true) {
         init();
     }
-    ~HuaweiCloudObs() {
-        deinit();
-    }
 
   public:
-    class Error : public std::exception {
-      public:
-        Error(const std::string &msg, obs_status status, const obs_error_details &error)
-            : status(status), error(error) {
-            _msg = fmt::format("Error: {}, status: {} details: {}", msg, obs_get_status_name(status), error);
-            PRINT_STACK_TRACE();
-        }
-
-        Error(const std::string &msg) : Error(msg, {}, {}) {}
-
-        Error() : Error("") {}
+    // 连接到指定的endpoint(如本地的ObsServer), 其余选项取自构造时的CONFIG; SDK的全局初始化由get_instance()的实例负责清理
+    explicit HuaweiCloudObs(std::string endpoint) : endpoint_(std::move(endpoint)), owns_sdk_(false) {
+        init();
+    }
 
-        const char *what() const noexcept override {
-            // PRINT_STACK_TRACE();
-            return _msg.c_str();
+    ~HuaweiCloudObs() {
+        // 输掉的对冲尝试仍在pool中使用this和SDK
+        hedger_.drain();
+        if (owns_sdk_) {
+            deinit();
         }
-
-        int get_msg_len() { return _msg.length(); }
-
-        std::string _msg;
-
-        const obs_status status = {};
-        const obs_error_details error = {};
-    };
+    }
 
     static HuaweiCloudObs *get_instance() {
         static HuaweiCloudObs instance;
         return &instance;
     }
 
-    void put_object(const std::string_view &key, const std::string_view &object) const {
-        // 初始化存储上传数据的结构体
-        object_callback_data data = {
-            // 流式上传数据buffer, 并赋值到上传数据结构中
-            .buffer = object.data(),
-            // 设置buffersize
-            .buffer_size = object.size(),
-        };
+    using ObjectStore::batch_delete_objects;
+    using ObjectStore::put_object;
 
-        obs_put_object_handler put_object_handler = {
-            {&response_properties_callback, &response_complete_callback},
-            &put_buffer_data_callback
-        };
+    // 不对冲: 输掉的请求可能晚于之后对同一个key的写入到达并覆盖它
+    void put_object_single(const std::string_view &key, const std::string_view &object) const override {
+        retrier_.run([&]() {
+            put_object_once(key, object, nullptr, 0);
+        });
+    }
 
-        ::put_object(
-            &base_option,
-            (char *)key.data(),
-            data.buffer_size,
-            const_cast<obs_put_properties *>(&put_properties),
-            0,
-            &put_object_handler,
-            &data
-        );
+    // 不超过CONFIG::HEDGE_PUT_MAX_SIZE时对冲: key只写入这一次, 两个请求写入相同的内容, 谁先完成结果都一样
+    void put_object_unique(const std::string_view &key, const std::string_view &object) const override {
+        retrier_.run([&]() {
+            if (!Hedger::enabled(object.size(), true)) {
+                put_object_once(key, object, nullptr, 0);
+                return;
+            }
+            // 调用方返回后object可能失效, 输掉的请求在put_buffer_data_callback中持锁检查后中止
+            hedger_.run<bool>(put_latency_, object.size(), [this, key = std::string(key), object](HedgeRace &race, std::size_t attempt) {
+                put_object_once(key, object, &race, attempt);
+                return true;
+            });
+        });
+    }
 
-        LOG_DEBUG("put key {} with object size: {}", key, object.size());
+    // 单次PUT, 由source直接填充SDK的发送缓冲区
+    void put_object(const std::string_view &key, UploadSource &source) const override {
+        retrier_.run([&]() {
+            rate_limiter_.acquire(key, source.size());
+            source_callback_data data = {
+                .object = {
+                    .buffer_size = source.size(),
+                },
+                .source = &source,
+            };
 
-        if (OBS_STATUS_OK != data.common.ret_status) {
-            throw Error(
-                fmt::format("Error in put_object, key: {}, size: {}", key, object.size()),
-                data.common.ret_status,
-                data.common.error_details
+            obs_put_object_handler put_object_handler = {
+                {&response_properties_callback, &response_complete_callback},
+                &put_source_data_callback
+            };
+
+            ::put_object(
+                &base_option,
+                (char *)key.data(),
+                source.size(),
+                const_cast<obs_put_properties *>(&put_properties),
+                0,
+                &put_object_handler,
+                &data
             );
+
+            LOG_DEBUG("put key {} from source with size: {}", key, source.size());
+
+            if (OBS_STATUS_OK != data.object.common.ret_status) {
+                throw Error(
+                    fmt::format("Error in put_object, key: {}, size: {}", key, source.size()),
+                    data.object.common.ret_status,
+                    data.object.common.error_details
+                );
+            }
+        });
+    }
+
+    // 分段上传: 初始化后由concurrency个线程直接从object中按part_size切片并发upload_part, 全部成功后合并;
+    // 任一步骤失败时调用abort_multi_part_upload清理已上传的段并重新抛出异常
+    void put_object_multipart(const std::string_view &key, const std::string_view &object, std::size_t part_size, std::size_t concurrency) const override {
+        ASSERT(part_size > 0);
+        if (object.empty()) {
+            put_object_single(key, object);
+            return;
         }
+        // 段数不能超过MULTIPART_MAX_PART_COUNT
+        part_size = std::max(part_size, (object.size() + MULTIPART_MAX_PART_COUNT - 1) / MULTIPART_MAX_PART_COUNT);
+        std::size_t part_count = (object.size() + part_size - 1) / part_size;
+
+        std::string upload_id = initiate_multipart_upload(key);
+        try {
+            std::vector<upload_part_callback_data> parts(part_count);
+            parallel_for(part_count, concurrency, [&](std::size_t part_idx) {
+                std::size_t offset = part_idx * part_size;
+                upload_part(key, upload_id, part_idx + 1, object.substr(offset, part_size), parts[part_idx]);
+            });
+            complete_multipart_upload(key, upload_id, parts);
+        } catch (...) {
+            abort_multipart_upload(key, upload_id);
+            throw;
+        }
+        LOG_DEBUG("put key {} with object size: {}, parts: {}", key, object.size(), part_count);
     }
 
-    std::size_t append_object(const std::string_view &key, const std::string_view &object, std::size_t start_pos) const {
-        LOG_DEBUG("key: {}, start_pos: {}", key, start_pos);
+    std::unique_ptr<MultipartUpload> begin_multipart_upload(const std::string_view &key) const override {
+        return std::make_unique<ObsMultipartUpload>(*this, std::string(key));
+    }
 
-        // 初始化存储上传数据的结构体
-        object_callback_data data = {
-            // 流式上传数据buffer, 并赋值到上传数据结构中
-            .buffer = object.data(),
-            // 设置buffersize
-            .buffer_size = object.size(),
-        };
-        obs_append_object_handler append_object_handler = {
-            {&response_properties_callback, &response_complete_callback},
-            &put_buffer_data_callback
-        };
-        ::append_object(
-            &base_option,
-            (char *)key.data(),
-            data.buffer_size,
-            std::to_string(start_pos).c_str(),
-            const_cast<obs_put_properties *>(&put_properties),
-            0,
-            &append_object_handler,
-            &data
-        );
+    std::size_t append_object(const std::string_view &key, const std::string_view &object, std::size_t start_pos) const override {
+        return retrier_.run([&]() {
+            rate_limiter_.acquire(key, object.size());
+            LOG_DEBUG("key: {}, start_pos: {}", key, start_pos);
+
+            // 初始化存储上传数据的结构体
+            object_callback_data data = {
+                // 流式上传数据buffer, 并赋值到上传数据结构中
+                .buffer = object.data(),
+                // 设置buffersize
+                .buffer_size = object.size(),
+            };
+            obs_append_object_handler append_object_handler = {
+                {&response_properties_callback, &response_complete_callback},
+                &put_buffer_data_callback
+            };
+            ::append_object(
+                &base_option,
+                (char *)key.data(),
+                data.buffer_size,
+                std::to_string(start_pos).c_str(),
+                const_cast<obs_put_properties *>(&put_properties),
+                0,
+                &append_object_handler,
+                &data
+            );
 
-        LOG_DEBUG("appending key {} with object size at [{}, {})", key, object.size(), start_pos,
-                  start_pos + data.obs_next_append_position);
+            LOG_DEBUG("appending key {} with object size at [{}, {})", key, object.size(), start_pos,
+                      start_pos + data.obs_next_append_position);
 
-        if (OBS_STATUS_OK != data.common.ret_status) {
-            throw Error(
-                fmt::format("Error in append_object, key: {}, size: {}, at [{}, {})", key, object.size(), start_pos, start_pos + data.obs_next_append_position),
-                data.common.ret_status,
-                data.common.error_details
-            );
-        }
-        return data.obs_next_append_position;
+            if (OBS_STATUS_OK != data.common.ret_status) {
+                throw Error(
+                    fmt::format("Error in append_object, key: {}, size: {}, at [{}, {})", key, object.size(), start_pos, start_pos + data.obs_next_append_position),
+                    data.common.ret_status,
+                    data.common.error_details
+                );
+            }
+            return data.obs_next_append_position;
+        });
     }
 
-    void delete_object(const std::string_view &key) const {
-        // 要删除的对象信息
-        obs_object_info object_info = {
-            .key = (char *)key.data(),
-            .version_id = NULL
-        };
-        // 设置响应回调函数
-        obs_response_handler response_handler = {
-            &response_properties_callback, &response_complete_callback
-        };
-        object_callback_data data;
-        // 删除对象
-        ::delete_object(&base_option, &object_info, &response_handler, &data);
-        if (OBS_STATUS_OK != data.common.ret_status) {
-            throw Error(
-                fmt::format("Error in delete_object, key: {}", key),
-                data.common.ret_status,
-                data.common.error_details
-            );
+    // 读取整个对象, 数据直接写入调用方提供的buffer; 返回读取的字节数, buffer不足时抛出异常
+    std::size_t get_object(const std::string_view &key, char *buffer, std::size_t buffer_size) const override {
+        return get_object_impl(key, 0, 0, buffer, buffer_size);
+    }
+
+    // 读取对象[offset, offset + len)范围内的数据到buffer(至少len字节); 返回读取的字节数
+    std::size_t get_range(const std::string_view &key, std::size_t offset, std::size_t len, char *buffer) const override {
+        if (len == 0) {
+            return 0;
         }
+        return get_object_impl(key, offset, len, buffer, len);
     }
 
-    void batch_delete_objects(const std::vector<std::string> &keys) const {
-        ASSERT(0 < keys.size() && keys.size() <= 1000);
-        std::vector<obs_object_info> objectinfos;
-        objectinfos.reserve(keys.size());
-        for (const auto &key : keys) {
-            obs_object_info info = {
-                .key = const_cast<char *>(key.data()),
-                .version_id = NULL
+    // 获取对象大小
+    std::size_t head_object(const std::string_view &key) const override {
+        return retrier_.run([&]() {
+            rate_limiter_.acquire(key, 0);
+            obs_response_handler response_handler = {
+                &get_properties_callback, &response_complete_callback
             };
-            objectinfos.push_back(info);
-        }
-        obs_delete_object_info delobj = {
-            .keys_number = static_cast<unsigned int>(objectinfos.size()),
-        };
-        // 设置响应回调函数
-        obs_delete_object_handler handler = {
-            {&response_properties_callback, &response_complete_callback},
-            delete_objects_data_callback
-        };
-        object_callback_data data;
-        // 批量删除对象
-        ::batch_delete_objects(&base_option, objectinfos.data(), &delobj, 0, &handler, &data);
-        if (OBS_STATUS_OK != data.common.ret_status) {
-            throw Error(
-                fmt::format("Error in batch_delete_objects, all: {}", objectinfos.size()),
-                data.common.ret_status,
-                data.common.error_details
-            );
-        }
+            get_object_callback_data data = {};
+            ::obs_head_object(&base_option, (char *)key.data(), &response_handler, &data);
+            if (OBS_STATUS_OK != data.common.ret_status) {
+                throw Error(
+                    fmt::format("Error in head_object, key: {}", key),
+                    data.common.ret_status,
+                    data.common.error_details
+                );
+            }
+            return data.content_length;
+        });
     }
 
-    void delete_objects(const std::vector<std::string> &keys) const {
-        std::vector<std::string> delete_batch_keys;
-        for (std::size_t i = 0; i < keys.size(); ++i) {
-            if ((i + 1) % 1000 == 0 || i == keys.size() - 1) {
-                delete_batch_keys.push_back(keys[i]);
-                batch_delete_objects(delete_batch_keys);
-                delete_batch_keys.clear();
-            } else {
-                delete_batch_keys.push_back(keys[i]);
+    void delete_object(const std::string_view &key) const override {
+        retrier_.run([&]() {
+            rate_limiter_.acquire(key, 0);
+            // 要删除的对象信息
+            obs_object_info object_info = {
+                .key = (char *)key.data(),
+                .version_id = NULL
+            };
+            // 设置响应回调函数
+            obs_response_handler response_handler = {
+                &response_properties_callback, &response_complete_callback
+            };
+            object_callback_data data;
+            // 删除对象
+            ::delete_object(&base_option, &object_info, &response_handler, &data);
+            if (OBS_STATUS_OK != data.common.ret_status) {
+                throw Error(
+                    fmt::format("Error in delete_object, key: {}", key),
+                    data.common.ret_status,
+                    data.common.error_details
+                );
             }
-        }
+        });
     }
 
-    std::size_t delete_all() {
-        std::cout << fmt::format("deleting about {} keys\n", get_approximate_object_count());
-        auto all_keys = list_objects();
-        std::cout << fmt::format("deleting {} keys\n", all_keys.size());
-        delete_objects(all_keys);
-        return all_keys.size();
+    // keys[i].c_str()直接作为obs_object_info的key, 不拷贝key
+    void batch_delete_objects(const std::string *keys, std::size_t count, std::vector<DeleteFailure> &failures) const override {
+        const std::size_t failure_count = failures.size();
+        retrier_.run([&]() {
+            // 重试时丢弃上一次失败的请求中解析出的结果
+            failures.resize(failure_count);
+            // 一次请求删除多个key, 按第一个key的前缀计
+            rate_limiter_.acquire(count ? std::string_view(keys[0]) : std::string_view(), 0);
+            std::vector<obs_object_info> objectinfos;
+            objectinfos.reserve(count);
+            for (std::size_t i = 0; i < count; ++i) {
+                objectinfos.push_back({.key = const_cast<char *>(keys[i].c_str()), .version_id = NULL});
+            }
+            obs_delete_object_info delobj = {
+                .keys_number = static_cast<unsigned int>(count),
+                // 只返回删除失败的key
+                .quiet = 1,
+            };
+            // 设置响应回调函数
+            obs_delete_object_handler handler = {
+                {&response_properties_callback, &response_complete_callback},
+                delete_objects_data_callback
+            };
+            delete_callback_data data = {
+                .failures = &failures,
+            };
+            // 批量删除对象
+            ::batch_delete_objects(&base_option, objectinfos.data(), &delobj, 0, &handler, &data);
+            if (OBS_STATUS_OK != data.common.ret_status) {
+                throw Error(
+                    fmt::format("Error in batch_delete_objects, all: {}", count),
+                    data.common.ret_status,
+                    data.common.error_details
+                );
+            }
+        });
     }
 
-    // start_key not included in the result
-    std::vector<std::string> list_objects(std::string start_key = "", std::string prefix = "", std::string delimiter = "/") const {
+    void list_objects_pages(const ListPageCallback &on_page, std::string start_key = "", std::string prefix = "", std::string delimiter = "/", bool report_progress = true) const override {
         std::string next_start_key = start_key;
 
-        bool list_all = start_key.empty() && prefix.empty() && delimiter.empty();
+        bool list_all = report_progress && start_key.empty() && prefix.empty() && delimiter.empty();
 
         // 设置响应回调函数
         obs_list_objects_handler list_bucket_objects_handler = {
@@ -267,59 +306,93 @@ class HuaweiCloudObs {
             .approximate_key_count = list_all ? std::optional<std::size_t>(get_approximate_object_count()) : std::nullopt,
         };
 
-        const int maxkeys = 1000;
-
         while (true) {
             const char *prefix_cstr = prefix.empty() ? NULL : prefix.c_str();
             const char *start_key_cstr = next_start_key.empty() ? NULL : next_start_key.c_str();
             const char *delimiter_cstr = delimiter.empty() ? NULL : delimiter.c_str();
 
-            data.batch_keys.clear();
-
-            // 列举对象
-            ::list_bucket_objects(
-                &base_option,
-                prefix_cstr,
-                start_key_cstr,
-                delimiter_cstr,
-                maxkeys,
-                &list_bucket_objects_handler,
-                &data
-            );
-
-            LOG_ASSERT(OBS_STATUS_OK == data.common.ret_status, "status: {}", obs_get_status_name(data.common.ret_status));
+            // 每一页单独重试
+            retrier_.run([&]() {
+                data.batch_keys.clear();
+                data.is_truncated = false;
+                rate_limiter_.acquire(prefix, 0);
+
+                // 列举对象
+                ::list_bucket_objects(
+                    &base_option,
+                    prefix_cstr,
+                    start_key_cstr,
+                    delimiter_cstr,
+                    LIST_MAX_KEYS,
+                    &list_bucket_objects_handler,
+                    &data
+                );
+
+                if (OBS_STATUS_OK != data.common.ret_status) {
+                    throw Error(
+                        fmt::format("Error in list_objects, prefix: {}, marker: {}", prefix, next_start_key),
+                        data.common.ret_status,
+                        data.common.error_details
+                    );
+                }
+            });
 
             if (data.batch_keys.empty()) {
                 break;
             }
             next_start_key = data.batch_keys.back();
+            bool is_truncated = data.is_truncated;
+            if (!on_page(data.batch_keys) || !is_truncated) {
+                break;
+            }
         };
-        return data.keys;
     }
 
-    std::size_t get_approximate_object_count() const {
-        // 设置响应回调函数
-        obs_response_handler response_handler = {
-                &response_properties_callback,
-                &response_complete_callback
-            };
-        object_callback_data data;
-        // 定义桶容量缓存及对象数缓存
-        char capacity[OBS_COMMON_LEN_256 + 1] = {0};
-        char obj_num[OBS_COMMON_LEN_256 + 1] = {0};
-        // 获取桶存量信息
-        get_bucket_storage_info(
-            &base_option,
-            OBS_COMMON_LEN_256 + 1,
-            capacity,
-            OBS_COMMON_LEN_256 + 1,
-            obj_num,
-            &response_handler,
-            &data
-        );
-        LOG_ASSERT(OBS_STATUS_OK == data.common.ret_status, "status: {}", obs_get_status_name(data.common.ret_status));
+    // 所有请求共用一个Retrier, 重试预算按客户端计算
+    RetryStats retry_stats() const override {
+        return retrier_.stats();
+    }
 
-        return std::stoull(obj_num);
+    HedgeStats hedge_stats() const override {
+        return hedger_.stats();
+    }
+
+    RateLimitStats rate_limit_stats() const override {
+        return rate_limiter_.stats();
+    }
+
+    std::size_t get_approximate_object_count() const override {
+        return retrier_.run([&]() {
+            rate_limiter_.acquire({}, 0);
+            // 设置响应回调函数
+            obs_response_handler response_handler = {
+                    &response_properties_callback,
+                    &response_complete_callback
+                };
+            object_callback_data data;
+            // 定义桶容量缓存及对象数缓存
+            char capacity[OBS_COMMON_LEN_256 + 1] = {0};
+            char obj_num[OBS_COMMON_LEN_256 + 1] = {0};
+            // 获取桶存量信息
+            get_bucket_storage_info(
+                &base_option,
+                OBS_COMMON_LEN_256 + 1,
+                capacity,
+                OBS_COMMON_LEN_256 + 1,
+                obj_num,
+                &response_handler,
+                &data
+            );
+            if (OBS_STATUS_OK != data.common.ret_status) {
+                throw Error(
+                    "Error in get_bucket_storage_info",
+                    data.common.ret_status,
+                    data.common.error_details
+                );
+            }
+
+            return std::stoull(obj_num);
+        });
     }
 
     // void create_bucket(const std::string *bucket_name) {
@@ -336,10 +409,27 @@ class HuaweiCloudObs {
     // }
 
   private:
+    const std::string endpoint_;
+    const bool owns_sdk_;
+
     obs_options base_option;
 
+    // 可重试的错误(网络错误、超时、限流)按CONFIG::RETRY_*退避重试, 其他错误直接抛出
+    const Retrier retrier_ = Retrier::from_config();
+
+    // GET和PUT分别统计延迟, 作为对冲的阈值
+    mutable LatencyTracker get_latency_;
+    mutable LatencyTracker put_latency_;
+
+    // 每个请求(包括重试和对冲)发出前按CONFIG::RATE_LIMIT_*取令牌, 避免多个线程的突发叠加后被服务端限流(503 SlowDown)
+    mutable RateLimiter rate_limiter_;
+
     obs_put_properties put_properties;
 
+    // CONFIG::HEDGE_ENABLE时GET和小的put_object_unique超过同类请求的延迟分位数后对冲;
+    // 必须最后声明: 最先析构, 其中输掉的尝试会访问上面的成员
+    const Hedger hedger_ = Hedger::from_config();
+
     obs_status init() {
         static std::once_flag once;
         static std::atomic<obs_status> status;
@@ -352,22 +442,280 @@ class HuaweiCloudObs {
             }
             status = ret_status;
             // 请不要多次调用obs_initialize和obs_deinitialize，否则会导致程序访问无效的内存
+        });
 
-            init_obs_options(&base_option);
-            base_option.bucket_options.host_name = const_cast<char *>(CONFIG::ENDPOINT.data());
-            base_option.bucket_options.bucket_name = const_cast<char *>(CONFIG::BUCKET_NAME.data());
+        init_obs_options(&base_option);
+        base_option.bucket_options.host_name = const_cast<char *>(endpoint_.c_str());
+        base_option.bucket_options.bucket_name = const_cast<char *>(CONFIG::BUCKET_NAME.data());
+        base_option.bucket_options.protocol = CONFIG::PROTOCOL == "http" ? OBS_PROTOCOL_HTTP : OBS_PROTOCOL_HTTPS;
+        base_option.bucket_options.uri_style = CONFIG::URI_STYLE == "path" ? OBS_URI_STYLE_PATH : OBS_URI_STYLE_VIRTUALHOST;
 
-            // 认证用的ak和sk硬编码到代码中或者明文存储都有很大的安全风险，建议在配置文件或者环境变量中密文存放，使用时解密，确保安全；本示例以ak和sk保存在环境变量中为例，运行本示例前请先在本地环境中设置环境变量ACCESS_KEY_ID和SECRET_ACCESS_KEY。
-            // 您可以登录访问管理控制台获取访问密钥AK/SK，获取方式请参见https://support.huaweicloud.com/usermanual-ca/ca_01_0003.html
-            base_option.bucket_options.access_key = const_cast<char*>(CONFIG::ACCESS_KEY_ID.data());
-            base_option.bucket_options.secret_access_key = const_cast<char*>(CONFIG::SECRET_ACCESS_KEY.data());
+        // 认证用的ak和sk硬编码到代码中或者明文存储都有很大的安全风险，建议在配置文件或者环境变量中密文存放，使用时解密，确保安全；本示例以ak和sk保存在环境变量中为例，运行本示例前请先在本地环境中设置环境变量ACCESS_KEY_ID和SECRET_ACCESS_KEY。
+        // 您可以登录访问管理控制台获取访问密钥AK/SK，获取方式请参见https://support.huaweicloud.com/usermanual-ca/ca_01_0003.html
+        base_option.bucket_options.access_key = const_cast<char*>(CONFIG::ACCESS_KEY_ID.data());
+        base_option.bucket_options.secret_access_key = const_cast<char*>(CONFIG::SECRET_ACCESS_KEY.data());
 
-            // 初始化上传对象属性
-            init_put_properties(&put_properties);
-        });
+        // 初始化上传对象属性
+        init_put_properties(&put_properties);
         return status;
     }
 
+    static constexpr std::size_t MULTIPART_MAX_PART_COUNT = 10000;
+
+    struct upload_part_callback_data;
+
+    std::string initiate_multipart_upload(const std::string_view &key) const {
+        return retrier_.run([&]() {
+            rate_limiter_.acquire(key, 0);
+            obs_response_handler response_handler = {
+                &response_properties_callback, &response_complete_callback
+            };
+            object_callback_data data = {};
+            char upload_id[OBS_COMMON_LEN_256] = {0};
+            ::initiate_multi_part_upload(
+                &base_option,
+                (char *)key.data(),
+                sizeof(upload_id),
+                upload_id,
+                const_cast<obs_put_properties *>(&put_properties),
+                0,
+                &response_handler,
+                &data
+            );
+            if (OBS_STATUS_OK != data.common.ret_status) {
+                throw Error(
+                    fmt::format("Error in initiate_multipart_upload, key: {}", key),
+                    data.common.ret_status,
+                    data.common.error_details
+                );
+            }
+            return std::string(upload_id);
+        });
+    }
+
+    void upload_part(const std::string_view &key, const std::string &upload_id, unsigned int part_number, const std::string_view &part, upload_part_callback_data &data) const {
+        retrier_.run([&]() {
+            rate_limiter_.acquire(key, part.size());
+            data.object = {
+                .buffer = part.data(),
+                .buffer_size = part.size(),
+            };
+            data.part_number = part_number;
+            obs_upload_part_info upload_part_info = {
+                .part_number = part_number,
+                .upload_id = const_cast<char *>(upload_id.c_str()),
+            };
+            obs_upload_handler upload_handler = {
+                {&upload_part_properties_callback, &response_complete_callback},
+                &put_buffer_data_callback
+            };
+            ::upload_part(
+                &base_option,
+                (char *)key.data(),
+                &upload_part_info,
+                part.size(),
+                const_cast<obs_put_properties *>(&put_properties),
+                0,
+                &upload_handler,
+                &data
+            );
+            if (OBS_STATUS_OK != data.object.common.ret_status) {
+                throw Error(
+                    fmt::format("Error in upload_part, key: {}, part: {}, size: {}", key, part_number, part.size()),
+                    data.object.common.ret_status,
+                    data.object.common.error_details
+                );
+            }
+        });
+    }
+
+    void complete_multipart_upload(const std::string_view &key, const std::string &upload_id, std::vector<upload_part_callback_data> &parts) const {
+        retrier_.run([&]() {
+            rate_limiter_.acquire(key, 0);
+            std::vector<obs_complete_upload_Info> complete_upload_infos;
+            complete_upload_infos.reserve(parts.size());
+            for (auto &part : parts) {
+                complete_upload_infos.push_back({.part_number = part.part_number, .etag = part.etag});
+            }
+            obs_complete_multi_part_upload_handler handler = {
+                {&response_properties_callback, &response_complete_callback},
+                &complete_multipart_upload_callback
+            };
+            object_callback_data data = {};
+            ::complete_multi_part_upload(
+                &base_option,
+                (char *)key.data(),
+                upload_id.c_str(),
+                static_cast<unsigned int>(complete_upload_infos.size()),
+                complete_upload_infos.data(),
+                const_cast<obs_put_properties *>(&put_properties),
+                &handler,
+                &data
+            );
+            if (OBS_STATUS_OK != data.common.ret_status) {
+                throw Error(
+                    fmt::format("Error in complete_multipart_upload, key: {}, parts: {}", key, parts.size()),
+                    data.common.ret_status,
+                    data.common.error_details
+                );
+            }
+        });
+    }
+
+    // 初始化时取得upload_id, 各段的etag在complete时按段号排序后提交
+    class ObsMultipartUpload : public MultipartUpload {
+      public:
+        ObsMultipartUpload(const HuaweiCloudObs &obs, std::string key) : obs_(obs), key_(std::move(key)), upload_id_(obs_.initiate_multipart_upload(key_)) {}
+
+        ~ObsMultipartUpload() override {
+            if (!completed_) {
+                obs_.abort_multipart_upload(key_, upload_id_);
+            }
+        }
+
+        void upload_part(unsigned int part_number, const std::string_view &part) override {
+            upload_part_callback_data data = {};
+            obs_.upload_part(key_, upload_id_, part_number, part, data);
+            std::lock_guard<std::mutex> lock(mutex_);
+            parts_.push_back(data);
+        }
+
+        void complete() override {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::sort(parts_.begin(), parts_.end(), [](const auto &a, const auto &b) { return a.part_number < b.part_number; });
+            obs_.complete_multipart_upload(key_, upload_id_, parts_);
+            completed_ = true;
+        }
+
+      private:
+        const HuaweiCloudObs &obs_;
+        const std::string key_;
+        const std::string upload_id_;
+        std::mutex mutex_;
+        std::vector<upload_part_callback_data> parts_;
+        bool completed_ = false;
+    };
+
+    // 在异常处理路径中调用, 失败只记录日志
+    void abort_multipart_upload(const std::string_view &key, const std::string &upload_id) const noexcept {
+        obs_response_handler response_handler = {
+            &response_properties_callback, &response_complete_callback
+        };
+        object_callback_data data = {};
+        ::abort_multi_part_upload(&base_option, (char *)key.data(), upload_id.c_str(), &response_handler, &data);
+        if (OBS_STATUS_OK != data.common.ret_status) {
+            LOG_WARN("abort_multipart_upload failed, key: {}, upload_id: {}, status: {}", key, upload_id, obs_get_status_name(data.common.ret_status));
+        }
+    }
+
+    // byte_count为0时读取到对象末尾
+    std::size_t get_object_impl(const std::string_view &key, uint64_t start_byte, uint64_t byte_count, char *buffer, std::size_t buffer_size) const {
+        return retrier_.run([&]() -> std::size_t {
+            if (!Hedger::enabled(buffer_size, false)) {
+                return get_object_once(key, start_byte, byte_count, buffer, buffer_size, nullptr, 0);
+            }
+            // 主请求直接写入buffer; 对冲请求写入自己的scratch, 胜出时在提交中拷贝到buffer.
+            // 两者写入buffer前都持有race的锁并检查是否已经输掉, 调用方返回后不会再写入buffer
+            auto scratch = std::make_shared<std::unique_ptr<char[]>>();
+            return hedger_.run<std::size_t>(
+                get_latency_,
+                byte_count ? byte_count : buffer_size,
+                [this, key = std::string(key), start_byte, byte_count, buffer, buffer_size, scratch](HedgeRace &race, std::size_t attempt) {
+                    if (attempt == 0) {
+                        return get_object_once(key, start_byte, byte_count, buffer, buffer_size, &race, attempt);
+                    }
+                    *scratch = std::unique_ptr<char[]>(new char[buffer_size]);
+                    return get_object_once(key, start_byte, byte_count, scratch->get(), buffer_size, &race, attempt);
+                },
+                [buffer, scratch](std::size_t attempt, std::size_t &read) {
+                    if (attempt != 0) {
+                        memcpy(buffer, scratch->get(), read);
+                    }
+                });
+        });
+    }
+
+    // race非空时为对冲中的一个请求, 另一个请求胜出后在数据回调中中止
+    std::size_t get_object_once(const std::string_view &key, uint64_t start_byte, uint64_t byte_count, char *buffer, std::size_t buffer_size, HedgeRace *race, std::size_t attempt) const {
+        // 读到对象末尾时事先不知道大小, 按buffer大小取令牌, 完成后退还多取的部分
+        const std::size_t expected_bytes = byte_count ? byte_count : buffer_size;
+        rate_limiter_.acquire(key, expected_bytes);
+        obs_object_info object_info = {
+            .key = (char *)key.data(),
+            .version_id = NULL
+        };
+        obs_get_conditions get_conditions;
+        init_get_properties(&get_conditions);
+        get_conditions.start_byte = start_byte;
+        get_conditions.byte_count = byte_count;
+
+        obs_get_object_handler get_object_handler = {
+            {&get_properties_callback, &response_complete_callback},
+            &get_object_data_callback
+        };
+
+        get_object_callback_data data = {
+            .buffer = buffer,
+            .buffer_size = buffer_size,
+            .race = race,
+            .attempt = attempt,
+        };
+
+        ::get_object(&base_option, &object_info, &get_conditions, 0, &get_object_handler, &data);
+
+        LOG_DEBUG("get key {} at [{}, {}) with size: {}", key, start_byte, start_byte + byte_count, data.cur_offset);
+
+        if (OBS_STATUS_OK != data.common.ret_status) {
+            throw Error(
+                fmt::format("Error in get_object, key: {}, range: [{}, {}), buffer size: {}, content length: {}", key, start_byte, start_byte + byte_count, buffer_size, data.content_length),
+                data.common.ret_status,
+                data.common.error_details
+            );
+        }
+        if (data.cur_offset < expected_bytes) {
+            rate_limiter_.refund(key, expected_bytes - data.cur_offset);
+        }
+        return data.cur_offset;
+    }
+
+    void put_object_once(const std::string_view &key, const std::string_view &object, HedgeRace *race, std::size_t attempt) const {
+        rate_limiter_.acquire(key, object.size());
+        // 初始化存储上传数据的结构体
+        object_callback_data data = {
+            // 流式上传数据buffer, 并赋值到上传数据结构中
+            .buffer = object.data(),
+            // 设置buffersize
+            .buffer_size = object.size(),
+            .race = race,
+            .attempt = attempt,
+        };
+
+        obs_put_object_handler put_object_handler = {
+            {&response_properties_callback, &response_complete_callback},
+            &put_buffer_data_callback
+        };
+
+        ::put_object(
+            &base_option,
+            (char *)key.data(),
+            data.buffer_size,
+            const_cast<obs_put_properties *>(&put_properties),
+            0,
+            &put_object_handler,
+            &data
+        );
+
+        LOG_DEBUG("put key {} with object size: {}", key, object.size());
+
+        if (OBS_STATUS_OK != data.common.ret_status) {
+            throw Error(
+                fmt::format("Error in put_object, key: {}, size: {}", key, object.size()),
+                data.common.ret_status,
+                data.common.error_details
+            );
+        }
+    }
+
     void deinit() {
         static std::once_flag once;
         std::call_once(once, []() {
@@ -387,18 +735,58 @@ class HuaweiCloudObs {
         uint64_t buffer_size;
         uint64_t cur_offset;
         std::size_t obs_next_append_position;
+        // 对冲请求的共享状态, 不对冲时为空
+        HedgeRace *race = nullptr;
+        std::size_t attempt = 0;
+    };
+
+    struct upload_part_callback_data {
+        // 需要位于首位, put_buffer_data_callback和response_complete_callback按object_callback_data访问
+        object_callback_data object;
+
+        unsigned int part_number;
+        char etag[OBS_COMMON_LEN_256];
+    };
+
+    struct source_callback_data {
+        // 需要位于首位, response_properties_callback和response_complete_callback按object_callback_data访问
+        object_callback_data object;
+
+        UploadSource *source;
+    };
+
+    struct get_object_callback_data {
+        common_callback_data common;
+
+        char *buffer;
+        uint64_t buffer_size;
+        uint64_t cur_offset;
+        uint64_t content_length;
+        HedgeRace *race = nullptr;
+        std::size_t attempt = 0;
+    };
+
+    struct delete_callback_data {
+        common_callback_data common;
+
+        std::vector<DeleteFailure> *failures;
     };
 
     struct list_object_callback_data {
         common_callback_data common;
 
-        std::vector<std::string> keys = {};
         std::vector<std::string> batch_keys = {};
+        bool is_truncated = false;
+        std::size_t listed_count = 0;
         std::optional<std::size_t> approximate_key_count = {};
     };
 
     static_assert(std::is_standard_layout<common_callback_data>::value == true);
     static_assert(std::is_standard_layout<object_callback_data>::value == true);
+    static_assert(std::is_standard_layout<upload_part_callback_data>::value == true);
+    static_assert(std::is_standard_layout<source_callback_data>::value == true);
+    static_assert(std::is_standard_layout<get_object_callback_data>::value == true);
+    static_assert(std::is_standard_layout<delete_callback_data>::value == true);
     static_assert(std::is_standard_layout<list_object_callback_data>::value == true);
 
     // 响应回调函数，可以在这个回调中把properties的内容记录到callback_data(用户自定义回调数据)中
@@ -476,6 +864,14 @@ class HuaweiCloudObs {
         object_callback_data *data =
             (object_callback_data *)callback_data;
         int toRead = 0;
+        // 对冲中另一个请求已经胜出时中止, 调用方可能已经返回, 不能再读取buffer
+        std::unique_lock<std::mutex> lock;
+        if (data->race) {
+            lock = std::unique_lock<std::mutex>(data->race->mutex);
+            if (data->race->lost(data->attempt)) {
+                return -1;
+            }
+        }
         if (data->buffer_size) {
             toRead = ((data->buffer_size > (unsigned)buffer_size) ? (unsigned)buffer_size : data->buffer_size);
             memcpy(buffer, data->buffer + data->cur_offset, toRead);
@@ -490,13 +886,68 @@ class HuaweiCloudObs {
         }
         return toRead;
     }
+    static int put_source_data_callback(int buffer_size, char *buffer, void *callback_data) {
+        source_callback_data *data = static_cast<source_callback_data *>(callback_data);
+        uint64_t remaining = data->object.buffer_size - data->object.cur_offset;
+        std::size_t to_read = std::min<uint64_t>(remaining, buffer_size);
+        if (to_read == 0) {
+            return 0;
+        }
+        to_read = data->source->feed(data->object.cur_offset, buffer, to_read);
+        data->object.cur_offset += to_read;
+        return static_cast<int>(to_read);
+    }
+    // 记录每个段的ETag, 合并时使用
+    static obs_status upload_part_properties_callback(const obs_response_properties *properties, void *callback_data) {
+        if (properties && properties->etag && callback_data) {
+            upload_part_callback_data *data = static_cast<upload_part_callback_data *>(callback_data);
+            snprintf(data->etag, sizeof(data->etag), "%s", properties->etag);
+        }
+        return OBS_STATUS_OK;
+    }
+    static obs_status complete_multipart_upload_callback(const char *location, const char *bucket, const char *key, const char *etag, void *callback_data) {
+        return OBS_STATUS_OK;
+    }
+    // get_object_callback_data与object_callback_data布局不同, 不能复用response_properties_callback
+    static obs_status get_properties_callback(const obs_response_properties *properties, void *callback_data) {
+        if (properties && callback_data) {
+            static_cast<get_object_callback_data *>(callback_data)->content_length = properties->content_length;
+        }
+        return OBS_STATUS_OK;
+    }
+    // 下载数据直接写入调用方的buffer, 超出buffer时中止请求
+    static obs_status get_object_data_callback(int buffer_size, const char *buffer, void *callback_data) {
+        get_object_callback_data *data = static_cast<get_object_callback_data *>(callback_data);
+        if (data->cur_offset + buffer_size > data->buffer_size) {
+            return OBS_STATUS_AbortedByCallback;
+        }
+        // 对冲中另一个请求已经胜出时中止, 写入与胜出方的提交互斥
+        std::unique_lock<std::mutex> lock;
+        if (data->race) {
+            lock = std::unique_lock<std::mutex>(data->race->mutex);
+            if (data->race->lost(data->attempt)) {
+                return OBS_STATUS_AbortedByCallback;
+            }
+        }
+        memcpy(data->buffer + data->cur_offset, buffer, buffer_size);
+        data->cur_offset += buffer_size;
+        return OBS_STATUS_OK;
+    }
     static obs_status delete_objects_data_callback(int contentsCount, obs_delete_objects *delobjs, void *callbackData) {
-        int i;
-        for (i = 0; i < contentsCount; i++) {
+        delete_callback_data *data = static_cast<delete_callback_data *>(callbackData);
+        for (int i = 0; i < contentsCount; i++) {
             const obs_delete_objects *content = &(delobjs[i]);
             // LOG_DEBUG("delete object result:\nobject key:{}\nerror code:{}\nerror message:{}\ndelete marker:{}\ndelete marker version_id:{}\n", content->key, content->code, content->message, content->delete_marker, content->delete_marker_version_id);
+            // 成功的key没有错误码
+            if (content->code && content->code[0] != '\0') {
+                data->failures->push_back({
+                    .key = content->key ? content->key : "",
+                    .code = content->code,
+                    .message = content->message ? content->message : "",
+                });
+            }
         }
-        LOG_DEBUG("deleted {} keys", contentsCount);
+        LOG_DEBUG("delete result of {} keys", contentsCount);
         return OBS_STATUS_OK;
     }
     static obs_status list_objects_callback(int is_truncated, const char *next_marker, int contents_count, const obs_list_objects_content *contents, int common_prefixes_count, const char **common_prefixes, void *callback_data) {
@@ -504,15 +955,16 @@ class HuaweiCloudObs {
 
         // 收集对象键
         for (int i = 0; i < contents_count; i++) {
-            data->keys.push_back(contents[i].key);
             data->batch_keys.push_back(contents[i].key);
         }
+        data->is_truncated = is_truncated;
+        data->listed_count += contents_count;
 
         if (data->approximate_key_count.has_value()) {
-            print_progress(data->keys.size(), data->approximate_key_count.value());
+            print_progress(data->listed_count, data->approximate_key_count.value());
         }
 
-        LOG_DEBUG("collected {} keys", data->keys.size());
+        LOG_DEBUG("collected {} keys", data->listed_count);
 
         return OBS_STATUS_OK;
     }
@@ -0,0 +1,198 @@
+#pragma once
+
+#include "object_store.h"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief 内存中的对象存储, 用于不依赖网络测量客户端自身的开销
+ * key按hash分到STRIPE_COUNT个分片, 每个分片一把读写锁和一个有序map, 不同分片的请求互不阻塞;
+ * 列举时从每个分片取marker之后的最多一页key再归并; 对象内容由shared_ptr持有, 有快照读者时追加先复制
+ */
+class MemoryObjectStore : public ObjectStore {
+  public:
+    using ObjectStore::batch_delete_objects;
+    using ObjectStore::put_object;
+
+    void put_object_single(const std::string_view &key, const std::string_view &object) const override {
+        put_owned(key, std::string(object));
+    }
+
+    void put_object(const std::string_view &key, UploadSource &source) const override {
+        std::string value(source.size(), '\0');
+        source.feed(0, value.data(), value.size());
+        put_owned(key, std::move(value));
+    }
+
+    // 直接接管已经接收好的数据, 不再拷贝
+    void put_owned(const std::string_view &key, std::string object) const {
+        auto value = std::make_shared<std::string>(std::move(object));
+        Stripe &stripe = stripe_of(key);
+        std::unique_lock lock(stripe.mutex);
+        stripe.objects.insert_or_assign(std::string(key), std::move(value));
+    }
+
+    std::size_t append_object(const std::string_view &key, const std::string_view &object, std::size_t start_pos) const override {
+        Stripe &stripe = stripe_of(key);
+        std::unique_lock lock(stripe.mutex);
+        auto it = stripe.objects.find(key);
+        std::size_t length = it == stripe.objects.end() ? 0 : it->second->size();
+        if (start_pos != length) {
+            throw Error(fmt::format("Error in append_object, key: {}, position: {} != length: {}", key, start_pos, length), OBS_STATUS_HttpErrorConflict);
+        }
+        if (it == stripe.objects.end()) {
+            it = stripe.objects.emplace(std::string(key), std::make_shared<std::string>()).first;
+        } else if (it->second.use_count() > 1) {
+            // 仍有读者持有旧内容(get_shared), 写时复制
+            it->second = std::make_shared<std::string>(*it->second);
+        }
+        it->second->append(object);
+        return it->second->size();
+    }
+
+    // 返回对象当前内容的快照, 之后的写入不影响快照; 读者可以在不持锁的情况下慢速消费(例如发送到网络)
+    std::shared_ptr<const std::string> get_shared(const std::string_view &key) const {
+        Stripe &stripe = stripe_of(key);
+        std::shared_lock lock(stripe.mutex);
+        auto it = stripe.objects.find(key);
+        if (it == stripe.objects.end()) {
+            throw Error(fmt::format("Error in get_object, key: {}", key), OBS_STATUS_NoSuchKey);
+        }
+        return it->second;
+    }
+
+    std::size_t get_object(const std::string_view &key, char *buffer, std::size_t buffer_size) const override {
+        Stripe &stripe = stripe_of(key);
+        std::shared_lock lock(stripe.mutex);
+        const std::string &value = find(stripe, key);
+        if (value.size() > buffer_size) {
+            throw Error(fmt::format("Error in get_object, key: {}, buffer size: {}, content length: {}", key, buffer_size, value.size()), OBS_STATUS_AbortedByCallback);
+        }
+        memcpy(buffer, value.data(), value.size());
+        return value.size();
+    }
+
+    std::size_t get_range(const std::string_view &key, std::size_t offset, std::size_t len, char *buffer) const override {
+        if (len == 0) {
+            return 0;
+        }
+        Stripe &stripe = stripe_of(key);
+        std::shared_lock lock(stripe.mutex);
+        const std::string &value = find(stripe, key);
+        if (offset >= value.size()) {
+            throw Error(fmt::format("Error in get_object, key: {}, range: [{}, {}), content length: {}", key, offset, offset + len, value.size()), OBS_STATUS_InvalidRange);
+        }
+        std::size_t read = std::min(len, value.size() - offset);
+        memcpy(buffer, value.data() + offset, read);
+        return read;
+    }
+
+    std::size_t head_object(const std::string_view &key) const override {
+        Stripe &stripe = stripe_of(key);
+        std::shared_lock lock(stripe.mutex);
+        return find(stripe, key).size();
+    }
+
+    // 与OBS一致, 删除不存在的key不报错
+    void delete_object(const std::string_view &key) const override {
+        Stripe &stripe = stripe_of(key);
+        std::unique_lock lock(stripe.mutex);
+        auto it = stripe.objects.find(key);
+        if (it != stripe.objects.end()) {
+            stripe.objects.erase(it);
+        }
+    }
+
+    void batch_delete_objects(const std::string *keys, std::size_t count, std::vector<DeleteFailure> &failures) const override {
+        for (std::size_t i = 0; i < count; ++i) {
+            delete_object(keys[i]);
+        }
+    }
+
+    void list_objects_pages(const ListPageCallback &on_page, std::string start_key = "", std::string prefix = "", std::string delimiter = "/", bool report_progress = true) const override {
+        while (true) {
+            bool is_truncated = false;
+            std::vector<std::string> page = list_page(start_key, prefix, delimiter, LIST_MAX_KEYS, is_truncated);
+            if (page.empty()) {
+                break;
+            }
+            start_key = page.back();
+            if (!on_page(page) || !is_truncated) {
+                break;
+            }
+        }
+    }
+
+    // 一次列举: prefix下大于start_key的最多max_keys个key, 与list_bucket_objects的一次请求对应
+    std::vector<std::string> list_page(const std::string &start_key, const std::string &prefix, const std::string &delimiter, std::size_t max_keys, bool &is_truncated) const {
+        const bool inclusive = start_key < prefix;
+        const std::string &marker = inclusive ? prefix : start_key;
+        std::vector<std::string> page;
+        is_truncated = false;
+        for (auto &stripe : stripes_) {
+            std::shared_lock lock(stripe.mutex);
+            auto it = inclusive ? stripe.objects.lower_bound(marker) : stripe.objects.upper_bound(marker);
+            std::size_t collected = 0;
+            for (; it != stripe.objects.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it) {
+                if (!delimiter.empty() && it->first.find(delimiter, prefix.size()) != std::string::npos) {
+                    continue;
+                }
+                if (collected == max_keys) {
+                    is_truncated = true;
+                    break;
+                }
+                page.push_back(it->first);
+                ++collected;
+            }
+        }
+        std::sort(page.begin(), page.end());
+        if (page.size() > max_keys) {
+            page.resize(max_keys);
+            is_truncated = true;
+        }
+        return page;
+    }
+
+    std::size_t get_approximate_object_count() const override {
+        std::size_t count = 0;
+        for (auto &stripe : stripes_) {
+            std::shared_lock lock(stripe.mutex);
+            count += stripe.objects.size();
+        }
+        return count;
+    }
+
+  private:
+    static constexpr std::size_t STRIPE_COUNT = 64;
+
+    // 独占缓存行, 避免相邻分片的锁互相干扰
+    struct alignas(64) Stripe {
+        std::shared_mutex mutex;
+        std::map<std::string, std::shared_ptr<std::string>, std::less<>> objects;
+    };
+
+    Stripe &stripe_of(const std::string_view &key) const {
+        return stripes_[std::hash<std::string_view>{}(key) % STRIPE_COUNT];
+    }
+
+    // 调用方需持有stripe的锁
+    static const std::string &find(const Stripe &stripe, const std::string_view &key) {
+        auto it = stripe.objects.find(key);
+        if (it == stripe.objects.end()) {
+            throw Error(fmt::format("Error in get_object, key: {}", key), OBS_STATUS_NoSuchKey);
+        }
+        return *it->second;
+    }
+
+    mutable std::array<Stripe, STRIPE_COUNT> stripes_;
+};
@@ -0,0 +1,368 @@
+#pragma once
+
+#include "arena.h"
+#include "bounded_queue.h"
+#include "config.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <random>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief LSM的内存写缓冲: 无锁跳表, 节点(连同key和value)分配在Arena中, 不单独malloc
+ * 多个线程可以同时add和get: 插入时逐层用CAS把节点接入链表, CAS失败只重新查找该层的位置;
+ * 读取只做acquire加载, 不加锁. 同一个key的多个版本按seq从新到旧排列, get返回最新的版本(可能是删除标记)
+ */
+class MemTable {
+    struct Node;
+
+  public:
+    enum Type : uint8_t {
+        PUT = 0,
+        DELETE = 1,
+    };
+
+    // key和value指向Arena中的内存, 与MemTable的生命周期相同
+    struct Entry {
+        std::string_view key;
+        std::string_view value;
+        uint64_t seq;
+        Type type;
+    };
+
+    static constexpr int MAX_HEIGHT = 12;
+
+    explicit MemTable(std::size_t arena_block_bytes = 1 << 20) : arena_(arena_block_bytes), head_(new_node(MAX_HEIGHT, 0, {}, {}, PUT)) {}
+
+    MemTable(const MemTable &) = delete;
+    MemTable &operator=(const MemTable &) = delete;
+
+    // 同一个<key, seq>只能插入一次
+    void add(uint64_t seq, std::string_view key, std::string_view value, Type type = PUT) {
+        int height = random_height();
+        Node *node = new_node(height, seq, key, value, type);
+        int max_height = max_height_.load(std::memory_order_relaxed);
+        while (height > max_height && !max_height_.compare_exchange_weak(max_height, height, std::memory_order_relaxed)) {
+        }
+
+        Node *prev[MAX_HEIGHT];
+        Node *next[MAX_HEIGHT];
+        Node *before = head_;
+        for (int level = std::max(max_height, height) - 1; level >= 0; --level) {
+            find_splice(node, before, level, prev[level], next[level]);
+            before = prev[level];
+        }
+        // 从底层往上接入, 节点在第0层可见后即可被读到
+        for (int level = 0; level < height; ++level) {
+            while (true) {
+                node->next(level).store(next[level], std::memory_order_relaxed);
+                if (prev[level]->next(level).compare_exchange_strong(next[level], node, std::memory_order_release)) {
+                    break;
+                }
+                find_splice(node, prev[level], level, prev[level], next[level]);
+            }
+        }
+        count_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::optional<Entry> get(std::string_view key) const {
+        // seq最大的版本排在最前
+        Node *node = seek(key, UINT64_MAX);
+        if (node && node->key() == key) {
+            return node->entry();
+        }
+        return std::nullopt;
+    }
+
+    std::size_t memory_usage() const {
+        return arena_.memory_usage();
+    }
+
+    std::size_t count() const {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+    // 按<key升序, seq降序>遍历第0层; 与add并发时可能看到遍历开始之后插入的节点
+    class Iterator {
+      public:
+        explicit Iterator(const MemTable &table) : table_(table) {}
+
+        bool valid() const { return node_ != nullptr; }
+        void seek_to_first() { node_ = table_.head_->next(0).load(std::memory_order_acquire); }
+        void seek(std::string_view key) { node_ = table_.seek(key, UINT64_MAX); }
+        void next() { node_ = node_->next(0).load(std::memory_order_acquire); }
+        Entry entry() const { return node_->entry(); }
+
+      private:
+        const MemTable &table_;
+        Node *node_ = nullptr;
+    };
+
+  private:
+    struct Node {
+        uint64_t seq;
+        uint32_t key_size;
+        uint32_t value_size;
+        uint8_t type;
+        uint8_t height;
+        // 实际有height个, 之后依次为key和value
+        std::atomic<Node *> next_[1];
+
+        std::atomic<Node *> &next(int level) { return next_[level]; }
+        const char *data() const { return reinterpret_cast<const char *>(next_) + sizeof(std::atomic<Node *>) * height; }
+        std::string_view key() const { return {data(), key_size}; }
+        std::string_view value() const { return {data() + key_size, value_size}; }
+        Entry entry() const { return Entry{key(), value(), seq, static_cast<Type>(type)}; }
+    };
+
+    Node *new_node(int height, uint64_t seq, std::string_view key, std::string_view value, Type type) {
+        std::size_t bytes = offsetof(Node, next_) + sizeof(std::atomic<Node *>) * height + key.size() + value.size();
+        Node *node = new (arena_.allocate(bytes)) Node;
+        node->seq = seq;
+        node->key_size = static_cast<uint32_t>(key.size());
+        node->value_size = static_cast<uint32_t>(value.size());
+        node->type = type;
+        node->height = static_cast<uint8_t>(height);
+        for (int level = 0; level < height; ++level) {
+            new (&node->next_[level]) std::atomic<Node *>(nullptr);
+        }
+        char *data = const_cast<char *>(node->data());
+        memcpy(data, key.data(), key.size());
+        memcpy(data + key.size(), value.data(), value.size());
+        return node;
+    }
+
+    // 每层以1/4的概率升高
+    static int random_height() {
+        thread_local std::mt19937 rng(std::random_device{}());
+        int height = 1;
+        while (height < MAX_HEIGHT && (rng() & 3) == 0) {
+            ++height;
+        }
+        return height;
+    }
+
+    // node是否排在<key, seq>之前
+    static bool less(const Node *node, std::string_view key, uint64_t seq) {
+        int cmp = node->key().compare(key);
+        return cmp < 0 || (cmp == 0 && node->seq > seq);
+    }
+
+    // 在level层从before开始找到第一个不排在node之前的节点
+    static void find_splice(const Node *node, Node *before, int level, Node *&prev, Node *&next) {
+        while (true) {
+            Node *candidate = before->next(level).load(std::memory_order_acquire);
+            if (candidate == nullptr || !less(candidate, node->key(), node->seq)) {
+                prev = before;
+                next = candidate;
+                return;
+            }
+            before = candidate;
+        }
+    }
+
+    // 第一个不排在<key, seq>之前的节点
+    Node *seek(std::string_view key, uint64_t seq) const {
+        Node *node = head_;
+        for (int level = max_height_.load(std::memory_order_relaxed) - 1; level >= 0; --level) {
+            while (true) {
+                Node *next = node->next(level).load(std::memory_order_acquire);
+                if (next == nullptr || !less(next, key, seq)) {
+                    break;
+                }
+                node = next;
+            }
+        }
+        return node->next(0).load(std::memory_order_acquire);
+    }
+
+    Arena arena_;
+    Node *const head_;
+    std::atomic<int> max_height_ = 1;
+    std::atomic<std::size_t> count_ = 0;
+};
+
+/**
+ * @brief 当前可写的MemTable和等待落盘的不可变MemTable
+ * 当前MemTable超过write_buffer_bytes后冻结(rotate), 交给后台的flush线程, 并换上新的MemTable;
+ * 不可变的MemTable达到max_immutable个时写入等待flush(写停顿). 写入和rotate之间用读写锁:
+ * 写入持有共享锁, 只有rotate时短暂持有独占锁, 冻结之后不会再有写入. get依次查找当前和不可变的MemTable
+ */
+class MemTableList {
+  public:
+    // 在flush线程上按冻结的顺序调用, 返回后该MemTable被释放
+    using FlushCallback = std::function<void(const MemTable &table)>;
+
+    // get的结果, 拷贝自MemTable, 不受flush之后释放的影响
+    struct Record {
+        std::string value;
+        uint64_t seq;
+        MemTable::Type type;
+    };
+
+    struct Options {
+        std::size_t write_buffer_bytes = 64 << 20;
+        std::size_t max_immutable = 2;
+        std::size_t arena_block_bytes = 1 << 20;
+
+        static Options from_config() {
+            return Options{
+                .write_buffer_bytes = CONFIG::MEMTABLE_BYTES,
+                .max_immutable = std::max<std::size_t>(1, CONFIG::MEMTABLE_MAX_IMMUTABLE),
+            };
+        }
+    };
+
+    struct Stats {
+        std::size_t rotations = 0;
+        std::size_t flushes = 0;
+        // 因不可变MemTable过多而等待的总时间
+        double stall_seconds = 0;
+    };
+
+    MemTableList(FlushCallback on_flush, const Options &options = Options::from_config())
+        : on_flush_(std::move(on_flush)), options_(options), active_(std::make_shared<MemTable>(options_.arena_block_bytes)), flush_queue_(options_.max_immutable) {
+        flusher_ = std::thread([this]() { run(); });
+    }
+
+    ~MemTableList() {
+        close();
+    }
+
+    MemTableList(const MemTableList &) = delete;
+    MemTableList &operator=(const MemTableList &) = delete;
+
+    // 返回分配的seq
+    uint64_t add(std::string_view key, std::string_view value, MemTable::Type type = MemTable::PUT) {
+        uint64_t seq;
+        std::optional<uint64_t> full;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex_);
+            seq = next_seq_.fetch_add(1, std::memory_order_relaxed) + 1;
+            active_->add(seq, key, value, type);
+            if (active_->memory_usage() >= options_.write_buffer_bytes) {
+                full = generation_;
+            }
+        }
+        if (full) {
+            rotate(*full);
+        }
+        return seq;
+    }
+
+    // 返回最新的版本, 删除标记也返回(type为DELETE), 以便调用方不再查找更旧的数据
+    std::optional<Record> get(std::string_view key) const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto entry = active_->get(key);
+        for (auto it = immutables_.rbegin(); !entry && it != immutables_.rend(); ++it) {
+            entry = (*it)->get(key);
+        }
+        if (!entry) {
+            return std::nullopt;
+        }
+        return Record{std::string(entry->value), entry->seq, entry->type};
+    }
+
+    // 冻结当前的MemTable(为空时不冻结)并等待所有不可变的MemTable写完
+    void flush() {
+        std::optional<uint64_t> generation;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex_);
+            if (active_->count() > 0) {
+                generation = generation_;
+            }
+        }
+        if (generation) {
+            rotate(*generation);
+        }
+        std::unique_lock<std::mutex> lock(stall_mutex_);
+        stall_cv_.wait(lock, [&]() { return immutable_count_ == 0; });
+    }
+
+    // flush剩余的数据并停止flush线程
+    void close() {
+        if (!flusher_.joinable()) {
+            return;
+        }
+        flush();
+        flush_queue_.close();
+        flusher_.join();
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(stall_mutex_);
+        return stats_;
+    }
+
+  private:
+    // 冻结第generation个MemTable; 其他线程已经冻结了它时什么也不做
+    void rotate(uint64_t generation) {
+        auto stall_start = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> stall(stall_mutex_);
+        stall_cv_.wait(stall, [&]() { return immutable_count_ < options_.max_immutable; });
+        stats_.stall_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - stall_start).count();
+
+        std::shared_ptr<MemTable> frozen;
+        {
+            std::unique_lock<std::shared_mutex> lock(mutex_);
+            if (generation_ != generation) {
+                return;
+            }
+            frozen = std::move(active_);
+            immutables_.push_back(frozen);
+            active_ = std::make_shared<MemTable>(options_.arena_block_bytes);
+            ++generation_;
+        }
+        ++immutable_count_;
+        ++stats_.rotations;
+        // 持有stall_mutex_入队以保证flush的顺序; 队列容量为max_immutable, 不会阻塞
+        flush_queue_.push(std::move(frozen));
+    }
+
+    void run() {
+        while (auto table = flush_queue_.pop()) {
+            on_flush_(**table);
+            {
+                std::unique_lock<std::shared_mutex> lock(mutex_);
+                immutables_.erase(std::find(immutables_.begin(), immutables_.end(), *table));
+            }
+            std::lock_guard<std::mutex> stall(stall_mutex_);
+            --immutable_count_;
+            ++stats_.flushes;
+            stall_cv_.notify_all();
+        }
+    }
+
+    const FlushCallback on_flush_;
+    const Options options_;
+
+    mutable std::shared_mutex mutex_;
+    std::shared_ptr<MemTable> active_;
+    // active_的编号, 每次冻结加1; 不用active_的地址比较, 释放后的地址可能被新的MemTable复用
+    uint64_t generation_ = 0;
+    // 按冻结的顺序, 越靠后越新
+    std::vector<std::shared_ptr<MemTable>> immutables_;
+    std::atomic<uint64_t> next_seq_ = 0;
+
+    mutable std::mutex stall_mutex_;
+    std::condition_variable stall_cv_;
+    std::size_t immutable_count_ = 0;
+    Stats stats_;
+
+    BoundedQueue<std::shared_ptr<MemTable>> flush_queue_;
+    std::thread flusher_;
+};
@@ -0,0 +1,565 @@
+#pragma once
+
+#include "bounded_queue.h"
+#include "config.h"
+#include "fmt/core.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <eSDKOBS.h>
+#include <exception>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <iterator>
+#include <log.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <thread_pool.h>
+#include <type_traits>
+#include <upload_source.h>
+#include <vector>
+
+template <>
+struct fmt::formatter<obs_error_details> : fmt::formatter<std::string_view> {
+    template <typename FormatContext>
+    auto format(const obs_error_details& error, FormatContext& ctx) const {
+        std::string msg;
+        if (error.message) {
+            msg += fmt::format("Error Message: \n   {}\n", error.message);
+        }
+        if (error.resource) {
+            msg += fmt::format("Error Resource: \n  {}\n", error.resource);
+        }
+        if (error.further_details) {
+            msg += fmt::format("Error further_details: \n   {}\n", error.further_details);
+        }
+        if (error.extra_details_count) {
+            int i;
+            for (i = 0; i < error.extra_details_count; i++) {
+                const char *name = error.extra_details[i].name;
+                const char *value = error.extra_details[i].value;
+                msg += fmt::format("Error Extra Detail({}):\n   {}:{}\n", i, name ? name : "NULL", value ? value : "NULL");
+            }
+        }
+        if (error.error_headers_count) {
+            int i;
+            for (i = 0; i < error.error_headers_count; i++) {
+                const char *errorHeader = error.error_headers[i];
+                msg += fmt::format("Error Headers({}):\n    {}\n", i, errorHeader == NULL ? "NULL Header" : errorHeader);
+            }
+        }
+
+        auto out = ctx.out();
+        out = fmt::format_to(out, "{}", msg);
+        return out;
+    }
+};
+
+/**
+ * @brief 对象存储接口, 各后端只需实现基本的对象操作
+ * 分段/并发下载, 流水线删除, 分片并发列举和异步接口都基于基本操作实现, 所有后端共用;
+ * 错误统一使用SDK的obs_status, 调用方可以不区分后端处理错误
+ */
+class ObjectStore {
+  public:
+    class Error : public std::exception {
+      public:
+        Error(const std::string &msg, obs_status status, const obs_error_details &error)
+            : status(status), error(error) {
+            _msg = fmt::format("Error: {}, status: {} details: {}", msg, obs_get_status_name(status), error);
+            PRINT_STACK_TRACE();
+        }
+
+        Error(const std::string &msg, obs_status status) : Error(msg, status, {}) {}
+
+        Error(const std::string &msg) : Error(msg, {}, {}) {}
+
+        Error() : Error("") {}
+
+        const char *what() const noexcept override {
+            // PRINT_STACK_TRACE();
+            return _msg.c_str();
+        }
+
+        int get_msg_len() { return _msg.length(); }
+
+        std::string _msg;
+
+        const obs_status status = {};
+        const obs_error_details error = {};
+    };
+
+    // 批量删除中删除失败的key
+    struct DeleteFailure {
+        std::string key;
+        std::string code;
+        std::string message;
+    };
+
+    // 后端内部重试的累计次数, 见Retrier
+    struct RetryStats {
+        // 包括首次请求
+        std::size_t attempts = 0;
+        std::size_t retries = 0;
+        // 达到最大次数仍失败
+        std::size_t gave_up = 0;
+        // 因重试预算耗尽而放弃
+        std::size_t budget_exhausted = 0;
+        double backoff_seconds = 0;
+
+        RetryStats operator-(const RetryStats &other) const {
+            return {
+                .attempts = attempts - other.attempts,
+                .retries = retries - other.retries,
+                .gave_up = gave_up - other.gave_up,
+                .budget_exhausted = budget_exhausted - other.budget_exhausted,
+                .backoff_seconds = backoff_seconds - other.backoff_seconds,
+            };
+        }
+    };
+
+    // 对冲请求的统计, requests为可对冲的请求数
+    struct HedgeStats {
+        std::size_t requests = 0;
+        std::size_t hedges = 0;
+        // 对冲请求先于主请求完成
+        std::size_t hedge_wins = 0;
+        // 超过分位数但因对冲比例上限没有对冲
+        std::size_t budget_denied = 0;
+
+        HedgeStats operator-(const HedgeStats &other) const {
+            return {
+                .requests = requests - other.requests,
+                .hedges = hedges - other.hedges,
+                .hedge_wins = hedge_wins - other.hedge_wins,
+                .budget_denied = budget_denied - other.budget_denied,
+            };
+        }
+    };
+
+    // 客户端限流的统计, wait_seconds为请求发出前在限流器中等待的总时间
+    struct RateLimitStats {
+        std::size_t requests = 0;
+        std::size_t waits = 0;
+        double wait_seconds = 0;
+
+        RateLimitStats operator-(const RateLimitStats &other) const {
+            return {
+                .requests = requests - other.requests,
+                .waits = waits - other.waits,
+                .wait_seconds = wait_seconds - other.wait_seconds,
+            };
+        }
+    };
+
+    // 异步请求完成(成功时error为空)后在工作线程上调用
+    using AsyncCallback = std::function<void(std::exception_ptr error)>;
+
+    // 每列举到一页(最多LIST_MAX_KEYS个key)调用一次on_page, on_page返回false时停止;
+    // on_page可以移走page中的key, 内存占用只与页大小有关
+    using ListPageCallback = std::function<bool(std::vector<std::string> &page)>;
+
+    virtual ~ObjectStore() = default;
+
+    // ---- 由各后端实现 ----
+
+    virtual void put_object_single(const std::string_view &key, const std::string_view &object) const = 0;
+
+    // 单次PUT, 数据由source按偏移提供
+    virtual void put_object(const std::string_view &key, UploadSource &source) const = 0;
+
+    // 在start_pos处追加, start_pos必须等于对象当前长度; 返回下次追加的位置
+    virtual std::size_t append_object(const std::string_view &key, const std::string_view &object, std::size_t start_pos) const = 0;
+
+    // 读取整个对象, 数据直接写入调用方提供的buffer; 返回读取的字节数, buffer不足时抛出异常
+    virtual std::size_t get_object(const std::string_view &key, char *buffer, std::size_t buffer_size) const = 0;
+
+    // 读取对象[offset, offset + len)范围内的数据到buffer(至少len字节); 返回读取的字节数
+    virtual std::size_t get_range(const std::string_view &key, std::size_t offset, std::size_t len, char *buffer) const = 0;
+
+    // 获取对象大小
+    virtual std::size_t head_object(const std::string_view &key) const = 0;
+
+    virtual void delete_object(const std::string_view &key) const = 0;
+
+    // 一次删除keys[0, count)(count不超过LIST_MAX_KEYS), 删除失败的key追加到failures, 整批失败时抛出异常
+    virtual void batch_delete_objects(const std::string *keys, std::size_t count, std::vector<DeleteFailure> &failures) const = 0;
+
+    // 按key的升序逐页列举, start_key not included in the result;
+    // delimiter非空时跳过prefix之后包含delimiter的key(即"子目录"中的key);
+    // report_progress时后端可以在列举整个桶(三个字符串参数都为空)时查询对象数并打印进度
+    virtual void list_objects_pages(const ListPageCallback &on_page, std::string start_key = "", std::string prefix = "", std::string delimiter = "/", bool report_progress = true) const = 0;
+
+    virtual std::size_t get_approximate_object_count() const = 0;
+
+    // 调用方保证key只写入这一次(如带唯一序号的key), 没有其他写入与之竞争时调用, 后端可以对冲;
+    // 不支持对冲的后端等同put_object_single
+    virtual void put_object_unique(const std::string_view &key, const std::string_view &object) const {
+        put_object_single(key, object);
+    }
+
+    // 没有分段上传的后端退化为单次PUT
+    virtual void put_object_multipart(const std::string_view &key, const std::string_view &object, std::size_t part_size, std::size_t concurrency) const {
+        put_object_single(key, object);
+    }
+
+    /**
+     * @brief 流式分段上传, 调用方逐段提供数据, 不需要事先拼出整个对象
+     * 各段可以并发上传, 全部成功后complete; 未complete就销毁时放弃上传并清理已上传的段
+     */
+    class MultipartUpload {
+      public:
+        virtual ~MultipartUpload() = default;
+
+        // part_number从1开始连续编号; 除最后一段外每段不能小于后端的最小段大小
+        virtual void upload_part(unsigned int part_number, const std::string_view &part) = 0;
+
+        virtual void complete() = 0;
+    };
+
+    // 没有分段上传的后端在内存中拼接各段, complete时单次PUT
+    virtual std::unique_ptr<MultipartUpload> begin_multipart_upload(const std::string_view &key) const {
+        return std::make_unique<BufferedMultipartUpload>(*this, std::string(key));
+    }
+
+    // 没有内部重试的后端返回全0
+    virtual RetryStats retry_stats() const {
+        return {};
+    }
+
+    // 不支持对冲的后端返回全0
+    virtual HedgeStats hedge_stats() const {
+        return {};
+    }
+
+    // 没有客户端限流的后端返回全0
+    virtual RateLimitStats rate_limit_stats() const {
+        return {};
+    }
+
+    // ---- 基于基本操作的通用实现 ----
+
+    // 对象大小达到CONFIG::MULTIPART_THRESHOLD时使用分段上传, 否则单次PUT
+    void put_object(const std::string_view &key, const std::string_view &object) const {
+        if (CONFIG::MULTIPART_THRESHOLD > 0 && object.size() >= CONFIG::MULTIPART_THRESHOLD) {
+            put_object_multipart(key, object, CONFIG::MULTIPART_PART_SIZE, CONFIG::MULTIPART_CONCURRENCY);
+        } else {
+            put_object_single(key, object);
+        }
+    }
+
+    // 异步接口: 请求提交到共享的工作线程池后立即返回, future在请求完成后就绪, 失败时future抛出对应异常;
+    // object/buffer需要保持有效直到请求完成
+    std::future<void> async_put_object(std::string key, const std::string_view &object, AsyncCallback on_complete = {}) const {
+        return submit_async([this, key = std::move(key), object]() { put_object(key, object); }, std::move(on_complete));
+    }
+
+    std::future<std::size_t> async_get_object(std::string key, char *buffer, std::size_t buffer_size, AsyncCallback on_complete = {}) const {
+        return submit_async([this, key = std::move(key), buffer, buffer_size]() { return get_object(key, buffer, buffer_size); }, std::move(on_complete));
+    }
+
+    std::future<std::size_t> async_get_range(std::string key, std::size_t offset, std::size_t len, char *buffer, AsyncCallback on_complete = {}) const {
+        return submit_async([this, key = std::move(key), offset, len, buffer]() { return get_range(key, offset, len, buffer); }, std::move(on_complete));
+    }
+
+    // upload和part需要保持有效直到请求完成
+    std::future<void> async_upload_part(MultipartUpload &upload, unsigned int part_number, const std::string_view &part, AsyncCallback on_complete = {}) const {
+        return submit_async([&upload, part_number, part]() { upload.upload_part(part_number, part); }, std::move(on_complete));
+    }
+
+    std::future<void> async_delete_object(std::string key, AsyncCallback on_complete = {}) const {
+        return submit_async([this, key = std::move(key)]() { delete_object(key); }, std::move(on_complete));
+    }
+
+    // 先HEAD获取对象大小, 再按part_size分段由concurrency个线程并发get_range,
+    // 每段直接写入dst中对应的偏移(dst可以是预分配的内存或mmap的文件, 至少dst_size字节); 返回对象大小
+    std::size_t parallel_get(const std::string_view &key, char *dst, std::size_t dst_size, std::size_t part_size, std::size_t concurrency) const {
+        ASSERT(part_size > 0);
+        std::size_t object_size = head_object(key);
+        if (object_size > dst_size) {
+            throw Error(fmt::format("Error in parallel_get, key: {}, object size: {} > dst size: {}", key, object_size, dst_size));
+        }
+        std::size_t part_count = (object_size + part_size - 1) / part_size;
+        parallel_for(part_count, concurrency, [&](std::size_t part_idx) {
+            std::size_t offset = part_idx * part_size;
+            std::size_t len = std::min(part_size, object_size - offset);
+            std::size_t read = get_range(key, offset, len, dst + offset);
+            if (read != len) {
+                throw Error(fmt::format("Error in parallel_get, key: {}, part: {}, read: {}, expected: {}", key, part_idx, read, len));
+            }
+        });
+        LOG_DEBUG("parallel get key {} with size: {}, parts: {}", key, object_size, part_count);
+        return object_size;
+    }
+
+    // 一次请求删除最多LIST_MAX_KEYS个key, 返回删除失败的key
+    std::vector<DeleteFailure> batch_delete_objects(const std::vector<std::string> &keys) const {
+        ASSERT(0 < keys.size() && keys.size() <= LIST_MAX_KEYS);
+        std::vector<DeleteFailure> failures;
+        batch_delete_objects(keys.data(), keys.size(), failures);
+        return failures;
+    }
+
+    // 按LIST_MAX_KEYS个key一批, 最多in_flight批同时在途; 每批直接引用keys中的字符串, 不拷贝key;
+    // 返回所有删除失败的key, 整批请求失败时抛出异常
+    std::vector<DeleteFailure> delete_objects(const std::vector<std::string> &keys, std::size_t in_flight = CONFIG::DELETE_IN_FLIGHT) const {
+        std::size_t batch_count = (keys.size() + LIST_MAX_KEYS - 1) / LIST_MAX_KEYS;
+        std::vector<std::vector<DeleteFailure>> batch_failures(batch_count);
+        parallel_for(batch_count, in_flight, [&](std::size_t batch_idx) {
+            std::size_t offset = batch_idx * LIST_MAX_KEYS;
+            std::size_t count = std::min<std::size_t>(LIST_MAX_KEYS, keys.size() - offset);
+            batch_delete_objects(keys.data() + offset, count, batch_failures[batch_idx]);
+        });
+
+        std::vector<DeleteFailure> failures;
+        for (auto &batch : batch_failures) {
+            std::move(batch.begin(), batch.end(), std::back_inserter(failures));
+        }
+        if (!failures.empty()) {
+            LOG_WARN("failed to delete {} of {} keys, first: {} ({})", failures.size(), keys.size(), failures[0].key, failures[0].code);
+        }
+        return failures;
+    }
+
+    // 流水线删除: 按CONFIG::LIST_SHARD_ALPHABET分片并发列举, 每攒够CONFIG::DELETE_IN_FLIGHT页就并发批量删除,
+    // 删除与后续列举并行, 内存占用与对象数无关; 返回删除的key数
+    std::size_t delete_prefix(const std::string &prefix = "") const {
+        const std::size_t window_size = std::max<std::size_t>(1, CONFIG::DELETE_IN_FLIGHT) * LIST_MAX_KEYS;
+        std::vector<std::string> window;
+        window.reserve(window_size);
+        std::size_t deleted = 0;
+        auto flush = [&]() {
+            if (!window.empty()) {
+                deleted += window.size() - delete_objects(window).size();
+                window.clear();
+            }
+        };
+        list_objects_parallel([&](std::vector<std::string> &page) {
+            std::move(page.begin(), page.end(), std::back_inserter(window));
+            if (window.size() >= window_size) {
+                flush();
+            }
+            return true;
+        }, make_shard_boundaries(prefix), CONFIG::LIST_CONCURRENCY, false, prefix);
+        flush();
+        return deleted;
+    }
+
+    std::size_t delete_all() const {
+        std::cout << fmt::format("deleting about {} keys\n", get_approximate_object_count());
+        std::size_t deleted = delete_prefix();
+        std::cout << fmt::format("deleted {} keys\n", deleted);
+        return deleted;
+    }
+
+    // 由prefix + alphabet中的每个字符生成list_objects_parallel的分片边界
+    static std::vector<std::string> make_shard_boundaries(const std::string &prefix = "", std::string_view alphabet = CONFIG::LIST_SHARD_ALPHABET) {
+        std::string chars(alphabet);
+        std::sort(chars.begin(), chars.end());
+        chars.erase(std::unique(chars.begin(), chars.end()), chars.end());
+        std::vector<std::string> boundaries;
+        boundaries.reserve(chars.size());
+        for (char c : chars) {
+            boundaries.push_back(prefix + c);
+        }
+        return boundaries;
+    }
+
+    // 按升序的boundaries把key空间划分为不相交的范围(-inf, b0], (b0, b1], ..., (bn-1, +inf),
+    // 由concurrency个线程并发列举, 在当前线程上逐页调用on_page;
+    // ordered为true时按key的顺序输出(每个范围单独缓存), 否则按到达顺序输出
+    void list_objects_parallel(const ListPageCallback &on_page, const std::vector<std::string> &boundaries, std::size_t concurrency, bool ordered = false, const std::string &prefix = "") const {
+        ASSERT(std::is_sorted(boundaries.begin(), boundaries.end()));
+        const std::size_t shard_count = boundaries.size() + 1;
+
+        std::vector<std::unique_ptr<BoundedQueue<std::vector<std::string>>>> queues(ordered ? shard_count : 1);
+        for (auto &queue : queues) {
+            queue = std::make_unique<BoundedQueue<std::vector<std::string>>>(LIST_PIPELINE_DEPTH);
+        }
+        auto close_all = [&]() {
+            for (auto &queue : queues) {
+                queue->close();
+            }
+        };
+
+        std::atomic<std::size_t> running_shards = shard_count;
+        std::exception_ptr list_error;
+        std::thread lister([&]() {
+            try {
+                parallel_for(shard_count, concurrency, [&](std::size_t shard_idx) {
+                    auto &queue = *queues[ordered ? shard_idx : 0];
+                    try {
+                        std::string lower = shard_idx > 0 ? boundaries[shard_idx - 1] : "";
+                        const std::string *upper = shard_idx + 1 < shard_count ? &boundaries[shard_idx] : nullptr;
+                        list_objects_pages([&](std::vector<std::string> &page) {
+                            bool done = false;
+                            if (upper) {
+                                auto end = std::upper_bound(page.begin(), page.end(), *upper);
+                                done = end != page.end();
+                                page.erase(end, page.end());
+                            }
+                            bool pushed = page.empty() || queue.push(std::move(page));
+                            return pushed && !done;
+                        }, lower, prefix, "", false);
+                    } catch (...) {
+                        // 避免其他分片阻塞在push上
+                        close_all();
+                        throw;
+                    }
+                    if (ordered || --running_shards == 0) {
+                        queue.close();
+                    }
+                });
+            } catch (...) {
+                list_error = std::current_exception();
+            }
+        });
+
+        bool stopped = false;
+        for (auto &queue : queues) {
+            while (!stopped) {
+                auto page = queue->pop();
+                if (!page) {
+                    break;
+                }
+                stopped = !on_page(*page);
+            }
+        }
+        if (stopped) {
+            close_all();
+        }
+        lister.join();
+        if (list_error) {
+            std::rethrow_exception(list_error);
+        }
+    }
+
+    // start_key not included in the result
+    std::vector<std::string> list_objects(std::string start_key = "", std::string prefix = "", std::string delimiter = "/") const {
+        std::vector<std::string> keys;
+        list_objects_pages([&](std::vector<std::string> &page) {
+            keys.insert(keys.end(), std::make_move_iterator(page.begin()), std::make_move_iterator(page.end()));
+            return true;
+        }, std::move(start_key), std::move(prefix), std::move(delimiter));
+        return keys;
+    }
+
+  protected:
+    class BufferedMultipartUpload : public MultipartUpload {
+      public:
+        BufferedMultipartUpload(const ObjectStore &store, std::string key) : store_(store), key_(std::move(key)) {}
+
+        void upload_part(unsigned int part_number, const std::string_view &part) override {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (parts_.size() < part_number) {
+                parts_.resize(part_number);
+            }
+            parts_[part_number - 1] = part;
+        }
+
+        void complete() override {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::string object;
+            for (const auto &part : parts_) {
+                object += part;
+            }
+            store_.put_object_single(key_, object);
+        }
+
+      private:
+        const ObjectStore &store_;
+        const std::string key_;
+        std::mutex mutex_;
+        std::vector<std::string> parts_;
+    };
+
+    // 单次列举返回的最大key数, 也是batch_delete_objects的上限
+    static constexpr int LIST_MAX_KEYS = 1000;
+
+    // list_objects_parallel中每个队列缓存的页数
+    static constexpr std::size_t LIST_PIPELINE_DEPTH = 4;
+
+    // 由concurrency个线程(包括当前线程)领取并执行task(0), ..., task(task_count - 1);
+    // 任一task抛出异常后不再领取新的task, 所有线程结束后重新抛出第一个异常
+    template <typename Task>
+    static void parallel_for(std::size_t task_count, std::size_t concurrency, Task &&task) {
+        concurrency = std::max<std::size_t>(1, std::min(concurrency, task_count));
+
+        std::atomic<std::size_t> next_task = 0;
+        std::atomic<bool> failed = false;
+        std::exception_ptr first_error;
+        std::mutex error_mutex;
+
+        auto worker = [&]() {
+            while (!failed) {
+                std::size_t task_idx = next_task.fetch_add(1);
+                if (task_idx >= task_count) {
+                    break;
+                }
+                try {
+                    task(task_idx);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    if (!first_error) {
+                        first_error = std::current_exception();
+                    }
+                    failed = true;
+                }
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(concurrency - 1);
+        for (std::size_t i = 1; i < concurrency; ++i) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto &t : threads) {
+            t.join();
+        }
+        if (first_error) {
+            std::rethrow_exception(first_error);
+        }
+    }
+
+    // 当前SDK的对象接口不接受obs_request_context, 无法在同一个context上复用连接批量驱动请求,
+    // 因此异步接口由固定大小的线程池执行同步请求, 在途请求数上限为CONFIG::ASYNC_THREADS
+    static ThreadPool &async_pool() {
+        static ThreadPool pool(CONFIG::ASYNC_THREADS);
+        return pool;
+    }
+
+    template <typename F>
+    static auto submit_async(F &&f, AsyncCallback on_complete) -> std::future<std::invoke_result_t<F>> {
+        return async_pool().submit([f = std::forward<F>(f), on_complete = std::move(on_complete)]() mutable {
+            // 回调自身抛出的异常不再重复通知
+            bool completed = false;
+            try {
+                if constexpr (std::is_void_v<std::invoke_result_t<F>>) {
+                    f();
+                    completed = true;
+                    if (on_complete) {
+                        on_complete(nullptr);
+                    }
+                } else {
+                    auto result = f();
+                    completed = true;
+                    if (on_complete) {
+                        on_complete(nullptr);
+                    }
+                    return result;
+                }
+            } catch (...) {
+                if (!completed && on_complete) {
+                    on_complete(std::current_exception());
+                }
+                throw;
+            }
+        });
+    }
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "config.h"
+#include "fs_object_store.h"
+#include "huawei_obs.h"
+#include "log.h"
+#include "memory_object_store.h"
+#include "object_store.h"
+
+// 按CONFIG::OBJECT_STORE选择后端, 需要在init_all_config()之后调用; 后端实例在进程内唯一
+inline ObjectStore *get_object_store() {
+    static ObjectStore *store = []() -> ObjectStore * {
+        if (CONFIG::OBJECT_STORE == "obs") {
+            return HuaweiCloudObs::get_instance();
+        }
+        if (CONFIG::OBJECT_STORE == "memory") {
+            static MemoryObjectStore memory_store;
+            return &memory_store;
+        }
+        if (CONFIG::OBJECT_STORE == "fs") {
+            static FsObjectStore fs_store{std::string(CONFIG::FS_STORE_ROOT)};
+            return &fs_store;
+        }
+        LOG_FATAL("unknown object store: {}", CONFIG::OBJECT_STORE);
+        return nullptr;
+    }();
+    return store;
+}
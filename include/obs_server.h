@@ -0,0 +1,798 @@
+#pragma once
+
+#include "config.h"
+#include "log.h"
+#include "memory_object_store.h"
+#include "object_store.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * @brief 请求附加延迟的分布, 由CONFIG::SERVER_LATENCY描述, 单位us
+ * none, fixed:<us>, uniform:<min>:<max>, exp:<mean>, lognormal:<median>:<sigma>, pareto:<min>:<alpha>;
+ * exp的mean, lognormal的median和pareto的min, alpha必须大于0, 否则抛出std::invalid_argument
+ */
+class LatencyModel {
+  public:
+    static LatencyModel parse(std::string_view spec) {
+        std::vector<std::string> fields;
+        std::size_t begin = 0;
+        while (begin <= spec.size()) {
+            std::size_t end = std::min(spec.find(':', begin), spec.size());
+            fields.emplace_back(spec.substr(begin, end - begin));
+            begin = end + 1;
+        }
+        auto arg = [&](std::size_t i) {
+            LOG_ASSERT(i < fields.size(), "invalid latency spec: {}", spec);
+            return std::stod(fields[i]);
+        };
+        // 作为除数或取对数的参数
+        auto positive_arg = [&](std::size_t i) {
+            double value = arg(i);
+            if (!(value > 0)) {
+                throw std::invalid_argument(fmt::format("invalid latency spec: {}, argument {} must be positive", spec, i));
+            }
+            return value;
+        };
+
+        LatencyModel model;
+        const std::string &kind = fields[0];
+        if (kind == "none") {
+            model.kind_ = Kind::NONE;
+        } else if (kind == "fixed") {
+            model = LatencyModel(Kind::FIXED, arg(1));
+        } else if (kind == "uniform") {
+            model = LatencyModel(Kind::UNIFORM, arg(1), arg(2));
+        } else if (kind == "exp") {
+            model = LatencyModel(Kind::EXP, positive_arg(1));
+        } else if (kind == "lognormal") {
+            model = LatencyModel(Kind::LOGNORMAL, positive_arg(1), arg(2));
+        } else if (kind == "pareto") {
+            model = LatencyModel(Kind::PARETO, positive_arg(1), positive_arg(2));
+        } else {
+            LOG_FATAL("invalid latency spec: {}", spec);
+        }
+        return model;
+    }
+
+    bool enabled() const { return kind_ != Kind::NONE; }
+
+    std::chrono::microseconds sample(std::mt19937_64 &rng) const {
+        double us = 0;
+        switch (kind_) {
+            case Kind::NONE:
+                break;
+            case Kind::FIXED:
+                us = a_;
+                break;
+            case Kind::UNIFORM:
+                us = std::uniform_real_distribution<double>(a_, b_)(rng);
+                break;
+            case Kind::EXP:
+                us = std::exponential_distribution<double>(1 / a_)(rng);
+                break;
+            case Kind::LOGNORMAL:
+                us = std::lognormal_distribution<double>(std::log(a_), b_)(rng);
+                break;
+            case Kind::PARETO:
+                // 逆变换采样, 最小值为a_, 尾部指数为b_
+                us = a_ / std::pow(1 - std::uniform_real_distribution<double>(0, 1)(rng), 1 / b_);
+                break;
+        }
+        return std::chrono::microseconds(static_cast<int64_t>(us));
+    }
+
+  private:
+    enum class Kind { NONE, FIXED, UNIFORM, EXP, LOGNORMAL, PARETO };
+
+    LatencyModel() = default;
+    LatencyModel(Kind kind, double a, double b = 0) : kind_(kind), a_(a), b_(b) {}
+
+    Kind kind_ = Kind::NONE;
+    double a_ = 0;
+    double b_ = 0;
+};
+
+/**
+ * @brief 所有连接共享的带宽上限, 每次收发前按字节数预约时间片, 超出上限时睡眠到预约的时刻
+ */
+class BandwidthLimiter {
+  public:
+    explicit BandwidthLimiter(std::size_t bytes_per_second) : bytes_per_second_(bytes_per_second) {}
+
+    void acquire(std::size_t bytes) {
+        if (bytes_per_second_ == 0) {
+            return;
+        }
+        auto cost = std::chrono::nanoseconds(static_cast<int64_t>(1e9 * bytes / bytes_per_second_));
+        std::chrono::steady_clock::time_point done;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            next_ = std::max(next_, std::chrono::steady_clock::now()) + cost;
+            done = next_;
+        }
+        std::this_thread::sleep_until(done);
+    }
+
+  private:
+    const std::size_t bytes_per_second_;
+    std::mutex mutex_;
+    std::chrono::steady_clock::time_point next_ = {};
+};
+
+/**
+ * @brief 本地的OBS替身: 实现HuaweiCloudObs用到的REST接口子集, 数据保存在MemoryObjectStore中
+ * PUT, 追加写(?append&position=), 带Range的GET, HEAD, DELETE, 批量删除(?delete), 列举, 存量信息(?storageinfo)和分段上传;
+ * 只支持path风格(客户端设置CONFIG_PROTOCOL=http CONFIG_URI_STYLE=path)和Content-Length定长的请求体, 不校验签名;
+ * 每个连接一个线程, 支持keep-alive; 可注入延迟, 带宽上限和503/SlowDown错误
+ */
+class ObsServer {
+  public:
+    struct Options {
+        // host:port, port为0时由系统分配
+        std::string address = "127.0.0.1:0";
+        std::string latency = "none";
+        std::size_t bandwidth = 0;
+        double error_rate = 0;
+        std::string error_code = "SlowDown";
+
+        static Options from_config() {
+            return {
+                .address = std::string(CONFIG::ENDPOINT),
+                .latency = std::string(CONFIG::SERVER_LATENCY),
+                .bandwidth = CONFIG::SERVER_BANDWIDTH,
+                .error_rate = CONFIG::SERVER_ERROR_RATE,
+                .error_code = std::string(CONFIG::SERVER_ERROR_CODE),
+            };
+        }
+    };
+
+    explicit ObsServer(Options options)
+        : options_(std::move(options)), latency_(LatencyModel::parse(options_.latency)), limiter_(options_.bandwidth) {}
+
+    ~ObsServer() { stop(); }
+
+    ObsServer(const ObsServer &) = delete;
+    ObsServer &operator=(const ObsServer &) = delete;
+
+    // 开始监听并返回实际的端口
+    uint16_t start() {
+        std::size_t colon = options_.address.rfind(':');
+        LOG_ASSERT(colon != std::string::npos, "invalid address: {}", options_.address);
+        std::string host = options_.address.substr(0, colon);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(std::stoi(options_.address.substr(colon + 1))));
+        LOG_ASSERT(::inet_pton(AF_INET, host.c_str(), &addr.sin_addr) == 1, "invalid host: {}", host);
+
+        listen_fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+        LOG_ASSERT(listen_fd_ >= 0, "socket failed: {}", strerror(errno));
+        int one = 1;
+        ::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        LOG_ASSERT(::bind(listen_fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0, "bind {} failed: {}", options_.address, strerror(errno));
+        LOG_ASSERT(::listen(listen_fd_, SOMAXCONN) == 0, "listen failed: {}", strerror(errno));
+        socklen_t len = sizeof(addr);
+        ::getsockname(listen_fd_, reinterpret_cast<sockaddr *>(&addr), &len);
+        port_ = ntohs(addr.sin_port);
+
+        acceptor_ = std::thread([this]() { accept_loop(); });
+        return port_;
+    }
+
+    // 关闭监听和所有连接, 等待连接线程退出
+    void stop() {
+        if (stopped_.exchange(true) || listen_fd_ < 0) {
+            return;
+        }
+        ::shutdown(listen_fd_, SHUT_RDWR);
+        ::close(listen_fd_);
+        acceptor_.join();
+        std::list<Connection> connections;
+        {
+            std::lock_guard<std::mutex> lock(connections_mutex_);
+            for (auto &connection : connections_) {
+                if (!connection.finished) {
+                    ::shutdown(connection.fd, SHUT_RDWR);
+                }
+            }
+            connections.swap(connections_);
+        }
+        for (auto &connection : connections) {
+            connection.thread.join();
+        }
+    }
+
+    uint16_t port() const { return port_; }
+
+    const MemoryObjectStore &store() const { return store_; }
+
+  private:
+    struct Request {
+        std::string method;
+        std::string bucket;
+        std::string key;
+        std::map<std::string, std::string> query;
+        std::map<std::string, std::string> headers;
+        std::string body;
+
+        bool has_query(const std::string &name) const { return query.count(name) > 0; }
+
+        std::string header(const std::string &name) const {
+            auto it = headers.find(name);
+            return it == headers.end() ? "" : it->second;
+        }
+    };
+
+    struct Response {
+        int status = 200;
+        std::vector<std::pair<std::string, std::string>> headers;
+        std::string body;
+        // GET的数据直接引用对象快照, 不拷贝
+        std::shared_ptr<const std::string> object;
+        std::string_view object_range;
+        // HEAD只返回对象大小, 没有响应体
+        std::optional<std::size_t> head_length;
+    };
+
+    // 连接线程退出前关闭fd并置finished, 由accept_loop或stop回收
+    struct Connection {
+        int fd;
+        std::thread thread;
+        bool finished = false;
+    };
+
+    static constexpr std::size_t IO_CHUNK_SIZE = 256 << 10;
+
+    // 每接受一个连接时回收已经退出的连接线程, 长时间运行时线程数不随累计的连接数增长
+    void accept_loop() {
+        while (true) {
+            int fd = ::accept(listen_fd_, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                return;
+            }
+            int one = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            std::list<Connection> finished;
+            {
+                std::lock_guard<std::mutex> lock(connections_mutex_);
+                if (stopped_) {
+                    ::close(fd);
+                    return;
+                }
+                for (auto it = connections_.begin(); it != connections_.end();) {
+                    auto next = std::next(it);
+                    if (it->finished) {
+                        finished.splice(finished.end(), connections_, it);
+                    }
+                    it = next;
+                }
+                auto &connection = connections_.emplace_back(Connection{.fd = fd});
+                connection.thread = std::thread([this, &connection]() {
+                    serve(connection.fd);
+                    std::lock_guard<std::mutex> lock(connections_mutex_);
+                    ::close(connection.fd);
+                    connection.finished = true;
+                });
+            }
+            for (auto &connection : finished) {
+                connection.thread.join();
+            }
+        }
+    }
+
+    void serve(int fd) {
+        thread_local std::mt19937_64 rng(std::random_device{}());
+        std::string buffer;
+        while (true) {
+            Request request;
+            if (!read_request(fd, buffer, request)) {
+                return;
+            }
+            Response response;
+            if (options_.error_rate > 0 && std::uniform_real_distribution<double>(0, 1)(rng) < options_.error_rate) {
+                bool unavailable = options_.error_code == "SlowDown" || options_.error_code == "ServiceUnavailable";
+                response = error_response(unavailable ? 503 : 500, options_.error_code, "injected error");
+            } else {
+                try {
+                    response = handle(request);
+                } catch (const ObjectStore::Error &e) {
+                    response = error_response(e.status, e.what());
+                } catch (const std::exception &e) {
+                    response = error_response(400, "InvalidArgument", e.what());
+                }
+            }
+            if (latency_.enabled()) {
+                std::this_thread::sleep_for(latency_.sample(rng));
+            }
+            if (!write_response(fd, request, response) || request.header("connection") == "close") {
+                return;
+            }
+        }
+    }
+
+    Response handle(Request &request) {
+        const std::string &method = request.method;
+        if (request.key.empty()) {
+            if (method == "GET" && request.has_query("storageinfo")) {
+                return xml_response(fmt::format(
+                    "<GetBucketStorageInfoResult><Size>0</Size><ObjectNumber>{}</ObjectNumber></GetBucketStorageInfoResult>",
+                    store_.get_approximate_object_count()));
+            }
+            if (method == "GET") {
+                return list_objects(request);
+            }
+            if (method == "POST" && request.has_query("delete")) {
+                return batch_delete(request);
+            }
+            if (method == "HEAD") {
+                return {};
+            }
+        } else if (method == "PUT") {
+            if (request.has_query("uploadId")) {
+                return upload_part(request);
+            }
+            std::size_t size = request.body.size();
+            store_.put_owned(request.key, std::move(request.body));
+            return etag_response(size);
+        } else if (method == "POST") {
+            if (request.has_query("append")) {
+                std::size_t next = store_.append_object(request.key, request.body, std::stoull(request.query.at("position")));
+                Response response = etag_response(next);
+                response.headers.emplace_back("x-obs-next-append-position", std::to_string(next));
+                response.headers.emplace_back("x-amz-next-append-position", std::to_string(next));
+                return response;
+            }
+            if (request.has_query("uploads")) {
+                return initiate_multipart_upload(request);
+            }
+            if (request.has_query("uploadId")) {
+                return complete_multipart_upload(request);
+            }
+        } else if (method == "GET" || method == "HEAD") {
+            return get_object(request);
+        } else if (method == "DELETE") {
+            if (request.has_query("uploadId")) {
+                std::lock_guard<std::mutex> lock(uploads_mutex_);
+                uploads_.erase(request.query.at("uploadId"));
+            } else {
+                store_.delete_object(request.key);
+            }
+            Response response;
+            response.status = 204;
+            return response;
+        }
+        return error_response(405, "MethodNotAllowed", fmt::format("{} {}", method, request.key));
+    }
+
+    Response get_object(const Request &request) {
+        Response response;
+        response.object = store_.get_shared(request.key);
+        const std::string &object = *response.object;
+        if (request.method == "HEAD") {
+            response.head_length = object.size();
+            return response;
+        }
+        std::size_t begin = 0;
+        std::size_t end = object.size();
+        std::string range = request.header("range");
+        if (!range.empty()) {
+            // 只支持单个范围: bytes=first-[last]
+            std::size_t eq = range.find('=');
+            std::size_t dash = range.find('-', eq);
+            begin = std::stoull(range.substr(eq + 1, dash - eq - 1));
+            if (dash + 1 < range.size()) {
+                end = std::min<std::size_t>(end, std::stoull(range.substr(dash + 1)) + 1);
+            }
+            if (begin >= object.size()) {
+                return error_response(416, "InvalidRange", range);
+            }
+            response.status = 206;
+            response.headers.emplace_back("Content-Range", fmt::format("bytes {}-{}/{}", begin, end - 1, object.size()));
+        }
+        response.object_range = std::string_view(object).substr(begin, end - begin);
+        return response;
+    }
+
+    Response list_objects(const Request &request) {
+        auto param = [&](const std::string &name) {
+            auto it = request.query.find(name);
+            return it == request.query.end() ? std::string() : it->second;
+        };
+        std::string prefix = param("prefix");
+        std::string marker = param("marker");
+        std::string delimiter = param("delimiter");
+        std::size_t max_keys = request.has_query("max-keys") ? std::stoull(param("max-keys")) : 1000;
+
+        bool is_truncated = false;
+        std::vector<std::string> keys = store_.list_page(marker, prefix, delimiter, max_keys, is_truncated);
+        std::string body = fmt::format(
+            "<ListBucketResult><Name>{}</Name><Prefix>{}</Prefix><Marker>{}</Marker><MaxKeys>{}</MaxKeys><IsTruncated>{}</IsTruncated>",
+            xml_escape(request.bucket), xml_escape(prefix), xml_escape(marker), max_keys, is_truncated ? "true" : "false");
+        if (is_truncated && !keys.empty()) {
+            body += fmt::format("<NextMarker>{}</NextMarker>", xml_escape(keys.back()));
+        }
+        for (const auto &key : keys) {
+            body += fmt::format(
+                "<Contents><Key>{}</Key><LastModified>2024-01-01T00:00:00.000Z</LastModified><ETag>\"0\"</ETag><Size>0</Size>"
+                "<StorageClass>STANDARD</StorageClass></Contents>",
+                xml_escape(key));
+        }
+        body += "</ListBucketResult>";
+        return xml_response(std::move(body));
+    }
+
+    // 只返回删除失败的key(Quiet模式), MemoryObjectStore的删除不会失败
+    Response batch_delete(const Request &request) {
+        std::vector<std::string> keys = xml_values(request.body, "Key");
+        std::vector<ObjectStore::DeleteFailure> failures;
+        store_.batch_delete_objects(keys.data(), keys.size(), failures);
+        bool quiet = request.body.find("<Quiet>true</Quiet>") != std::string::npos;
+        std::string body = "<DeleteResult>";
+        if (!quiet) {
+            for (const auto &key : keys) {
+                body += fmt::format("<Deleted><Key>{}</Key></Deleted>", xml_escape(key));
+            }
+        }
+        body += "</DeleteResult>";
+        return xml_response(std::move(body));
+    }
+
+    Response initiate_multipart_upload(const Request &request) {
+        std::string upload_id = fmt::format("{:016x}", next_upload_id_.fetch_add(1));
+        {
+            std::lock_guard<std::mutex> lock(uploads_mutex_);
+            uploads_[upload_id].key = request.key;
+        }
+        return xml_response(fmt::format(
+            "<InitiateMultipartUploadResult><Bucket>{}</Bucket><Key>{}</Key><UploadId>{}</UploadId></InitiateMultipartUploadResult>",
+            xml_escape(request.bucket), xml_escape(request.key), upload_id));
+    }
+
+    Response upload_part(Request &request) {
+        int part_number = std::stoi(request.query.at("partNumber"));
+        std::size_t size = request.body.size();
+        std::lock_guard<std::mutex> lock(uploads_mutex_);
+        auto it = uploads_.find(request.query.at("uploadId"));
+        if (it == uploads_.end()) {
+            return error_response(404, "NoSuchUpload", request.query.at("uploadId"));
+        }
+        it->second.parts[part_number] = std::move(request.body);
+        return etag_response(size);
+    }
+
+    // 按请求中PartNumber的顺序合并
+    Response complete_multipart_upload(const Request &request) {
+        Upload upload;
+        {
+            std::lock_guard<std::mutex> lock(uploads_mutex_);
+            auto it = uploads_.find(request.query.at("uploadId"));
+            if (it == uploads_.end()) {
+                return error_response(404, "NoSuchUpload", request.query.at("uploadId"));
+            }
+            upload = std::move(it->second);
+            uploads_.erase(it);
+        }
+        std::string object;
+        for (const auto &number : xml_values(request.body, "PartNumber")) {
+            auto part = upload.parts.find(std::stoi(number));
+            if (part == upload.parts.end()) {
+                return error_response(400, "InvalidPart", number);
+            }
+            object += part->second;
+        }
+        std::size_t size = object.size();
+        store_.put_owned(request.key, std::move(object));
+        return xml_response(fmt::format(
+            "<CompleteMultipartUploadResult><Location>/{0}/{1}</Location><Bucket>{0}</Bucket><Key>{1}</Key><ETag>\"{2:x}\"</ETag></CompleteMultipartUploadResult>",
+            xml_escape(request.bucket), xml_escape(request.key), size));
+    }
+
+    // ---- HTTP ----
+
+    bool read_request(int fd, std::string &buffer, Request &request) {
+        std::size_t header_end;
+        while ((header_end = buffer.find("\r\n\r\n")) == std::string::npos) {
+            if (!recv_some(fd, buffer)) {
+                return false;
+            }
+        }
+        std::string_view head(buffer.data(), header_end);
+        std::size_t line_end = head.find("\r\n");
+        std::string_view request_line = head.substr(0, line_end);
+        std::size_t sp1 = request_line.find(' ');
+        std::size_t sp2 = request_line.find(' ', sp1 + 1);
+        request.method = std::string(request_line.substr(0, sp1));
+        parse_target(request_line.substr(sp1 + 1, sp2 - sp1 - 1), request);
+
+        while (line_end != std::string_view::npos && line_end < head.size()) {
+            std::size_t next = head.find("\r\n", line_end + 2);
+            std::string_view line = head.substr(line_end + 2, (next == std::string_view::npos ? head.size() : next) - line_end - 2);
+            std::size_t colon = line.find(':');
+            if (colon != std::string_view::npos) {
+                std::string name(line.substr(0, colon));
+                std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+                std::string_view value = line.substr(colon + 1);
+                while (!value.empty() && value.front() == ' ') {
+                    value.remove_prefix(1);
+                }
+                request.headers[name] = std::string(value);
+            }
+            line_end = next;
+        }
+        buffer.erase(0, header_end + 4);
+
+        std::size_t content_length = request.headers.count("content-length") ? std::stoull(request.headers["content-length"]) : 0;
+        if (content_length > 0 && request.header("expect") == "100-continue") {
+            if (!send_all(fd, "HTTP/1.1 100 Continue\r\n\r\n")) {
+                return false;
+            }
+        }
+        request.body.reserve(content_length);
+        std::size_t from_buffer = std::min(content_length, buffer.size());
+        request.body.append(buffer, 0, from_buffer);
+        buffer.erase(0, from_buffer);
+        limiter_.acquire(from_buffer);
+        while (request.body.size() < content_length) {
+            std::size_t old_size = request.body.size();
+            std::size_t want = std::min(IO_CHUNK_SIZE, content_length - old_size);
+            limiter_.acquire(want);
+            request.body.resize(old_size + want);
+            ssize_t n = ::recv(fd, request.body.data() + old_size, want, 0);
+            if (n <= 0) {
+                return false;
+            }
+            request.body.resize(old_size + n);
+        }
+        return true;
+    }
+
+    // path风格: /bucket/key?query
+    static void parse_target(std::string_view target, Request &request) {
+        std::size_t question = target.find('?');
+        std::string_view path = target.substr(0, question);
+        if (!path.empty() && path.front() == '/') {
+            path.remove_prefix(1);
+        }
+        std::size_t slash = path.find('/');
+        request.bucket = url_decode(path.substr(0, slash));
+        request.key = slash == std::string_view::npos ? "" : url_decode(path.substr(slash + 1));
+        if (question == std::string_view::npos) {
+            return;
+        }
+        std::string_view query = target.substr(question + 1);
+        while (!query.empty()) {
+            std::size_t amp = std::min(query.find('&'), query.size());
+            std::string_view item = query.substr(0, amp);
+            std::size_t eq = item.find('=');
+            request.query[url_decode(item.substr(0, eq))] = eq == std::string_view::npos ? "" : url_decode(item.substr(eq + 1));
+            query.remove_prefix(std::min(amp + 1, query.size()));
+        }
+    }
+
+    bool write_response(int fd, const Request &request, const Response &response) {
+        std::size_t content_length = response.head_length ? *response.head_length
+                                     : response.object ? response.object_range.size()
+                                                        : response.body.size();
+        std::string head = fmt::format("HTTP/1.1 {} {}\r\nContent-Length: {}\r\nx-amz-request-id: {:016x}\r\nx-obs-request-id: {:016x}\r\n",
+                                       response.status, reason(response.status), content_length, request_seq_, request_seq_);
+        ++request_seq_;
+        for (const auto &[name, value] : response.headers) {
+            head += fmt::format("{}: {}\r\n", name, value);
+        }
+        head += "\r\n";
+        if (!send_all(fd, head)) {
+            return false;
+        }
+        if (response.head_length) {
+            return true;
+        }
+        return send_paced(fd, response.object ? response.object_range : std::string_view(response.body));
+    }
+
+    bool recv_some(int fd, std::string &buffer) {
+        char chunk[16 << 10];
+        ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) {
+            return false;
+        }
+        buffer.append(chunk, n);
+        return true;
+    }
+
+    bool send_paced(int fd, std::string_view data) {
+        while (!data.empty()) {
+            std::string_view chunk = data.substr(0, IO_CHUNK_SIZE);
+            limiter_.acquire(chunk.size());
+            if (!send_all(fd, chunk)) {
+                return false;
+            }
+            data.remove_prefix(chunk.size());
+        }
+        return true;
+    }
+
+    static bool send_all(int fd, std::string_view data) {
+        while (!data.empty()) {
+            ssize_t n = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            data.remove_prefix(n);
+        }
+        return true;
+    }
+
+    static Response xml_response(std::string body) {
+        Response response;
+        response.headers.emplace_back("Content-Type", "application/xml");
+        response.body = std::move(body);
+        return response;
+    }
+
+    static Response etag_response(std::size_t tag) {
+        Response response;
+        response.headers.emplace_back("ETag", fmt::format("\"{:x}\"", tag));
+        return response;
+    }
+
+    static Response error_response(int status, const std::string &code, const std::string &message) {
+        Response response = xml_response(fmt::format("<Error><Code>{}</Code><Message>{}</Message><RequestId>0</RequestId></Error>", code, xml_escape(message)));
+        response.status = status;
+        return response;
+    }
+
+    // 把MemoryObjectStore的错误转换为OBS返回的HTTP状态码和错误码
+    static Response error_response(obs_status status, const std::string &message) {
+        switch (status) {
+            case OBS_STATUS_NoSuchKey:
+                return error_response(404, "NoSuchKey", message);
+            case OBS_STATUS_InvalidRange:
+                return error_response(416, "InvalidRange", message);
+            case OBS_STATUS_HttpErrorConflict:
+                return error_response(409, "PositionNotEqualToLength", message);
+            default:
+                return error_response(500, "InternalError", message);
+        }
+    }
+
+    static const char *reason(int status) {
+        switch (status) {
+            case 200: return "OK";
+            case 204: return "No Content";
+            case 206: return "Partial Content";
+            case 400: return "Bad Request";
+            case 404: return "Not Found";
+            case 405: return "Method Not Allowed";
+            case 409: return "Conflict";
+            case 416: return "Requested Range Not Satisfiable";
+            case 503: return "Service Unavailable";
+            default: return "Internal Server Error";
+        }
+    }
+
+    static std::string url_decode(std::string_view s) {
+        std::string out;
+        out.reserve(s.size());
+        for (std::size_t i = 0; i < s.size(); ++i) {
+            if (s[i] == '%' && i + 2 < s.size()) {
+                out.push_back(static_cast<char>(std::stoi(std::string(s.substr(i + 1, 2)), nullptr, 16)));
+                i += 2;
+            } else if (s[i] == '+') {
+                out.push_back(' ');
+            } else {
+                out.push_back(s[i]);
+            }
+        }
+        return out;
+    }
+
+    static std::string xml_escape(std::string_view s) {
+        std::string out;
+        out.reserve(s.size());
+        for (char c : s) {
+            switch (c) {
+                case '&': out += "&amp;"; break;
+                case '<': out += "&lt;"; break;
+                case '>': out += "&gt;"; break;
+                case '"': out += "&quot;"; break;
+                case '\'': out += "&apos;"; break;
+                default: out.push_back(c);
+            }
+        }
+        return out;
+    }
+
+    static std::string xml_unescape(std::string_view s) {
+        static const std::pair<std::string_view, char> ENTITIES[] = {
+            {"&amp;", '&'}, {"&lt;", '<'}, {"&gt;", '>'}, {"&quot;", '"'}, {"&apos;", '\''},
+        };
+        std::string out;
+        out.reserve(s.size());
+        for (std::size_t i = 0; i < s.size(); ++i) {
+            bool replaced = false;
+            if (s[i] == '&') {
+                for (const auto &[entity, c] : ENTITIES) {
+                    if (s.substr(i, entity.size()) == entity) {
+                        out.push_back(c);
+                        i += entity.size() - 1;
+                        replaced = true;
+                        break;
+                    }
+                }
+            }
+            if (!replaced) {
+                out.push_back(s[i]);
+            }
+        }
+        return out;
+    }
+
+    // 请求体中所有<tag>...</tag>的值, 请求体由SDK生成, 不需要完整的XML解析
+    static std::vector<std::string> xml_values(std::string_view xml, const std::string &tag) {
+        std::vector<std::string> values;
+        const std::string open = "<" + tag + ">";
+        const std::string close = "</" + tag + ">";
+        std::size_t pos = 0;
+        while ((pos = xml.find(open, pos)) != std::string_view::npos) {
+            pos += open.size();
+            std::size_t end = xml.find(close, pos);
+            if (end == std::string_view::npos) {
+                break;
+            }
+            values.push_back(xml_unescape(xml.substr(pos, end - pos)));
+            pos = end + close.size();
+        }
+        return values;
+    }
+
+    struct Upload {
+        std::string key;
+        std::map<int, std::string> parts;
+    };
+
+    const Options options_;
+    const LatencyModel latency_;
+    BandwidthLimiter limiter_;
+    MemoryObjectStore store_;
+
+    std::mutex uploads_mutex_;
+    std::map<std::string, Upload> uploads_;
+    std::atomic<uint64_t> next_upload_id_ = 1;
+
+    int listen_fd_ = -1;
+    uint16_t port_ = 0;
+    std::atomic<bool> stopped_ = false;
+    std::thread acceptor_;
+    std::mutex connections_mutex_;
+    std::list<Connection> connections_;
+
+    static inline thread_local uint64_t request_seq_ = 0;
+};
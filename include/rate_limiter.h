@@ -0,0 +1,179 @@
+#pragma once
+
+#include "config.h"
+#include "object_store.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <thread>
+
+/**
+ * @brief 无锁令牌桶, 按GCRA(理论到达时间)实现: 只有一个原子变量tat, 取走n个令牌即把tat向后推n个令牌的时间,
+ * tat超出当前时间burst个令牌以上的部分即为需要等待的时间. 令牌不足时预支而不是失败, 等待由调用方完成,
+ * 多个线程同时取令牌时各自得到排好队的等待时间, 不会在令牌恢复的同一时刻一起发出
+ */
+class TokenBucket {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    TokenBucket() = default;
+
+    TokenBucket(const TokenBucket &) = delete;
+    TokenBucket &operator=(const TokenBucket &) = delete;
+
+    // rate为每秒的令牌数, 0表示不限; 空闲之后最多可以连续取走burst个令牌. 只能在使用前调用
+    void configure(double rate, double burst) {
+        ns_per_token_ = rate > 0 ? 1e9 / rate : 0;
+        burst_ns_ = static_cast<int64_t>(std::max(burst, 0.0) * ns_per_token_);
+        tat_.store(0, std::memory_order_relaxed);
+    }
+
+    bool unlimited() const { return ns_per_token_ == 0; }
+
+    // 取走n个令牌, 返回在now之后还需要等待的时间; n为0时不取令牌, 但仍要等到之前预支的令牌恢复
+    std::chrono::nanoseconds reserve(double n, Clock::time_point now) {
+        if (unlimited()) {
+            return std::chrono::nanoseconds(0);
+        }
+        int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+        int64_t cost = static_cast<int64_t>(std::max(n, 0.0) * ns_per_token_);
+        int64_t tat = tat_.load(std::memory_order_relaxed);
+        int64_t next = tat;
+        if (cost > 0) {
+            do {
+                next = std::max(tat, now_ns) + cost;
+            } while (!tat_.compare_exchange_weak(tat, next, std::memory_order_relaxed));
+        }
+        return std::chrono::nanoseconds(std::max<int64_t>(0, next - burst_ns_ - now_ns));
+    }
+
+    // 退还n个令牌
+    void refund(double n) {
+        if (!unlimited() && n > 0) {
+            tat_.fetch_sub(static_cast<int64_t>(n * ns_per_token_), std::memory_order_relaxed);
+        }
+    }
+
+  private:
+    double ns_per_token_ = 0;
+    int64_t burst_ns_ = 0;
+    // 理论到达时间(steady_clock的ns), 在此之前的令牌都已被取走
+    std::atomic<int64_t> tat_ = 0;
+};
+
+/**
+ * @brief HuaweiCloudObs发出每个请求(包括重试和对冲)前的客户端限流, 请求数和字节数分别限制:
+ * 整个桶(客户端只访问CONFIG::BUCKET_NAME一个桶)一组令牌桶, 另外每个key前缀(前prefix_length个字符)一组.
+ * 前缀的令牌桶是固定数量的槽位, 按前缀的哈希选择, 哈希冲突的前缀共享一个槽位(限流只会更严), 不需要加锁的map.
+ * 等待的次数和时间累计在stats()中, 与服务端延迟区分开
+ */
+class RateLimiter {
+  public:
+    using Clock = TokenBucket::Clock;
+
+    struct Options {
+        // 0表示不限
+        double ops_per_s = 0;
+        double bytes_per_s = 0;
+        // 0表示不按前缀限流
+        std::size_t prefix_length = 0;
+        double prefix_ops_per_s = 0;
+        double prefix_bytes_per_s = 0;
+        std::size_t prefix_slots = 1024;
+        // 空闲之后允许的突发, 以秒计的令牌数
+        double burst_seconds = 0.1;
+
+        static Options from_config() {
+            return Options{
+                .ops_per_s = CONFIG::RATE_LIMIT_OPS,
+                .bytes_per_s = CONFIG::RATE_LIMIT_MBPS * 1024 * 1024,
+                .prefix_length = CONFIG::RATE_LIMIT_PREFIX_LENGTH,
+                .prefix_ops_per_s = CONFIG::RATE_LIMIT_PREFIX_OPS,
+                .prefix_bytes_per_s = CONFIG::RATE_LIMIT_PREFIX_MBPS * 1024 * 1024,
+                .prefix_slots = std::max<std::size_t>(1, CONFIG::RATE_LIMIT_PREFIX_SLOTS),
+                .burst_seconds = CONFIG::RATE_LIMIT_BURST_SECONDS,
+            };
+        }
+    };
+
+    explicit RateLimiter(const Options &options = Options::from_config()) : options_(options) {
+        // 突发至少1个请求
+        ops_.configure(options_.ops_per_s, std::max(1.0, options_.ops_per_s * options_.burst_seconds));
+        bytes_.configure(options_.bytes_per_s, options_.bytes_per_s * options_.burst_seconds);
+        if (prefix_enabled()) {
+            prefix_ops_ = std::make_unique<TokenBucket[]>(options_.prefix_slots);
+            prefix_bytes_ = std::make_unique<TokenBucket[]>(options_.prefix_slots);
+            for (std::size_t i = 0; i < options_.prefix_slots; ++i) {
+                prefix_ops_[i].configure(options_.prefix_ops_per_s, std::max(1.0, options_.prefix_ops_per_s * options_.burst_seconds));
+                prefix_bytes_[i].configure(options_.prefix_bytes_per_s, options_.prefix_bytes_per_s * options_.burst_seconds);
+            }
+        }
+    }
+
+    RateLimiter(const RateLimiter &) = delete;
+    RateLimiter &operator=(const RateLimiter &) = delete;
+
+    bool unlimited() const { return ops_.unlimited() && bytes_.unlimited() && !prefix_enabled(); }
+
+    // 请求发出前调用: 取走1个请求和bytes字节的令牌, 不足时在这里等待
+    void acquire(std::string_view key, std::size_t bytes) {
+        if (unlimited()) {
+            return;
+        }
+        auto now = Clock::now();
+        auto wait = std::max(ops_.reserve(1, now), bytes_.reserve(bytes, now));
+        if (prefix_enabled()) {
+            std::size_t slot = prefix_slot(key);
+            wait = std::max({wait, prefix_ops_[slot].reserve(1, now), prefix_bytes_[slot].reserve(bytes, now)});
+        }
+        requests_.fetch_add(1, std::memory_order_relaxed);
+        if (wait.count() > 0) {
+            waits_.fetch_add(1, std::memory_order_relaxed);
+            wait_ns_.fetch_add(wait.count(), std::memory_order_relaxed);
+            std::this_thread::sleep_until(now + wait);
+        }
+    }
+
+    // 事先按上限(读到对象末尾的GET按buffer大小)取令牌, 实际传输较少时退还多取的字节数
+    void refund(std::string_view key, std::size_t bytes) {
+        if (unlimited() || bytes == 0) {
+            return;
+        }
+        bytes_.refund(bytes);
+        if (prefix_enabled()) {
+            prefix_bytes_[prefix_slot(key)].refund(bytes);
+        }
+    }
+
+    ObjectStore::RateLimitStats stats() const {
+        return {
+            .requests = requests_.load(std::memory_order_relaxed),
+            .waits = waits_.load(std::memory_order_relaxed),
+            .wait_seconds = wait_ns_.load(std::memory_order_relaxed) / 1e9,
+        };
+    }
+
+  private:
+    bool prefix_enabled() const {
+        return options_.prefix_length > 0 && (options_.prefix_ops_per_s > 0 || options_.prefix_bytes_per_s > 0);
+    }
+
+    std::size_t prefix_slot(std::string_view key) const {
+        return std::hash<std::string_view>{}(key.substr(0, options_.prefix_length)) % options_.prefix_slots;
+    }
+
+    const Options options_;
+    TokenBucket ops_;
+    TokenBucket bytes_;
+    std::unique_ptr<TokenBucket[]> prefix_ops_;
+    std::unique_ptr<TokenBucket[]> prefix_bytes_;
+
+    std::atomic<std::size_t> requests_ = 0;
+    std::atomic<std::size_t> waits_ = 0;
+    std::atomic<int64_t> wait_ns_ = 0;
+};
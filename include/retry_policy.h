@@ -0,0 +1,166 @@
+#pragma once
+
+#include "config.h"
+#include "object_store.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <eSDKOBS.h>
+#include <random>
+#include <thread>
+#include <type_traits>
+
+/**
+ * @brief 重试的退避方式: 第n次重试前等待[0, min(max_delay, base * 2^(n-1))]之间均匀分布的时间(full jitter),
+ * 同时失败的请求不会在同一时刻一起重试; 限流错误使用更大的throttle_base_delay
+ */
+struct RetryPolicy {
+    // 包括首次请求
+    std::size_t max_attempts = 3;
+    std::chrono::nanoseconds base_delay = std::chrono::milliseconds(20);
+    std::chrono::nanoseconds throttle_base_delay = std::chrono::milliseconds(200);
+    std::chrono::nanoseconds max_delay = std::chrono::seconds(2);
+
+    static RetryPolicy from_config() {
+        auto ms = [](double value) { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double, std::milli>(value)); };
+        return RetryPolicy{
+            .max_attempts = std::max<std::size_t>(1, CONFIG::RETRY_MAX_ATTEMPTS),
+            .base_delay = ms(CONFIG::RETRY_BASE_DELAY_MS),
+            .throttle_base_delay = ms(CONFIG::RETRY_THROTTLE_DELAY_MS),
+            .max_delay = ms(CONFIG::RETRY_MAX_DELAY_MS),
+        };
+    }
+
+    // retry从1开始
+    std::chrono::nanoseconds backoff(std::size_t retry, bool throttled) const {
+        thread_local std::mt19937_64 rng(std::random_device{}());
+        double base = static_cast<double>((throttled ? throttle_base_delay : base_delay).count());
+        double cap = std::min(static_cast<double>(max_delay.count()), std::ldexp(base, static_cast<int>(std::min<std::size_t>(retry, 63)) - 1));
+        return std::chrono::nanoseconds(static_cast<int64_t>(std::uniform_real_distribution<double>(0, cap)(rng)));
+    }
+};
+
+/**
+ * @brief 每个客户端共享的重试预算(令牌桶): 每次重试取走1个令牌, 每个成功的请求放回ratio个, 最多capacity个;
+ * 后端整体故障时令牌很快耗尽, 重试占请求的比例被限制在ratio左右, 不会把故障放大成重试风暴
+ */
+class RetryBudget {
+  public:
+    RetryBudget(double ratio, double capacity)
+        : deposit_(std::llround(ratio * SCALE)), capacity_(std::llround(capacity * SCALE)), tokens_(capacity_) {}
+
+    bool try_withdraw() {
+        int64_t tokens = tokens_.load(std::memory_order_relaxed);
+        do {
+            if (tokens < SCALE) {
+                return false;
+            }
+        } while (!tokens_.compare_exchange_weak(tokens, tokens - SCALE, std::memory_order_relaxed));
+        return true;
+    }
+
+    void deposit() {
+        int64_t tokens = tokens_.load(std::memory_order_relaxed);
+        // 令牌已满时(正常情况)只有一次读
+        while (tokens < capacity_ && !tokens_.compare_exchange_weak(tokens, std::min(capacity_, tokens + deposit_), std::memory_order_relaxed)) {
+        }
+    }
+
+    double tokens() const { return static_cast<double>(tokens_.load(std::memory_order_relaxed)) / SCALE; }
+
+  private:
+    // 以千分之一个令牌为单位, 用整数原子操作
+    static constexpr int64_t SCALE = 1000;
+
+    const int64_t deposit_;
+    const int64_t capacity_;
+    std::atomic<int64_t> tokens_;
+};
+
+/**
+ * @brief 按RetryPolicy和RetryBudget执行请求, 只重试网络错误、超时和服务端限流, 4xx等错误直接抛出;
+ * 重试次数和退避时间累计在stats()中, 供压测结果区分请求本身的延迟和重试的影响
+ */
+class Retrier {
+  public:
+    Retrier(const RetryPolicy &policy, double budget_ratio, double budget_capacity) : policy_(policy), budget_(budget_ratio, budget_capacity) {}
+
+    static Retrier from_config() {
+        return Retrier(RetryPolicy::from_config(), CONFIG::RETRY_BUDGET_RATIO, CONFIG::RETRY_BUDGET_CAPACITY);
+    }
+
+    // 执行attempt(), 抛出可重试的ObjectStore::Error时退避后重新执行; attempt每次都要从头构造请求
+    template <typename F>
+    std::invoke_result_t<F &> run(F &&attempt) const {
+        for (std::size_t attempt_idx = 1;; ++attempt_idx) {
+            attempts_.fetch_add(1, std::memory_order_relaxed);
+            try {
+                if constexpr (std::is_void_v<std::invoke_result_t<F &>>) {
+                    attempt();
+                    budget_.deposit();
+                    return;
+                } else {
+                    auto result = attempt();
+                    budget_.deposit();
+                    return result;
+                }
+            } catch (const ObjectStore::Error &e) {
+                if (!is_retryable(e.status)) {
+                    throw;
+                }
+                if (attempt_idx >= policy_.max_attempts) {
+                    gave_up_.fetch_add(1, std::memory_order_relaxed);
+                    throw;
+                }
+                if (!budget_.try_withdraw()) {
+                    budget_exhausted_.fetch_add(1, std::memory_order_relaxed);
+                    throw;
+                }
+                auto delay = policy_.backoff(attempt_idx, is_throttled(e.status));
+                retries_.fetch_add(1, std::memory_order_relaxed);
+                backoff_ns_.fetch_add(delay.count(), std::memory_order_relaxed);
+                LOG_DEBUG("retry {} after {}us: {}", attempt_idx, delay.count() / 1000, obs_get_status_name(e.status));
+                std::this_thread::sleep_for(delay);
+            }
+        }
+    }
+
+    ObjectStore::RetryStats stats() const {
+        return {
+            .attempts = attempts_.load(std::memory_order_relaxed),
+            .retries = retries_.load(std::memory_order_relaxed),
+            .gave_up = gave_up_.load(std::memory_order_relaxed),
+            .budget_exhausted = budget_exhausted_.load(std::memory_order_relaxed),
+            .backoff_seconds = backoff_ns_.load(std::memory_order_relaxed) / 1e9,
+        };
+    }
+
+    const RetryPolicy &policy() const { return policy_; }
+
+    const RetryBudget &budget() const { return budget_; }
+
+    // SDK认为可重试的网络/超时错误, 以及服务端限流; AbortedByCallback是回调主动中止(例如buffer不足), 重试的结果相同
+    static bool is_retryable(obs_status status) {
+        if (status == OBS_STATUS_AbortedByCallback) {
+            return false;
+        }
+        return is_throttled(status) || obs_status_is_retryable(status);
+    }
+
+    static bool is_throttled(obs_status status) {
+        return status == OBS_STATUS_SlowDown || status == OBS_STATUS_ServiceUnavailable;
+    }
+
+  private:
+    const RetryPolicy policy_;
+    mutable RetryBudget budget_;
+
+    mutable std::atomic<std::size_t> attempts_ = 0;
+    mutable std::atomic<std::size_t> retries_ = 0;
+    mutable std::atomic<std::size_t> gave_up_ = 0;
+    mutable std::atomic<std::size_t> budget_exhausted_ = 0;
+    mutable std::atomic<int64_t> backoff_ns_ = 0;
+};
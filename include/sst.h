@@ -0,0 +1,531 @@
+#pragma once
+
+#include "bloom_filter.h"
+#include "config.h"
+#include "memtable.h"
+#include "object_store.h"
+#include "wal.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief SST对象的格式, 按GET的次数设计: 打开时一次读回对象尾部的过滤器块、索引块和footer,
+ * 之后每次点查最多一次get_range读取一个数据块
+ *
+ * [数据块 0] ... [数据块 n-1] [过滤器块] [索引块] [footer]
+ *
+ * 数据块: 按<key升序, seq降序>连续存放的记录 [key_size: u32][value_size: u32][seq << 8 | type: u64][key][value]
+ * 过滤器块: [type: u8][过滤器数据], type为NONE时没有过滤器, BLOCKED_BLOOM时为BloomFilter的序列化格式
+ * 索引块: [count: u32], 每个数据块一项 [key_size: u32][块内最后一个key][offset: u64][size: u64]
+ * 每个块之后是块内容的CRC-32C(u32), 块的size包括它; footer为固定的FOOTER_SIZE字节, 全部为小端序
+ */
+struct SstFormat {
+    static constexpr uint64_t MAGIC = 0x7473732d73626f31ull;
+    static constexpr std::size_t FOOTER_SIZE = 48;
+    static constexpr std::size_t BLOCK_TRAILER_SIZE = 4;
+    static constexpr std::size_t ENTRY_HEADER_SIZE = 16;
+
+    enum FilterType : uint8_t {
+        NONE = 0,
+        BLOCKED_BLOOM = 1,
+    };
+
+    struct Handle {
+        uint64_t offset = 0;
+        // 包括块尾的CRC
+        uint64_t size = 0;
+    };
+
+    struct Footer {
+        Handle filter;
+        Handle index;
+        uint64_t entries = 0;
+    };
+
+    static void put_u32(std::string &out, uint32_t value) {
+        out.append(reinterpret_cast<const char *>(&value), 4);
+    }
+
+    static void put_u64(std::string &out, uint64_t value) {
+        out.append(reinterpret_cast<const char *>(&value), 8);
+    }
+
+    static uint32_t get_u32(const char *data) {
+        uint32_t value;
+        memcpy(&value, data, 4);
+        return value;
+    }
+
+    static uint64_t get_u64(const char *data) {
+        uint64_t value;
+        memcpy(&value, data, 8);
+        return value;
+    }
+
+    static void encode_entry(std::string &out, std::string_view key, std::string_view value, uint64_t seq, MemTable::Type type) {
+        put_u32(out, static_cast<uint32_t>(key.size()));
+        put_u32(out, static_cast<uint32_t>(value.size()));
+        put_u64(out, seq << 8 | type);
+        out.append(key);
+        out.append(value);
+    }
+
+    // 在块末尾追加CRC
+    static void seal_block(std::string &block, std::size_t start) {
+        put_u32(block, crc32c(block.data() + start, block.size() - start));
+    }
+
+    // 校验CRC并返回块的内容(不含CRC)
+    static std::string_view check_block(std::string_view block, const std::string &key, uint64_t offset) {
+        if (block.size() < BLOCK_TRAILER_SIZE) {
+            throw ObjectStore::Error(fmt::format("Error in SstReader, key: {}, block at {} is truncated", key, offset));
+        }
+        std::string_view contents = block.substr(0, block.size() - BLOCK_TRAILER_SIZE);
+        if (crc32c(contents.data(), contents.size()) != get_u32(block.data() + contents.size())) {
+            throw ObjectStore::Error(fmt::format("Error in SstReader, key: {}, checksum mismatch in block at {}", key, offset));
+        }
+        return contents;
+    }
+
+    static void encode_footer(std::string &out, const Footer &footer) {
+        put_u64(out, footer.filter.offset);
+        put_u64(out, footer.filter.size);
+        put_u64(out, footer.index.offset);
+        put_u64(out, footer.index.size);
+        put_u64(out, footer.entries);
+        put_u64(out, MAGIC);
+    }
+
+    static Footer decode_footer(const char *data, const std::string &key) {
+        if (get_u64(data + 40) != MAGIC) {
+            throw ObjectStore::Error(fmt::format("Error in SstReader, key: {}, bad magic in footer", key));
+        }
+        return Footer{
+            .filter = {get_u64(data), get_u64(data + 8)},
+            .index = {get_u64(data + 16), get_u64(data + 24)},
+            .entries = get_u64(data + 32),
+        };
+    }
+};
+
+/**
+ * @brief 按顺序写入记录, 生成SST对象
+ * 数据块攒够part_bytes后作为一段上传(上传当前段的同时填充下一段), 内存占用约为两段, 与表的大小无关;
+ * 整个表不足一段时直接单次PUT. 未finish就销毁时放弃上传
+ */
+class SstWriter {
+  public:
+    struct Options {
+        std::size_t block_bytes = 64 << 10;
+        // 分段上传的段大小, 不能小于后端的最小段大小
+        std::size_t part_bytes = 16 << 20;
+        // 0表示不生成过滤器
+        double bloom_bits_per_key = 10;
+
+        static Options from_config() {
+            return Options{
+                .block_bytes = std::max<std::size_t>(1, CONFIG::SST_BLOCK_BYTES),
+                .part_bytes = std::max<std::size_t>(1, CONFIG::MULTIPART_PART_SIZE),
+                .bloom_bits_per_key = CONFIG::SST_BLOOM_BITS_PER_KEY,
+            };
+        }
+    };
+
+    struct Result {
+        std::size_t size = 0;
+        std::size_t entries = 0;
+        std::size_t data_blocks = 0;
+        std::size_t filter_bytes = 0;
+        std::size_t index_bytes = 0;
+        // 0表示单次PUT
+        std::size_t parts = 0;
+    };
+
+    SstWriter(const ObjectStore &store, std::string key, const Options &options = Options::from_config())
+        : store_(store), key_(std::move(key)), options_(options) {}
+
+    ~SstWriter() {
+        // upload_part引用uploading_, 先等它结束再放弃上传
+        if (in_flight_.valid()) {
+            in_flight_.wait();
+        }
+    }
+
+    SstWriter(const SstWriter &) = delete;
+    SstWriter &operator=(const SstWriter &) = delete;
+
+    // 记录必须按<key升序, seq降序>添加
+    void add(std::string_view key, std::string_view value, uint64_t seq, MemTable::Type type = MemTable::PUT) {
+        if (result_.entries > 0 && (key < last_key_ || (key == last_key_ && seq >= last_seq_))) {
+            throw ObjectStore::Error(fmt::format("Error in SstWriter, key: {}, record <{}, {}> out of order", key_, key, seq));
+        }
+        // 同一个key的多个版本只加入过滤器一次
+        if (options_.bloom_bits_per_key > 0 && (result_.entries == 0 || key != last_key_)) {
+            key_hashes_.push_back(BloomFilter::hash(key));
+        }
+        SstFormat::encode_entry(block_, key, value, seq, type);
+        last_key_.assign(key);
+        last_seq_ = seq;
+        ++result_.entries;
+        if (block_.size() >= options_.block_bytes) {
+            finish_block();
+        }
+    }
+
+    // 写入过滤器块、索引块和footer并完成上传
+    Result finish() {
+        finish_block();
+
+        SstFormat::Footer footer{.entries = result_.entries};
+        footer.filter.offset = offset();
+        std::size_t start = out_.size();
+        if (options_.bloom_bits_per_key > 0 && !key_hashes_.empty()) {
+            out_.push_back(SstFormat::BLOCKED_BLOOM);
+            out_.append(BloomFilter::build(key_hashes_, options_.bloom_bits_per_key));
+            key_hashes_ = {};
+        } else {
+            out_.push_back(SstFormat::NONE);
+        }
+        SstFormat::seal_block(out_, start);
+        footer.filter.size = out_.size() - start;
+
+        footer.index.offset = offset();
+        start = out_.size();
+        SstFormat::put_u32(out_, static_cast<uint32_t>(index_count_));
+        out_.append(index_);
+        SstFormat::seal_block(out_, start);
+        footer.index.size = out_.size() - start;
+        SstFormat::encode_footer(out_, footer);
+
+        result_.filter_bytes = footer.filter.size;
+        result_.index_bytes = footer.index.size;
+        result_.size = offset();
+        if (!upload_) {
+            store_.put_object(key_, out_);
+        } else {
+            flush_part();
+            in_flight_.get();
+            upload_->complete();
+        }
+        return result_;
+    }
+
+    // 每个key只写入最新的版本(包括删除标记)
+    static Result write(const ObjectStore &store, const std::string &key, const MemTable &table, const Options &options = Options::from_config()) {
+        SstWriter writer(store, key, options);
+        MemTable::Iterator it(table);
+        std::string_view prev;
+        for (it.seek_to_first(); it.valid(); it.next()) {
+            auto entry = it.entry();
+            if (entry.key != prev || writer.result_.entries == 0) {
+                writer.add(entry.key, entry.value, entry.seq, entry.type);
+                prev = entry.key;
+            }
+        }
+        return writer.finish();
+    }
+
+  private:
+    // 已写入对象的字节数
+    std::size_t offset() const {
+        return uploaded_ + out_.size();
+    }
+
+    void finish_block() {
+        if (block_.empty()) {
+            return;
+        }
+        SstFormat::Handle handle{.offset = offset()};
+        std::size_t start = out_.size();
+        out_.append(block_);
+        SstFormat::seal_block(out_, start);
+        handle.size = out_.size() - start;
+        block_.clear();
+
+        SstFormat::put_u32(index_, static_cast<uint32_t>(last_key_.size()));
+        index_.append(last_key_);
+        SstFormat::put_u64(index_, handle.offset);
+        SstFormat::put_u64(index_, handle.size);
+        ++index_count_;
+        ++result_.data_blocks;
+
+        if (out_.size() >= options_.part_bytes) {
+            flush_part();
+        }
+    }
+
+    // 等上一段上传完成后, 异步上传out_
+    void flush_part() {
+        if (!upload_) {
+            upload_ = store_.begin_multipart_upload(key_);
+        }
+        if (in_flight_.valid()) {
+            in_flight_.get();
+        }
+        std::swap(out_, uploading_);
+        out_.clear();
+        uploaded_ += uploading_.size();
+        in_flight_ = store_.async_upload_part(*upload_, ++result_.parts, uploading_);
+    }
+
+    const ObjectStore &store_;
+    const std::string key_;
+    const Options options_;
+
+    std::string block_;
+    std::string last_key_;
+    uint64_t last_seq_ = 0;
+    std::string index_;
+    std::size_t index_count_ = 0;
+    // 每个key的BloomFilter::hash, finish时构建过滤器
+    std::vector<uint64_t> key_hashes_;
+    // 尚未上传的数据
+    std::string out_;
+    std::size_t uploaded_ = 0;
+    std::unique_ptr<ObjectStore::MultipartUpload> upload_;
+    std::string uploading_;
+    std::future<void> in_flight_;
+    Result result_;
+};
+
+/**
+ * @brief 打开时读取footer、索引块和过滤器块并常驻内存, 之后每次get最多一次get_range, 过滤器判定不存在的key不发出GET
+ * 对象大小已知时(比如记录在manifest中)可以传入, 省去HEAD; 尾部在tail_read_bytes以内时打开只需一次GET
+ */
+class SstReader {
+  public:
+    struct Options {
+        std::size_t tail_read_bytes = 1 << 20;
+
+        static Options from_config() {
+            return Options{.tail_read_bytes = std::max(SstFormat::FOOTER_SIZE, CONFIG::SST_TAIL_READ_BYTES)};
+        }
+    };
+
+    // 打开和点查发出的GET次数
+    struct Stats {
+        std::size_t open_reads = 0;
+        std::size_t block_reads = 0;
+        // 被过滤器排除, 没有读取数据块的点查
+        std::size_t filter_skips = 0;
+    };
+
+    SstReader(const ObjectStore &store, std::string key, std::size_t object_size = 0, const Options &options = Options::from_config())
+        : store_(store), key_(std::move(key)), size_(object_size ? object_size : store_.head_object(key_)) {
+        if (size_ < SstFormat::FOOTER_SIZE) {
+            throw ObjectStore::Error(fmt::format("Error in SstReader, key: {}, size: {} is smaller than footer", key_, size_));
+        }
+        // 先读尾部, 过滤器块和索引块不在其中时再补读缺少的部分
+        std::size_t tail_offset = size_ - std::min(size_, options.tail_read_bytes);
+        std::string tail = read(tail_offset, size_ - tail_offset);
+        ++open_reads_;
+        footer_ = SstFormat::decode_footer(tail.data() + tail.size() - SstFormat::FOOTER_SIZE, key_);
+        if (footer_.filter.offset + footer_.filter.size != footer_.index.offset || footer_.index.offset + footer_.index.size + SstFormat::FOOTER_SIZE != size_) {
+            throw ObjectStore::Error(fmt::format("Error in SstReader, key: {}, bad block handles in footer", key_));
+        }
+        if (footer_.filter.offset < tail_offset) {
+            tail = read(footer_.filter.offset, tail_offset - footer_.filter.offset) + tail;
+            tail_offset = footer_.filter.offset;
+            ++open_reads_;
+        }
+        std::string_view meta = std::string_view(tail).substr(footer_.filter.offset - tail_offset);
+        parse_filter(SstFormat::check_block(meta.substr(0, footer_.filter.size), key_, footer_.filter.offset));
+        parse_index(SstFormat::check_block(meta.substr(footer_.filter.size, footer_.index.size), key_, footer_.index.offset));
+    }
+
+    SstReader(const SstReader &) = delete;
+    SstReader &operator=(const SstReader &) = delete;
+
+    // 返回key的最新版本, 删除标记也返回
+    std::optional<MemTableList::Record> get(std::string_view key) const {
+        if (filter_ && !filter_->may_contain(BloomFilter::hash(key))) {
+            filter_skips_.fetch_add(1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+        std::size_t block_idx = find_block(key);
+        if (block_idx == index_.size()) {
+            return std::nullopt;
+        }
+        const auto &handle = index_[block_idx].handle;
+        std::string block = read(handle.offset, handle.size);
+        block_reads_.fetch_add(1, std::memory_order_relaxed);
+        return search_block(SstFormat::check_block(block, key_, handle.offset), key);
+    }
+
+    // 批量点查: 先用过滤器批量排除不存在的key, 剩下的key按数据块合并, 每个数据块一次get_range, 并发读取
+    std::vector<std::optional<MemTableList::Record>> multi_get(const std::vector<std::string_view> &keys) const {
+        std::vector<std::optional<MemTableList::Record>> results(keys.size());
+        std::unique_ptr<bool[]> may_contain(new bool[keys.size()]);
+        if (filter_) {
+            std::vector<uint64_t> hashes(keys.size());
+            for (std::size_t i = 0; i < keys.size(); ++i) {
+                hashes[i] = BloomFilter::hash(keys[i]);
+            }
+            filter_->may_contain(hashes.data(), hashes.size(), may_contain.get());
+        } else {
+            std::fill_n(may_contain.get(), keys.size(), true);
+        }
+
+        // 数据块 -> 其中要查找的key
+        std::unordered_map<std::size_t, std::vector<std::size_t>> block_keys;
+        for (std::size_t i = 0; i < keys.size(); ++i) {
+            if (!may_contain[i]) {
+                filter_skips_.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            std::size_t block_idx = find_block(keys[i]);
+            if (block_idx < index_.size()) {
+                block_keys[block_idx].push_back(i);
+            }
+        }
+        std::vector<std::pair<std::size_t, std::string>> blocks;
+        std::vector<std::future<std::size_t>> reads;
+        blocks.reserve(block_keys.size());
+        reads.reserve(block_keys.size());
+        for (const auto &[block_idx, _] : block_keys) {
+            const auto &handle = index_[block_idx].handle;
+            blocks.emplace_back(block_idx, std::string(handle.size, '\0'));
+            reads.push_back(store_.async_get_range(key_, handle.offset, handle.size, blocks.back().second.data()));
+        }
+        block_reads_.fetch_add(blocks.size(), std::memory_order_relaxed);
+        // 先等待全部读取结束, 再检查结果, 避免异常时buffer在读取完成前被释放
+        for (auto &read : reads) {
+            read.wait();
+        }
+        for (std::size_t i = 0; i < blocks.size(); ++i) {
+            const auto &handle = index_[blocks[i].first].handle;
+            std::size_t read = reads[i].get();
+            if (read != handle.size) {
+                throw ObjectStore::Error(fmt::format("Error in SstReader, key: {}, offset: {}, read: {}, expected: {}", key_, handle.offset, read, handle.size));
+            }
+            std::string_view contents = SstFormat::check_block(blocks[i].second, key_, handle.offset);
+            for (std::size_t key_idx : block_keys[blocks[i].first]) {
+                results[key_idx] = search_block(contents, keys[key_idx]);
+            }
+        }
+        return results;
+    }
+
+    std::size_t size() const { return size_; }
+
+    // key所在的数据块在索引中的序号, 超出最后一个key时为数据块数
+    std::size_t block_of(std::string_view key) const { return find_block(key); }
+
+    std::size_t entries() const { return footer_.entries; }
+
+    std::size_t data_blocks() const { return index_.size(); }
+
+    // 过滤器占用的位数, 没有过滤器时为0
+    std::size_t filter_bits() const { return filter_ ? filter_->bits() : 0; }
+
+    Stats stats() const {
+        return Stats{
+            .open_reads = open_reads_,
+            .block_reads = block_reads_.load(std::memory_order_relaxed),
+            .filter_skips = filter_skips_.load(std::memory_order_relaxed),
+        };
+    }
+
+  private:
+    struct IndexEntry {
+        std::string last_key;
+        SstFormat::Handle handle;
+    };
+
+    // 第一个最后一个key不小于key的数据块, 没有时返回index_.size()
+    std::size_t find_block(std::string_view key) const {
+        auto it = std::lower_bound(index_.begin(), index_.end(), key, [](const IndexEntry &entry, std::string_view key) { return entry.last_key < key; });
+        return it - index_.begin();
+    }
+
+    std::optional<MemTableList::Record> search_block(std::string_view contents, std::string_view key) const {
+        std::size_t pos = 0;
+        while (pos + SstFormat::ENTRY_HEADER_SIZE <= contents.size()) {
+            const char *header = contents.data() + pos;
+            uint32_t key_size = SstFormat::get_u32(header);
+            uint32_t value_size = SstFormat::get_u32(header + 4);
+            uint64_t tag = SstFormat::get_u64(header + 8);
+            std::string_view entry_key = contents.substr(pos + SstFormat::ENTRY_HEADER_SIZE, key_size);
+            if (entry_key == key) {
+                return MemTableList::Record{
+                    std::string(contents.substr(pos + SstFormat::ENTRY_HEADER_SIZE + key_size, value_size)),
+                    tag >> 8,
+                    static_cast<MemTable::Type>(tag & 0xff),
+                };
+            }
+            if (entry_key > key) {
+                break;
+            }
+            pos += SstFormat::ENTRY_HEADER_SIZE + key_size + value_size;
+        }
+        return std::nullopt;
+    }
+
+    std::string read(uint64_t offset, std::size_t len) const {
+        std::string data(len, '\0');
+        std::size_t read = store_.get_range(key_, offset, len, data.data());
+        if (read != len) {
+            throw ObjectStore::Error(fmt::format("Error in SstReader, key: {}, offset: {}, read: {}, expected: {}", key_, offset, read, len));
+        }
+        return data;
+    }
+
+    void parse_filter(std::string_view contents) {
+        if (contents.empty()) {
+            throw ObjectStore::Error(fmt::format("Error in SstReader, key: {}, filter block is truncated", key_));
+        }
+        switch (contents[0]) {
+        case SstFormat::NONE:
+            break;
+        case SstFormat::BLOCKED_BLOOM:
+            if (!BloomFilter::valid(contents.substr(1))) {
+                throw ObjectStore::Error(fmt::format("Error in SstReader, key: {}, filter size: {} does not match its block count", key_, contents.size() - 1));
+            }
+            filter_.emplace(contents.substr(1));
+            break;
+        default:
+            throw ObjectStore::Error(fmt::format("Error in SstReader, key: {}, unknown filter type: {}", key_, static_cast<int>(contents[0])));
+        }
+    }
+
+    void parse_index(std::string_view contents) {
+        if (contents.size() < 4) {
+            throw ObjectStore::Error(fmt::format("Error in SstReader, key: {}, index block is truncated", key_));
+        }
+        uint32_t count = SstFormat::get_u32(contents.data());
+        index_.reserve(count);
+        std::size_t pos = 4;
+        for (uint32_t i = 0; i < count; ++i) {
+            if (pos + 4 > contents.size() || pos + 4 + SstFormat::get_u32(contents.data() + pos) + 16 > contents.size()) {
+                throw ObjectStore::Error(fmt::format("Error in SstReader, key: {}, index entry {} is truncated", key_, i));
+            }
+            uint32_t key_size = SstFormat::get_u32(contents.data() + pos);
+            const char *handle = contents.data() + pos + 4 + key_size;
+            index_.push_back(IndexEntry{
+                std::string(contents.substr(pos + 4, key_size)),
+                {SstFormat::get_u64(handle), SstFormat::get_u64(handle + 8)},
+            });
+            pos += 4 + key_size + 16;
+        }
+    }
+
+    const ObjectStore &store_;
+    const std::string key_;
+    const std::size_t size_;
+    SstFormat::Footer footer_;
+    std::optional<BloomFilter> filter_;
+    std::vector<IndexEntry> index_;
+    std::size_t open_reads_ = 0;
+    mutable std::atomic<std::size_t> block_reads_ = 0;
+    mutable std::atomic<std::size_t> filter_skips_ = 0;
+};
@@ -0,0 +1,413 @@
+#pragma once
+
+#include "bounded_queue.h"
+#include "histogram.h"
+#include "log.h"
+#include "object_store.h"
+#include "worker_pool.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief 访问日志中的一个请求, 每行一个JSON对象, 例如
+ * {"ts": 12.345, "op": "get", "key": "a/b", "size": 4096}
+ * ts为秒(只使用相邻记录的差值), op为put/get/get_range/head/append/list/delete;
+ * size为put/append的写入大小和get的对象大小, get_range读取[offset, offset + size), list的key为前缀; 其他字段忽略
+ */
+struct TraceRecord {
+    enum Op { PUT, GET, GET_RANGE, HEAD, APPEND, LIST, DELETE, OP_COUNT };
+
+    static constexpr std::array<std::string_view, OP_COUNT> OP_NAMES = {"put", "get", "get_range", "head", "append", "list", "delete"};
+
+    double ts = 0;
+    Op op = GET;
+    std::string key;
+    std::size_t size = 0;
+    std::size_t offset = 0;
+
+    // 只支持扁平的对象, 值为字符串、数字、true/false/null; 格式不对或缺少ts/op/key时返回false
+    static bool parse(std::string_view line, TraceRecord &record) {
+        record = TraceRecord();
+        std::size_t pos = 0;
+        auto skip_spaces = [&]() {
+            while (pos < line.size() && (line[pos] == ' ' || line[pos] == '\t' || line[pos] == '\r' || line[pos] == '\n')) {
+                ++pos;
+            }
+        };
+        auto parse_string = [&](std::string &out) {
+            if (pos >= line.size() || line[pos] != '"') {
+                return false;
+            }
+            ++pos;
+            out.clear();
+            while (pos < line.size() && line[pos] != '"') {
+                char c = line[pos++];
+                if (c == '\\' && pos < line.size()) {
+                    char escaped = line[pos++];
+                    switch (escaped) {
+                        case 'n':
+                            c = '\n';
+                            break;
+                        case 't':
+                            c = '\t';
+                            break;
+                        case 'r':
+                            c = '\r';
+                            break;
+                        case 'u': {
+                            // 只支持ASCII范围内的\uXXXX
+                            if (pos + 4 > line.size()) {
+                                return false;
+                            }
+                            unsigned code = 0;
+                            for (std::size_t end = pos + 4; pos < end; ++pos) {
+                                char h = line[pos];
+                                unsigned digit;
+                                if (h >= '0' && h <= '9') {
+                                    digit = h - '0';
+                                } else if (h >= 'a' && h <= 'f') {
+                                    digit = h - 'a' + 10;
+                                } else if (h >= 'A' && h <= 'F') {
+                                    digit = h - 'A' + 10;
+                                } else {
+                                    return false;
+                                }
+                                code = code * 16 + digit;
+                            }
+                            c = static_cast<char>(code);
+                            break;
+                        }
+                        default:
+                            c = escaped;
+                    }
+                }
+                out.push_back(c);
+            }
+            if (pos >= line.size()) {
+                return false;
+            }
+            ++pos;
+            return true;
+        };
+
+        skip_spaces();
+        if (pos >= line.size() || line[pos++] != '{') {
+            return false;
+        }
+        bool has_ts = false, has_op = false, has_key = false;
+        std::string name, text;
+        while (true) {
+            skip_spaces();
+            if (pos < line.size() && line[pos] == '}') {
+                break;
+            }
+            if (!parse_string(name)) {
+                return false;
+            }
+            skip_spaces();
+            if (pos >= line.size() || line[pos++] != ':') {
+                return false;
+            }
+            skip_spaces();
+            if (pos < line.size() && line[pos] == '"') {
+                if (!parse_string(text)) {
+                    return false;
+                }
+            } else {
+                std::size_t end = line.find_first_of(",} \t", pos);
+                text = std::string(line.substr(pos, end == std::string_view::npos ? std::string_view::npos : end - pos));
+                pos = end == std::string_view::npos ? line.size() : end;
+            }
+
+            try {
+                if (name == "ts") {
+                    record.ts = std::stod(text);
+                    has_ts = true;
+                } else if (name == "op") {
+                    auto it = std::find(OP_NAMES.begin(), OP_NAMES.end(), text);
+                    if (it == OP_NAMES.end()) {
+                        return false;
+                    }
+                    record.op = static_cast<Op>(it - OP_NAMES.begin());
+                    has_op = true;
+                } else if (name == "key") {
+                    record.key = text;
+                    has_key = true;
+                } else if (name == "size") {
+                    record.size = std::stoull(text);
+                } else if (name == "offset") {
+                    record.offset = std::stoull(text);
+                }
+            } catch (const std::exception &) {
+                return false;
+            }
+
+            skip_spaces();
+            if (pos < line.size() && line[pos] == ',') {
+                ++pos;
+            }
+        }
+        return has_ts && has_op && has_key;
+    }
+};
+
+/**
+ * @brief 按原始的时间间隔回放访问日志
+ * 一个线程流式读取trace, 经有界队列交给num_threads个工作线程, 内存占用与trace长度无关;
+ * 第n个请求的计划时间为start + (ts_n - ts_0) / speed, 工作线程取到请求后等到计划时间再发起,
+ * 延迟从计划时间算起, 工作线程都被慢请求占住时排队的时间也计入延迟; speed为0时不等待, 尽快回放,
+ * 没有计划时间, 延迟从实际发起算起(与service相同);
+ * 补写由另一个线程执行, 不占用工作线程, 也不计入之后请求的延迟
+ */
+class TraceReplayer {
+  public:
+    using Clock = std::chrono::high_resolution_clock;
+
+    struct Options {
+        // 回放速度相对原始时间的倍数, 0表示尽快回放
+        double speed = 1;
+        // 加在trace中每个key之前, 与其他测试隔离并便于清理
+        std::string key_prefix;
+        // 读取不存在的对象时按记录的大小补写(由单独的线程执行, 不计时), 补写完成后对该key的读取可以命中
+        bool fill_missing = true;
+        // 每个窗口的秒数
+        std::size_t window_seconds = 1;
+        // 读取线程最多领先工作线程的请求数
+        std::size_t queue_depth = 1024;
+    };
+
+    struct Result {
+        // latency/service/series/bytes只统计成功的请求, 失败的请求只计入errors
+        // [op][thread], 从计划时间(speed为0时为实际发起)算起的延迟(ns)
+        std::vector<std::vector<Histogram>> latency;
+        // [op][thread], 从实际发起算起的延迟(ns)
+        std::vector<std::vector<Histogram>> service;
+        // [op], 按完成时间所在的窗口
+        std::vector<HistogramSeries> series;
+        std::array<uint64_t, TraceRecord::OP_COUNT> bytes = {};
+        std::array<uint64_t, TraceRecord::OP_COUNT> errors = {};
+        std::size_t records = 0;
+        std::size_t skipped_lines = 0;
+        double seconds = 0;
+        double cpu_seconds = 0;
+
+        explicit Result(std::size_t num_threads)
+            : latency(TraceRecord::OP_COUNT, std::vector<Histogram>(num_threads)),
+              service(TraceRecord::OP_COUNT, std::vector<Histogram>(num_threads)),
+              series(TraceRecord::OP_COUNT) {}
+    };
+
+    TraceReplayer(const ObjectStore &store, Options options) : store_(store), options_(std::move(options)) {}
+
+    // 在pool的前num_threads + 2个线程上回放, 倒数第二个线程读取trace, 最后一个线程补写
+    Result replay(std::istream &trace, WorkerPool &pool, std::size_t num_threads) const {
+        LOG_ASSERT(num_threads > 0, "num_threads must be positive");
+        Result result(num_threads);
+        std::array<std::atomic<uint64_t>, TraceRecord::OP_COUNT> bytes = {};
+        std::array<std::atomic<uint64_t>, TraceRecord::OP_COUNT> errors = {};
+        BoundedQueue<Scheduled> queue(options_.queue_depth);
+        // 只在补写积压超过queue_depth时阻塞工作线程
+        BoundedQueue<TraceRecord> fills(options_.queue_depth);
+        std::atomic<std::size_t> running_workers = num_threads;
+        const auto window = std::chrono::seconds(std::max<std::size_t>(1, options_.window_seconds));
+        const bool paced = options_.speed > 0;
+
+        Clock::time_point start_time;
+        std::clock_t start_cpu = 0;
+
+        pool.run(num_threads + 2, [&](std::size_t i) {
+            if (i == num_threads) {
+                read_trace(trace, queue, start_time, result);
+                return;
+            }
+            if (i == num_threads + 1) {
+                while (auto record = fills.pop()) {
+                    fill(*record);
+                }
+                return;
+            }
+            std::string buffer;
+            std::vector<Histogram> window_histograms(TraceRecord::OP_COUNT);
+            std::size_t current_window = 0;
+            while (auto scheduled = queue.pop()) {
+                if (paced) {
+                    std::this_thread::sleep_until(scheduled->intended);
+                }
+                const TraceRecord &record = scheduled->record;
+                auto t1 = Clock::now();
+                bool ok = execute(record, buffer);
+                auto t2 = Clock::now();
+                // 失败的请求只计入errors, 不进入延迟统计和吞吐
+                if (!ok) {
+                    errors[record.op].fetch_add(1, std::memory_order_relaxed);
+                    if (options_.fill_missing && needs_fill(record)) {
+                        fills.push(std::move(scheduled->record));
+                    }
+                    continue;
+                }
+                bytes[record.op].fetch_add(record.size, std::memory_order_relaxed);
+                uint64_t latency = std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - (paced ? scheduled->intended : t1)).count();
+                result.latency[record.op][i].record(latency);
+                result.service[record.op][i].record(std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count());
+
+                std::size_t now_window = (t2 - start_time) / window;
+                if (now_window != current_window) {
+                    for (std::size_t op = 0; op < TraceRecord::OP_COUNT; ++op) {
+                        result.series[op].merge(current_window, window_histograms[op]);
+                        window_histograms[op].reset();
+                    }
+                    current_window = now_window;
+                }
+                window_histograms[record.op].record(latency);
+            }
+            for (std::size_t op = 0; op < TraceRecord::OP_COUNT; ++op) {
+                result.series[op].merge(current_window, window_histograms[op]);
+            }
+            if (--running_workers == 0) {
+                fills.close();
+            }
+        }, [&]() {
+            start_time = Clock::now();
+            start_cpu = std::clock();
+        });
+
+        result.seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+        result.cpu_seconds = static_cast<double>(std::clock() - start_cpu) / CLOCKS_PER_SEC;
+        for (std::size_t op = 0; op < TraceRecord::OP_COUNT; ++op) {
+            result.bytes[op] = bytes[op];
+            result.errors[op] = errors[op];
+        }
+        return result;
+    }
+
+  private:
+    struct Scheduled {
+        TraceRecord record;
+        Clock::time_point intended;
+    };
+
+    void read_trace(std::istream &trace, BoundedQueue<Scheduled> &queue, Clock::time_point start_time, Result &result) const {
+        // 读取抛出异常时也要关闭队列, 否则工作线程一直等待
+        struct CloseGuard {
+            BoundedQueue<Scheduled> &queue;
+            ~CloseGuard() { queue.close(); }
+        } guard{queue};
+        std::string line;
+        TraceRecord record;
+        bool first = true;
+        double first_ts = 0;
+        while (std::getline(trace, line)) {
+            if (line.empty()) {
+                continue;
+            }
+            if (!TraceRecord::parse(line, record)) {
+                ++result.skipped_lines;
+                continue;
+            }
+            if (first) {
+                first_ts = record.ts;
+                first = false;
+            }
+            // speed为0时不使用
+            Clock::time_point intended = start_time;
+            if (options_.speed > 0) {
+                double offset = std::max(0.0, record.ts - first_ts) / options_.speed;
+                intended += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(offset));
+            }
+            record.key.insert(0, options_.key_prefix);
+            ++result.records;
+            queue.push(Scheduled{std::move(record), intended});
+        }
+    }
+
+    // 请求失败(包括对象不存在)时返回false
+    bool execute(const TraceRecord &record, std::string &buffer) const {
+        try {
+            switch (record.op) {
+                case TraceRecord::PUT: {
+                    auto data = payload(record.size);
+                    store_.put_object(record.key, std::string_view(*data).substr(0, record.size));
+                    break;
+                }
+                case TraceRecord::GET:
+                    // 记录的大小可能与当前对象不同, 按较大者准备buffer
+                    buffer.resize(std::max(buffer.size(), record.size));
+                    store_.get_object(record.key, buffer.data(), buffer.size());
+                    break;
+                case TraceRecord::GET_RANGE:
+                    buffer.resize(std::max(buffer.size(), record.size));
+                    store_.get_range(record.key, record.offset, record.size, buffer.data());
+                    break;
+                case TraceRecord::HEAD:
+                    store_.head_object(record.key);
+                    break;
+                case TraceRecord::APPEND: {
+                    std::size_t position = 0;
+                    try {
+                        position = store_.head_object(record.key);
+                    } catch (const ObjectStore::Error &e) {
+                        // HEAD的响应没有body, SDK对不存在的key返回HttpErrorNotFound而不是NoSuchKey
+                        if (e.status != OBS_STATUS_NoSuchKey && e.status != OBS_STATUS_HttpErrorNotFound) {
+                            throw;
+                        }
+                    }
+                    auto data = payload(record.size);
+                    store_.append_object(record.key, std::string_view(*data).substr(0, record.size), position);
+                    break;
+                }
+                case TraceRecord::LIST:
+                    store_.list_objects_pages([](std::vector<std::string> &) { return false; }, "", record.key);
+                    break;
+                case TraceRecord::DELETE:
+                    store_.delete_object(record.key);
+                    break;
+                default:
+                    break;
+            }
+        } catch (const ObjectStore::Error &e) {
+            LOG_DEBUG("replay {} failed: {}", TraceRecord::OP_NAMES[record.op], e.what());
+            return false;
+        }
+        return true;
+    }
+
+    static bool needs_fill(const TraceRecord &record) {
+        return record.op == TraceRecord::GET || record.op == TraceRecord::GET_RANGE || record.op == TraceRecord::HEAD;
+    }
+
+    void fill(const TraceRecord &record) const {
+        try {
+            std::size_t size = std::max<std::size_t>(1, record.offset + record.size);
+            auto data = payload(size);
+            store_.put_object(record.key, std::string_view(*data).substr(0, size));
+        } catch (const ObjectStore::Error &e) {
+            LOG_WARN("replay fill failed: {}", e.what());
+        }
+    }
+
+    // 所有写入共享同一份只读数据, 不够大时换成新的一份, 正在使用旧数据的请求持有旧的shared_ptr
+    std::shared_ptr<const std::string> payload(std::size_t size) const {
+        std::lock_guard<std::mutex> lock(payload_mutex_);
+        if (!payload_ || payload_->size() < size) {
+            payload_ = std::make_shared<const std::string>(std::max(size, payload_ ? payload_->size() * 2 : size), 'a');
+        }
+        return payload_;
+    }
+
+    const ObjectStore &store_;
+    const Options options_;
+
+    mutable std::mutex payload_mutex_;
+    mutable std::shared_ptr<const std::string> payload_;
+};
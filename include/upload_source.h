@@ -0,0 +1,243 @@
+#pragma once
+
+#include "log.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// x86下为TSC周期数, 其他平台退化为纳秒
+inline uint64_t read_cycle_counter() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/**
+ * @brief 上传数据源, 由SDK的上传回调按偏移直接填充SDK的发送缓冲区
+ * SDK的回调接口要求把数据写入它提供的缓冲区, 因此最多只有这一次拷贝; 数据源自身不做额外的暂存拷贝
+ * 同一个数据源可以被多个请求并发读取
+ */
+class UploadSource {
+  public:
+    virtual ~UploadSource() = default;
+
+    virtual std::size_t size() const = 0;
+
+    // 由上传回调调用, 写入[offset, offset + len)的数据并统计消耗的CPU周期
+    std::size_t feed(std::size_t offset, char *dst, std::size_t len) {
+        uint64_t t1 = read_cycle_counter();
+        std::size_t n = read(offset, dst, std::min(len, size() - offset));
+        feed_cycles_.fetch_add(read_cycle_counter() - t1, std::memory_order_relaxed);
+        return n;
+    }
+
+    // 所有请求在feed中消耗的CPU周期
+    uint64_t feed_cycles() const { return feed_cycles_.load(std::memory_order_relaxed); }
+
+    void reset_feed_cycles() { feed_cycles_.store(0, std::memory_order_relaxed); }
+
+  protected:
+    // len已保证不超过剩余数据
+    virtual std::size_t read(std::size_t offset, char *dst, std::size_t len) = 0;
+
+  private:
+    std::atomic<uint64_t> feed_cycles_ = 0;
+};
+
+// 内存中的数据, 每次feed拷贝一次, 与put_buffer_data_callback相同
+class BufferSource : public UploadSource {
+  public:
+    explicit BufferSource(std::string_view buffer) : buffer_(buffer) {}
+
+    std::size_t size() const override { return buffer_.size(); }
+
+  protected:
+    std::size_t read(std::size_t offset, char *dst, std::size_t len) override {
+        memcpy(dst, buffer_.data() + offset, len);
+        return len;
+    }
+
+  private:
+    std::string_view buffer_;
+};
+
+// 只读mmap的文件, 直接从page cache拷贝到SDK缓冲区, 省去read()到用户态暂存buffer的拷贝
+class MappedFileSource : public UploadSource {
+  public:
+    explicit MappedFileSource(const std::string &path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        LOG_ASSERT(fd >= 0, "open {} failed: {}", path, strerror(errno));
+        struct stat st;
+        LOG_ASSERT(::fstat(fd, &st) == 0, "fstat {} failed: {}", path, strerror(errno));
+        size_ = st.st_size;
+        if (size_ > 0) {
+            void *addr = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+            LOG_ASSERT(addr != MAP_FAILED, "mmap {} failed: {}", path, strerror(errno));
+            data_ = static_cast<const char *>(addr);
+            ::madvise(addr, size_, MADV_SEQUENTIAL);
+        }
+        ::close(fd);
+    }
+
+    ~MappedFileSource() override {
+        if (data_) {
+            ::munmap(const_cast<char *>(data_), size_);
+        }
+    }
+
+    MappedFileSource(const MappedFileSource &) = delete;
+    MappedFileSource &operator=(const MappedFileSource &) = delete;
+
+    std::size_t size() const override { return size_; }
+
+  protected:
+    std::size_t read(std::size_t offset, char *dst, std::size_t len) override {
+        memcpy(dst, data_ + offset, len);
+        return len;
+    }
+
+  private:
+    const char *data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+// 由生成函数直接在SDK缓冲区中产生数据, 没有源buffer, 也就没有拷贝
+class GeneratorSource : public UploadSource {
+  public:
+    using Generator = std::function<void(std::size_t offset, char *dst, std::size_t len)>;
+
+    GeneratorSource(std::size_t size, Generator generator) : size_(size), generator_(std::move(generator)) {}
+
+    // 填充固定字节
+    static GeneratorSource filled(std::size_t size, char c) {
+        return GeneratorSource(size, [c](std::size_t, char *dst, std::size_t len) { memset(dst, c, len); });
+    }
+
+    std::size_t size() const override { return size_; }
+
+  protected:
+    std::size_t read(std::size_t offset, char *dst, std::size_t len) override {
+        generator_(offset, dst, len);
+        return len;
+    }
+
+  private:
+    std::size_t size_;
+    Generator generator_;
+};
+
+/**
+ * @brief 预先分配并完成首次访问(page fault)的固定大小buffer池
+ * 上传方直接在借出的buffer中准备数据, 再通过PooledBufferSource上传, 避免每次上传时分配和暂存拷贝
+ */
+class BufferPool {
+  public:
+    class Buffer {
+      public:
+        Buffer() = default;
+        Buffer(BufferPool *pool, char *data) : pool_(pool), data_(data) {}
+        Buffer(Buffer &&other) noexcept : pool_(other.pool_), data_(other.data_) { other.data_ = nullptr; }
+        Buffer &operator=(Buffer &&other) noexcept {
+            std::swap(pool_, other.pool_);
+            std::swap(data_, other.data_);
+            return *this;
+        }
+        ~Buffer() {
+            if (data_) {
+                pool_->release(data_);
+            }
+        }
+
+        explicit operator bool() const { return data_ != nullptr; }
+        char *data() const { return data_; }
+        std::size_t capacity() const { return pool_->buffer_size(); }
+
+      private:
+        BufferPool *pool_ = nullptr;
+        char *data_ = nullptr;
+    };
+
+    BufferPool(std::size_t buffer_count, std::size_t buffer_size) : buffer_size_(buffer_size) {
+        storage_.reset(static_cast<char *>(std::aligned_alloc(ALIGNMENT, round_up(buffer_count * buffer_size))));
+        LOG_ASSERT(storage_ || buffer_count * buffer_size == 0, "allocate {} bytes failed", buffer_count * buffer_size);
+        if (storage_) {
+            memset(storage_.get(), 0, buffer_count * buffer_size);
+        }
+        free_list_.reserve(buffer_count);
+        for (std::size_t i = 0; i < buffer_count; ++i) {
+            free_list_.push_back(storage_.get() + i * buffer_size);
+        }
+    }
+
+    // 没有空闲buffer时返回空的Buffer
+    Buffer try_acquire() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (free_list_.empty()) {
+            return {};
+        }
+        char *data = free_list_.back();
+        free_list_.pop_back();
+        return Buffer(this, data);
+    }
+
+    std::size_t buffer_size() const { return buffer_size_; }
+
+  private:
+    static constexpr std::size_t ALIGNMENT = 4096;
+
+    static std::size_t round_up(std::size_t size) { return (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT; }
+
+    void release(char *data) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_list_.push_back(data);
+    }
+
+    struct FreeDeleter {
+        void operator()(char *p) const { std::free(p); }
+    };
+
+    std::size_t buffer_size_;
+    std::unique_ptr<char, FreeDeleter> storage_;
+    std::vector<char *> free_list_;
+    std::mutex mutex_;
+};
+
+// 从BufferPool借出的buffer中的前size字节, 析构时归还; 数据已经在池中准备好, feed时只有拷贝到SDK缓冲区的一次
+class PooledBufferSource : public UploadSource {
+  public:
+    PooledBufferSource(BufferPool::Buffer buffer, std::size_t size) : buffer_(std::move(buffer)), size_(size) {
+        LOG_ASSERT(buffer_ && size_ <= buffer_.capacity(), "invalid pooled buffer, size: {}", size_);
+    }
+
+    std::size_t size() const override { return size_; }
+
+  protected:
+    std::size_t read(std::size_t offset, char *dst, std::size_t len) override {
+        memcpy(dst, buffer_.data() + offset, len);
+        return len;
+    }
+
+  private:
+    BufferPool::Buffer buffer_;
+    std::size_t size_;
+};
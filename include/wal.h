@@ -0,0 +1,321 @@
+#pragma once
+
+#include "append_writer.h"
+#include "config.h"
+#include "object_store.h"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// CRC-32C(Castagnoli), 按字节查表
+inline uint32_t crc32c(const char *data, std::size_t size, uint32_t crc = 0) {
+    static const std::array<uint32_t, 256> table = []() {
+        std::array<uint32_t, 256> table{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                value = (value >> 1) ^ (0x82F63B78u & (0u - (value & 1)));
+            }
+            table[i] = value;
+        }
+        return table;
+    }();
+    crc = ~crc;
+    for (std::size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+/**
+ * @brief WAL的记录格式和段对象的命名
+ * 每条记录为 [length: u32][crc: u32][payload], 小端序, crc为length和payload的CRC-32C;
+ * 段对象的key为prefix加16位十进制序号, 按key的顺序即为写入的顺序
+ */
+struct WalFormat {
+    static constexpr std::size_t HEADER_SIZE = 8;
+
+    static std::string segment_key(const std::string &prefix, uint64_t segment) {
+        return fmt::format("{}{:016}", prefix, segment);
+    }
+
+    // 按序号升序返回prefix下的所有段
+    static std::vector<uint64_t> list_segments(const ObjectStore &store, const std::string &prefix) {
+        std::vector<uint64_t> segments;
+        for (const auto &key : store.list_objects("", prefix, "")) {
+            std::string_view suffix = std::string_view(key).substr(prefix.size());
+            if (suffix.size() == 16 && std::all_of(suffix.begin(), suffix.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+                segments.push_back(std::stoull(std::string(suffix)));
+            }
+        }
+        std::sort(segments.begin(), segments.end());
+        return segments;
+    }
+
+    static void encode(std::string_view payload, std::string &out) {
+        uint32_t length = static_cast<uint32_t>(payload.size());
+        char header[HEADER_SIZE];
+        memcpy(header, &length, 4);
+        uint32_t crc = crc32c(payload.data(), payload.size(), crc32c(header, 4));
+        memcpy(header + 4, &crc, 4);
+        out.append(header, HEADER_SIZE);
+        out.append(payload);
+    }
+
+    enum class Decode { OK, NEED_MORE, CORRUPT };
+
+    // 从data开头解析一条记录, 成功时payload指向data内部; consumed为记录头中的总长度, CORRUPT时也设置
+    static Decode decode(std::string_view data, std::string_view &payload, std::size_t &consumed) {
+        if (data.size() < HEADER_SIZE) {
+            return Decode::NEED_MORE;
+        }
+        uint32_t length, crc;
+        memcpy(&length, data.data(), 4);
+        memcpy(&crc, data.data() + 4, 4);
+        if (data.size() < HEADER_SIZE + length) {
+            return Decode::NEED_MORE;
+        }
+        consumed = HEADER_SIZE + length;
+        if (crc32c(data.data() + HEADER_SIZE, length, crc32c(data.data(), 4)) != crc) {
+            return Decode::CORRUPT;
+        }
+        payload = data.substr(HEADER_SIZE, length);
+        return Decode::OK;
+    }
+};
+
+/**
+ * @brief 写入OBS追加对象的WAL
+ * 多个写线程的记录经AppendWriter合并为一次append_object(组提交, 由CONFIG::APPEND_FLUSH_*控制),
+ * 段达到segment_bytes后切换到下一个段; 打开时总是从已有的最后一段之后新建一段, 不追加到可能有残缺尾部的旧段,
+ * 因此残缺的尾部可能出现在任何一段的末尾(见WalReader)
+ */
+class WalWriter {
+  public:
+    struct Options {
+        std::size_t segment_bytes = 64 << 20;
+        AppendWriter::Options append = {};
+
+        static Options from_config() {
+            return Options{
+                .segment_bytes = std::max<std::size_t>(1, CONFIG::WAL_SEGMENT_BYTES),
+                .append = AppendWriter::Options::from_config(),
+            };
+        }
+    };
+
+    // end在记录写入后就绪, 为记录在段中的结束位置
+    struct Ticket {
+        uint64_t segment;
+        std::future<std::size_t> end;
+    };
+
+    struct Stats {
+        std::size_t records = 0;
+        std::size_t bytes = 0;
+        std::size_t segments = 0;
+    };
+
+    WalWriter(const ObjectStore &store, std::string prefix, const Options &options = Options::from_config())
+        : store_(store), prefix_(std::move(prefix)), options_(options) {
+        auto segments = WalFormat::list_segments(store_, prefix_);
+        open_segment(segments.empty() ? 0 : segments.back() + 1);
+    }
+
+    ~WalWriter() {
+        close();
+    }
+
+    WalWriter(const WalWriter &) = delete;
+    WalWriter &operator=(const WalWriter &) = delete;
+
+    // 编码并提交一条记录, 等待ticket.end即为等待提交完成
+    Ticket append(std::string_view payload) {
+        thread_local std::string record;
+        record.clear();
+        WalFormat::encode(payload, record);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!writer_) {
+            throw ObjectStore::Error(fmt::format("WalWriter for {} is closed", prefix_));
+        }
+        // 记录不跨段; 切换时等待当前段写完, 段内的记录总在之后的段之前写入
+        if (segment_bytes_ > 0 && segment_bytes_ + record.size() > options_.segment_bytes) {
+            writer_->close();
+            open_segment(segment_ + 1);
+        }
+        segment_bytes_ += record.size();
+        ++stats_.records;
+        stats_.bytes += record.size();
+        return Ticket{segment_, writer_->append(record)};
+    }
+
+    // 等待此前append的记录全部写入
+    void sync() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (writer_) {
+            writer_->flush();
+        }
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (writer_) {
+            writer_->close();
+            writer_.reset();
+        }
+    }
+
+    uint64_t segment() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return segment_;
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+  private:
+    void open_segment(uint64_t segment) {
+        segment_ = segment;
+        segment_bytes_ = 0;
+        ++stats_.segments;
+        writer_ = std::make_unique<AppendWriter>(store_, WalFormat::segment_key(prefix_, segment_), 0, options_.append);
+    }
+
+    const ObjectStore &store_;
+    const std::string prefix_;
+    const Options options_;
+
+    mutable std::mutex mutex_;
+    std::unique_ptr<AppendWriter> writer_;
+    uint64_t segment_ = 0;
+    // 当前段已经交给writer_的字节数(包括尚未写入的)
+    std::size_t segment_bytes_ = 0;
+    Stats stats_;
+};
+
+/**
+ * @brief 按段的顺序回放WAL, 每段用get_range分块读取, 解析当前块的同时预读下一块
+ * 每段的尾部允许残缺(写入中途失败后WalWriter重新打开, 在新的段中继续写入): 记录不跨段, 该段的回放在残缺处停止,
+ * 计入torn_segments后继续回放下一段; 残缺的尾部是被截断的最后一条记录, 或恰好结束于段末尾的校验失败的记录.
+ * 之前的段中间的记录校验失败(之后还有数据)时抛出异常; 最后一段在第一条校验失败的记录处停止
+ */
+class WalReader {
+  public:
+    struct Options {
+        std::size_t read_bytes = 4 << 20;
+
+        static Options from_config() {
+            return Options{.read_bytes = std::max<std::size_t>(WalFormat::HEADER_SIZE, CONFIG::WAL_READ_BYTES)};
+        }
+    };
+
+    struct Result {
+        std::size_t segments = 0;
+        std::size_t records = 0;
+        // 记录的总字节数, 包括记录头
+        std::size_t bytes = 0;
+        // 尾部有残缺的记录的段数(包括最后一段), 不计入segments
+        std::size_t torn_segments = 0;
+        // 最后一段的尾部有残缺的记录
+        bool torn_tail = false;
+    };
+
+    using RecordCallback = std::function<void(uint64_t segment, std::string_view payload)>;
+
+    WalReader(const ObjectStore &store, std::string prefix, const Options &options = Options::from_config())
+        : store_(store), prefix_(std::move(prefix)), options_(options) {}
+
+    Result replay(const RecordCallback &on_record) const {
+        Result result;
+        auto segments = WalFormat::list_segments(store_, prefix_);
+        for (std::size_t i = 0; i < segments.size(); ++i) {
+            bool last = i + 1 == segments.size();
+            if (replay_segment(segments[i], last, on_record, result)) {
+                ++result.segments;
+            } else {
+                ++result.torn_segments;
+                result.torn_tail = last;
+            }
+        }
+        return result;
+    }
+
+  private:
+    // 返回false表示该段的尾部残缺
+    bool replay_segment(uint64_t segment, bool last, const RecordCallback &on_record, Result &result) const {
+        std::string key = WalFormat::segment_key(prefix_, segment);
+        const std::size_t size = store_.head_object(key);
+        // pending为上一块剩余的不完整记录加上当前块
+        std::string pending;
+        std::string next(std::min(options_.read_bytes, size), '\0');
+        std::size_t offset = 0;
+        std::future<std::size_t> prefetch;
+        // 提前返回或抛出异常时等待在途的预读, 之后才能释放next
+        struct PrefetchGuard {
+            std::future<std::size_t> &prefetch;
+            ~PrefetchGuard() {
+                if (prefetch.valid()) {
+                    prefetch.wait();
+                }
+            }
+        } guard{prefetch};
+        auto fetch = [&](std::size_t at) {
+            std::size_t len = std::min(options_.read_bytes, size - at);
+            next.resize(len);
+            prefetch = store_.async_get_range(key, at, len, next.data());
+        };
+        if (size > 0) {
+            fetch(0);
+        }
+        while (offset < size) {
+            std::size_t read = prefetch.get();
+            if (read != next.size()) {
+                throw ObjectStore::Error(fmt::format("Error in WalReader, key: {}, offset: {}, read: {}, expected: {}", key, offset, read, next.size()));
+            }
+            pending.append(next);
+            offset += read;
+            if (offset < size) {
+                fetch(offset);
+            }
+
+            std::size_t parsed = 0;
+            while (true) {
+                std::string_view payload;
+                std::size_t consumed = 0;
+                auto status = WalFormat::decode(std::string_view(pending).substr(parsed), payload, consumed);
+                if (status == WalFormat::Decode::NEED_MORE) {
+                    break;
+                }
+                if (status == WalFormat::Decode::CORRUPT) {
+                    std::size_t at = offset - pending.size() + parsed;
+                    if (last || at + consumed == size) {
+                        return false;
+                    }
+                    throw ObjectStore::Error(fmt::format("Error in WalReader, key: {}, corrupt record at {}", key, at));
+                }
+                on_record(segment, payload);
+                ++result.records;
+                result.bytes += consumed;
+                parsed += consumed;
+            }
+            pending.erase(0, parsed);
+        }
+        return pending.empty();
+    }
+
+    const ObjectStore &store_;
+    const std::string prefix_;
+    const Options options_;
+};
@@ -0,0 +1,217 @@
+#pragma once
+
+#include "log.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief 常驻的工作线程池, 每次run把同一个task分给前num_workers个线程, 全部就绪后同时放行
+ * 与ThreadPool不同, 这里的线程按编号使用, 第i个task总在第i个线程上执行, 线程在多次run之间复用,
+ * 线程创建、栈和线程局部状态的初始化不会出现在计时区间内; 可以按affinity把线程绑定到CPU上,
+ * 绑定后线程首次写入的内存(first-touch)分配在所在的NUMA节点
+ */
+class WorkerPool {
+  public:
+    // affinity: none(不绑定), compact(按CPU编号依次绑定), numa(依次轮流使用各NUMA节点的CPU), 或CPU列表如"0-7,16-23"
+    explicit WorkerPool(std::string_view affinity = "none") : cpus_(cpu_order(affinity)) {}
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        start_cv_.notify_all();
+        for (auto &worker : workers_) {
+            worker.join();
+        }
+    }
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    // 在前num_workers个线程上执行task(worker_idx); 所有线程都进入屏障后, 先在调用线程上执行on_start
+    // (例如记录开始时间), 再同时放行; 返回时所有task已经结束, 如有异常重新抛出第一个
+    void run(std::size_t num_workers, const std::function<void(std::size_t)> &task, const std::function<void()> &on_start = {}) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (workers_.size() < num_workers) {
+            std::size_t worker_idx = workers_.size();
+            workers_.emplace_back([this, worker_idx]() { worker_loop(worker_idx); });
+        }
+        task_ = &task;
+        active_ = num_workers;
+        ready_ = 0;
+        done_ = 0;
+        released_ = false;
+        first_error_ = nullptr;
+        ++generation_;
+        start_cv_.notify_all();
+
+        done_cv_.wait(lock, [&]() { return ready_ == active_; });
+        if (on_start) {
+            on_start();
+        }
+        released_ = true;
+        start_cv_.notify_all();
+
+        done_cv_.wait(lock, [&]() { return done_ == active_; });
+        task_ = nullptr;
+        if (first_error_) {
+            std::rethrow_exception(first_error_);
+        }
+    }
+
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return workers_.size();
+    }
+
+    // affinity对应的CPU顺序, 第i个线程绑定到cpus[i % cpus.size()]; 为空表示不绑定
+    static std::vector<int> cpu_order(std::string_view affinity) {
+        if (affinity.empty() || affinity == "none") {
+            return {};
+        }
+        std::vector<int> allowed;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        LOG_ASSERT(sched_getaffinity(0, sizeof(set), &set) == 0, "sched_getaffinity failed");
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                allowed.push_back(cpu);
+            }
+        }
+        auto is_allowed = [&](int cpu) { return std::binary_search(allowed.begin(), allowed.end(), cpu); };
+
+        if (affinity == "compact") {
+            return allowed;
+        }
+        if (affinity == "numa") {
+            std::vector<std::vector<int>> nodes;
+            for (int node = 0;; ++node) {
+                std::ifstream ifs(fmt::format("/sys/devices/system/node/node{}/cpulist", node));
+                if (!ifs) {
+                    break;
+                }
+                std::string list;
+                std::getline(ifs, list);
+                std::vector<int> cpus = parse_cpu_list(list);
+                cpus.erase(std::remove_if(cpus.begin(), cpus.end(), [&](int cpu) { return !is_allowed(cpu); }), cpus.end());
+                if (!cpus.empty()) {
+                    nodes.push_back(std::move(cpus));
+                }
+            }
+            if (nodes.empty()) {
+                return allowed;
+            }
+            // 相邻编号的线程落在不同节点上, 线程数较少时也能用到所有节点
+            std::vector<int> order;
+            for (std::size_t i = 0; order.size() < allowed.size(); ++i) {
+                bool any = false;
+                for (const auto &cpus : nodes) {
+                    if (i < cpus.size()) {
+                        order.push_back(cpus[i]);
+                        any = true;
+                    }
+                }
+                if (!any) {
+                    break;
+                }
+            }
+            return order;
+        }
+        std::vector<int> order = parse_cpu_list(affinity);
+        LOG_ASSERT(!order.empty() && std::all_of(order.begin(), order.end(), is_allowed), "invalid cpu list: {}", affinity);
+        return order;
+    }
+
+    // 解析"0-3,8,10-11"格式的CPU列表
+    static std::vector<int> parse_cpu_list(std::string_view list) {
+        std::vector<int> cpus;
+        while (!list.empty()) {
+            std::size_t comma = std::min(list.find(','), list.size());
+            std::string range(list.substr(0, comma));
+            list.remove_prefix(std::min(comma + 1, list.size()));
+            if (range.empty() || range == "\n") {
+                continue;
+            }
+            std::size_t dash = range.find('-');
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        }
+        return cpus;
+    }
+
+  private:
+    void worker_loop(std::size_t worker_idx) {
+        if (!cpus_.empty()) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpus_[worker_idx % cpus_.size()], &set);
+            int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+            LOG_ASSERT(ret == 0, "pthread_setaffinity_np failed: {}", ret);
+        }
+
+        std::size_t seen_generation = 0;
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            start_cv_.wait(lock, [&]() { return stop_ || generation_ != seen_generation; });
+            if (stop_) {
+                return;
+            }
+            seen_generation = generation_;
+            if (worker_idx >= active_) {
+                continue;
+            }
+
+            if (++ready_ == active_) {
+                done_cv_.notify_one();
+            }
+            start_cv_.wait(lock, [&]() { return released_; });
+
+            const auto &task = *task_;
+            lock.unlock();
+            std::exception_ptr error;
+            try {
+                task(worker_idx);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            lock.lock();
+            if (error && !first_error_) {
+                first_error_ = error;
+            }
+            if (++done_ == active_) {
+                done_cv_.notify_one();
+            }
+        }
+    }
+
+    const std::vector<int> cpus_;
+
+    std::vector<std::thread> workers_;
+    mutable std::mutex mutex_;
+    std::condition_variable start_cv_;
+    std::condition_variable done_cv_;
+
+    const std::function<void(std::size_t)> *task_ = nullptr;
+    std::size_t generation_ = 0;
+    std::size_t active_ = 0;
+    std::size_t ready_ = 0;
+    std::size_t done_ = 0;
+    bool released_ = false;
+    bool stop_ = false;
+    std::exception_ptr first_error_;
+};
@@ -0,0 +1,348 @@
+#pragma once
+
+#include "config.h"
+#include "log.h"
+#include "object_store.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief YCSB的Zipfian生成器(Gray等, Quickly Generating Billion-Record Synthetic Databases), 返回[0, items), 0最热
+ * 构造时计算zeta(items)需要O(items); item数增长时(latest分布)只增量计算新增的部分
+ */
+class ZipfianGenerator {
+  public:
+    ZipfianGenerator() = default;
+
+    ZipfianGenerator(uint64_t items, double theta) : theta_(theta), alpha_(1 / (1 - theta)), zeta2_(zeta(0, 2, theta, 0)) {
+        LOG_ASSERT(items > 0 && theta > 0 && theta < 1, "invalid zipfian: items: {}, theta: {}", items, theta);
+        resize(items);
+    }
+
+    uint64_t next(std::mt19937_64 &rng) const {
+        double u = std::uniform_real_distribution<double>(0, 1)(rng);
+        double uz = u * zetan_;
+        if (uz < 1) {
+            return 0;
+        }
+        if (uz < 1 + std::pow(0.5, theta_)) {
+            return 1;
+        }
+        return std::min<uint64_t>(items_ - 1, static_cast<uint64_t>(items_ * std::pow(eta_ * u - eta_ + 1, alpha_)));
+    }
+
+    void resize(uint64_t items) {
+        if (items == items_) {
+            return;
+        }
+        zetan_ = items > items_ ? zeta(items_, items, theta_, zetan_) : zeta(0, items, theta_, 0);
+        items_ = items;
+        eta_ = (1 - std::pow(2.0 / items_, 1 - theta_)) / (1 - zeta2_ / zetan_);
+    }
+
+    uint64_t items() const { return items_; }
+
+  private:
+    // initial + sum(1 / i^theta), i = from + 1, ..., to
+    static double zeta(uint64_t from, uint64_t to, double theta, double initial) {
+        double sum = initial;
+        for (uint64_t i = from; i < to; ++i) {
+            sum += 1 / std::pow(static_cast<double>(i + 1), theta);
+        }
+        return sum;
+    }
+
+    uint64_t items_ = 0;
+    double theta_ = 0.99;
+    double alpha_ = 0;
+    double zeta2_ = 0;
+    double zetan_ = 0;
+    double eta_ = 0;
+};
+
+/**
+ * @brief 对象大小的分布, 由CONFIG::YCSB_VALUE_SIZE描述, 单位字节
+ * fixed:<size>, uniform:<min>:<max>, lognormal:<median>:<sigma>:<max>
+ */
+class SizeDistribution {
+  public:
+    static SizeDistribution parse(std::string_view spec) {
+        std::vector<std::string> fields;
+        std::size_t begin = 0;
+        while (begin <= spec.size()) {
+            std::size_t end = std::min(spec.find(':', begin), spec.size());
+            fields.emplace_back(spec.substr(begin, end - begin));
+            begin = end + 1;
+        }
+        auto arg = [&](std::size_t i) {
+            LOG_ASSERT(i < fields.size(), "invalid size spec: {}", spec);
+            return std::stod(fields[i]);
+        };
+
+        const std::string &kind = fields[0];
+        if (kind == "fixed") {
+            return SizeDistribution(Kind::FIXED, arg(1), 0, arg(1));
+        } else if (kind == "uniform") {
+            return SizeDistribution(Kind::UNIFORM, arg(1), arg(2), arg(2));
+        } else if (kind == "lognormal") {
+            return SizeDistribution(Kind::LOGNORMAL, arg(1), arg(2), arg(3));
+        }
+        LOG_FATAL("invalid size spec: {}", spec);
+    }
+
+    std::size_t sample(std::mt19937_64 &rng) const {
+        double size = a_;
+        switch (kind_) {
+            case Kind::FIXED:
+                break;
+            case Kind::UNIFORM:
+                size = std::uniform_real_distribution<double>(a_, b_)(rng);
+                break;
+            case Kind::LOGNORMAL:
+                size = std::lognormal_distribution<double>(std::log(a_), b_)(rng);
+                break;
+        }
+        return std::clamp<std::size_t>(static_cast<std::size_t>(size), 1, max_);
+    }
+
+    std::size_t max() const { return max_; }
+
+    // 期望值, lognormal不考虑截断
+    double mean() const {
+        switch (kind_) {
+            case Kind::UNIFORM:
+                return (a_ + b_) / 2;
+            case Kind::LOGNORMAL:
+                return std::min<double>(max_, a_ * std::exp(b_ * b_ / 2));
+            default:
+                return a_;
+        }
+    }
+
+  private:
+    enum class Kind { FIXED, UNIFORM, LOGNORMAL };
+
+    SizeDistribution(Kind kind, double a, double b, double max) : kind_(kind), a_(a), b_(b), max_(static_cast<std::size_t>(max)) {
+        LOG_ASSERT(max_ >= 1, "invalid size distribution max: {}", max);
+    }
+
+    Kind kind_;
+    double a_;
+    double b_;
+    std::size_t max_;
+};
+
+/**
+ * @brief YCSB风格的混合负载: 按比例执行get/put/insert/append/list/delete, key的热度服从uniform/zipfian/latest分布
+ * 数据对象为prefix + "user" + hash(index), 装载阶段写入[0, record_count), insert依次写入新的index;
+ * append写入另外append_key_count个"log"对象(OBS不允许追加普通PUT的对象); list从选中的key开始列举一页;
+ * delete之后的get返回NoSuchKey, 与append的位置冲突一样作为该操作的错误计数, 不中断负载
+ */
+class Workload {
+  public:
+    enum Op { GET, PUT, INSERT, APPEND, LIST, DELETE, OP_COUNT };
+
+    static constexpr std::array<std::string_view, OP_COUNT> OP_NAMES = {"get", "put", "insert", "append", "list", "delete"};
+
+    struct Spec {
+        // 各操作的比例, 已归一化
+        std::array<double, OP_COUNT> ratios;
+        uint64_t record_count;
+        // uniform, zipfian(打散的zipfian, 热点分布在整个key空间), latest(最近insert的最热)
+        std::string key_distribution;
+        double zipf_theta;
+        SizeDistribution value_size;
+        uint64_t append_key_count;
+
+        static Spec from_config() {
+            return Spec{
+                .ratios = parse_ops(CONFIG::YCSB_OPS),
+                .record_count = CONFIG::YCSB_RECORD_COUNT,
+                .key_distribution = std::string(CONFIG::YCSB_KEY_DISTRIBUTION),
+                .zipf_theta = CONFIG::YCSB_ZIPF_THETA,
+                .value_size = SizeDistribution::parse(CONFIG::YCSB_VALUE_SIZE),
+                .append_key_count = std::max<uint64_t>(1, CONFIG::YCSB_APPEND_KEY_COUNT),
+            };
+        }
+
+        // "get=0.5,put=0.3,append=0.2", 未出现的操作比例为0
+        static std::array<double, OP_COUNT> parse_ops(std::string_view spec) {
+            std::array<double, OP_COUNT> ratios = {};
+            double total = 0;
+            while (!spec.empty()) {
+                std::size_t comma = std::min(spec.find(','), spec.size());
+                std::string_view item = spec.substr(0, comma);
+                spec.remove_prefix(std::min(comma + 1, spec.size()));
+                std::size_t eq = item.find('=');
+                LOG_ASSERT(eq != std::string_view::npos, "invalid ycsb ops: {}", item);
+                auto it = std::find(OP_NAMES.begin(), OP_NAMES.end(), item.substr(0, eq));
+                LOG_ASSERT(it != OP_NAMES.end(), "unknown ycsb op: {}", item);
+                double ratio = std::stod(std::string(item.substr(eq + 1)));
+                ratios[it - OP_NAMES.begin()] += ratio;
+                total += ratio;
+            }
+            LOG_ASSERT(total > 0, "empty ycsb ops");
+            for (auto &ratio : ratios) {
+                ratio /= total;
+            }
+            return ratios;
+        }
+    };
+
+    // 每个线程一份, 不共享
+    struct ThreadState {
+        std::mt19937_64 rng;
+        ZipfianGenerator zipfian;
+        // get的接收buffer
+        std::string buffer;
+    };
+
+    Workload(const ObjectStore &store, Spec spec, std::string prefix)
+        : store_(store), spec_(std::move(spec)), prefix_(std::move(prefix)), value_(spec_.value_size.max(), 'a'),
+          next_insert_(spec_.record_count) {
+        LOG_ASSERT(spec_.record_count > 0, "YCSB_RECORD_COUNT must be positive");
+        LOG_ASSERT(spec_.key_distribution == "uniform" || spec_.key_distribution == "zipfian" || spec_.key_distribution == "latest",
+                   "unknown key distribution: {}", spec_.key_distribution);
+        if (spec_.key_distribution != "uniform") {
+            zipfian_ = ZipfianGenerator(spec_.record_count, spec_.zipf_theta);
+        }
+    }
+
+    const Spec &spec() const { return spec_; }
+
+    const std::string &prefix() const { return prefix_; }
+
+    // 在使用它的线程上调用, buffer由该线程首次写入
+    ThreadState make_thread_state(uint64_t seed) const {
+        return ThreadState{
+            .rng = std::mt19937_64(seed),
+            .zipfian = zipfian_,
+            .buffer = std::string(spec_.value_size.max(), '\0'),
+        };
+    }
+
+    // 装载阶段写入第index个对象
+    void load(uint64_t index, ThreadState &state) const {
+        store_.put_object(key(index), value(state));
+    }
+
+    std::string key(uint64_t index) const {
+        return fmt::format("{}user{:016x}", prefix_, fnv_hash(index));
+    }
+
+    std::string append_key(uint64_t index) const {
+        return fmt::format("{}log{:016x}", prefix_, fnv_hash(index));
+    }
+
+    // 按比例选择并执行一次操作, 返回执行的操作; 请求失败时计入errors(op)后重新抛出ObjectStore::Error,
+    // 调用方(run_threads)把它计为失败, 不计入该操作的延迟和吞吐
+    Op execute(ThreadState &state) const {
+        Op op = choose_op(state.rng);
+        try {
+            switch (op) {
+                case GET:
+                    store_.get_object(key(next_index(state)), state.buffer.data(), state.buffer.size());
+                    break;
+                case PUT:
+                    store_.put_object(key(next_index(state)), value(state));
+                    break;
+                case INSERT:
+                    store_.put_object(key(next_insert_.fetch_add(1, std::memory_order_relaxed)), value(state));
+                    break;
+                case APPEND: {
+                    std::string log_key = append_key(next_index(state) % spec_.append_key_count);
+                    std::size_t position = 0;
+                    try {
+                        position = store_.head_object(log_key);
+                    } catch (const ObjectStore::Error &e) {
+                        // HEAD的响应没有body, SDK对不存在的key返回HttpErrorNotFound而不是NoSuchKey
+                        if (e.status != OBS_STATUS_NoSuchKey && e.status != OBS_STATUS_HttpErrorNotFound) {
+                            throw;
+                        }
+                    }
+                    store_.append_object(log_key, value(state), position);
+                    break;
+                }
+                case LIST:
+                    store_.list_objects_pages([](std::vector<std::string> &) { return false; }, key(next_index(state)), prefix_);
+                    break;
+                case DELETE:
+                    store_.delete_object(key(next_index(state)));
+                    break;
+                default:
+                    break;
+            }
+        } catch (const ObjectStore::Error &e) {
+            errors_[op].fetch_add(1, std::memory_order_relaxed);
+            LOG_DEBUG("ycsb {} failed: {}", OP_NAMES[op], e.what());
+            throw;
+        }
+        return op;
+    }
+
+    uint64_t errors(Op op) const { return errors_[op].load(std::memory_order_relaxed); }
+
+  private:
+    Op choose_op(std::mt19937_64 &rng) const {
+        double u = std::uniform_real_distribution<double>(0, 1)(rng);
+        for (std::size_t op = 0; op < OP_COUNT; ++op) {
+            if (u < spec_.ratios[op]) {
+                return static_cast<Op>(op);
+            }
+            u -= spec_.ratios[op];
+        }
+        // 浮点误差
+        for (std::size_t op = OP_COUNT; op-- > 0;) {
+            if (spec_.ratios[op] > 0) {
+                return static_cast<Op>(op);
+            }
+        }
+        return GET;
+    }
+
+    // 按key分布选择一个已经写入(或正在insert)的对象
+    uint64_t next_index(ThreadState &state) const {
+        uint64_t count = next_insert_.load(std::memory_order_relaxed);
+        if (spec_.key_distribution == "uniform") {
+            return std::uniform_int_distribution<uint64_t>(0, count - 1)(state.rng);
+        }
+        state.zipfian.resize(count);
+        uint64_t rank = state.zipfian.next(state.rng);
+        if (spec_.key_distribution == "latest") {
+            return count - 1 - rank;
+        }
+        // 与YCSB的ScrambledZipfian相同, 打散后热点不集中在相邻的key上
+        return fnv_hash(rank) % count;
+    }
+
+    std::string_view value(ThreadState &state) const {
+        return std::string_view(value_).substr(0, spec_.value_size.sample(state.rng));
+    }
+
+    static uint64_t fnv_hash(uint64_t value) {
+        uint64_t hash = 0xCBF29CE484222325ULL;
+        for (int i = 0; i < 8; ++i) {
+            hash ^= value & 0xff;
+            hash *= 0x100000001B3ULL;
+            value >>= 8;
+        }
+        return hash;
+    }
+
+    const ObjectStore &store_;
+    const Spec spec_;
+    const std::string prefix_;
+    const std::string value_;
+    ZipfianGenerator zipfian_;
+
+    mutable std::atomic<uint64_t> next_insert_;
+    mutable std::array<std::atomic<uint64_t>, OP_COUNT> errors_ = {};
+};
@@ -0,0 +1,99 @@
+#include "bloom_filter.h"
+#include "config.h"
+#include "log.h"
+#include <benchmark/benchmark.h>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+// SST过滤器(BloomFilter)的误判率和单核查询吞吐, 不访问OBS
+// ./filter_bench --benchmark_filter=probe_batch_avx2
+// range(0)为bits/key, range(1)为key数(1<<16时过滤器在L2中, 1<<22时超出L2);
+// 查询的都是不存在的key, fpr为其中误判的比例, items_per_second为单线程每秒的查询数(哈希事先算好, 不计入)
+
+static constexpr std::size_t PROBE_KEYS = 1 << 20;
+static constexpr std::size_t PROBE_BATCH = 1024;
+
+static std::vector<uint64_t> make_hashes(const char *prefix, std::size_t count) {
+    std::vector<uint64_t> hashes(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        hashes[i] = BloomFilter::hash(fmt::format("{}{:012}", prefix, i));
+    }
+    return hashes;
+}
+
+// 按state的参数构建过滤器, 统计误判率
+static BloomFilter build_filter(benchmark::State &state, const std::vector<uint64_t> &absent) {
+    const std::size_t keys = state.range(1);
+    BloomFilter filter(BloomFilter::build(make_hashes("key", keys), state.range(0)));
+    std::size_t false_positives = 0;
+    for (uint64_t h : absent) {
+        false_positives += filter.may_contain(h);
+    }
+    state.counters["fpr"] = static_cast<double>(false_positives) / absent.size();
+    state.counters["bits_per_key"] = static_cast<double>(filter.bits()) / keys;
+    state.counters["filter_kb"] = filter.bits() / 8 / 1024.0;
+    return filter;
+}
+
+template <typename Probe>
+static void run_probes(benchmark::State &state, const std::vector<uint64_t> &absent, Probe &&probe) {
+    std::unique_ptr<bool[]> results(new bool[PROBE_BATCH]);
+    std::size_t offset = 0;
+    for (auto _ : state) {
+        probe(absent.data() + offset, PROBE_BATCH, results.get());
+        benchmark::DoNotOptimize(results.get());
+        offset = (offset + PROBE_BATCH) % absent.size();
+    }
+    state.SetItemsProcessed(state.iterations() * PROBE_BATCH);
+}
+
+// 逐个key查询
+static void probe_single(benchmark::State &state) {
+    static const auto absent = make_hashes("absent", PROBE_KEYS);
+    BloomFilter filter = build_filter(state, absent);
+    run_probes(state, absent, [&](const uint64_t *hashes, std::size_t count, bool *results) {
+        for (std::size_t i = 0; i < count; ++i) {
+            results[i] = filter.may_contain(hashes[i]);
+        }
+    });
+}
+
+// 批量查询, 不使用AVX2
+static void probe_batch_scalar(benchmark::State &state) {
+    static const auto absent = make_hashes("absent", PROBE_KEYS);
+    BloomFilter filter = build_filter(state, absent);
+    run_probes(state, absent, [&](const uint64_t *hashes, std::size_t count, bool *results) {
+        filter.may_contain_scalar(hashes, count, results);
+    });
+}
+
+// 批量查询, CPU支持AVX2时预取+AVX2比较(SstReader::multi_get的路径)
+static void probe_batch_avx2(benchmark::State &state) {
+    static const auto absent = make_hashes("absent", PROBE_KEYS);
+    BloomFilter filter = build_filter(state, absent);
+    run_probes(state, absent, [&](const uint64_t *hashes, std::size_t count, bool *results) {
+        filter.may_contain(hashes, count, results);
+    });
+}
+
+static void FilterArguments(benchmark::internal::Benchmark *b) {
+    b->ArgsProduct({
+        {6, 8, 10, 12, 16},  // bits/key
+        {1 << 16, 1 << 22}   // key数
+    });
+}
+
+BENCHMARK(probe_single)->Apply(FilterArguments);
+BENCHMARK(probe_batch_scalar)->Apply(FilterArguments);
+BENCHMARK(probe_batch_avx2)->Apply(FilterArguments);
+
+int main(int argc, char **argv) {
+    init_logger();
+    init_all_config();
+    ::benchmark::Initialize(&argc, argv);
+    if (::benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    ::benchmark::RunSpecifiedBenchmarks();
+}
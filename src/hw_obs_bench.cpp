@@ -1,18 +1,33 @@
-#include "huawei_obs.h"
+#include "append_writer.h"
+#include "concurrency_limiter.h"
+#include "histogram.h"
+#include "sst.h"
+#include "object_store_factory.h"
+#include "worker_pool.h"
+#include "trace_replay.h"
+#include "wal.h"
+#include "workload.h"
 #include <fmt/ranges.h>
 #include <atomic>
 #include <benchmark/benchmark.h>
 #include <cstddef>
+#include <ctime>
 #include <eSDKOBS.h>
+#include <filesystem>
+#include <fstream>
 #include <gtest/gtest.h>
 #include <mutex>
+#include <optional>
+#include <random>
 #include <string>
 #include <thread>
+#include <type_traits>
 #include <vector>
 
 class Tracer {
   public:
-    Tracer(const std::string &filename = "results.csv") : filename(filename) {}
+    Tracer(const std::string &filename = "results.csv", const std::string &series_filename = "timeseries.csv", const std::string &concurrency_filename = "concurrency.csv")
+        : filename(filename), series_filename(series_filename), concurrency_filename(concurrency_filename) {}
     struct DataFrameRow {
         std::string type;
         std::size_t threads;
@@ -20,25 +35,83 @@ class Tracer {
         std::size_t total_ops;
         std::size_t loop_count;
         double seconds;
+        // 整个进程(包括SDK内部线程)消耗的CPU时间
+        double cpu_seconds;
         double ops_per_s;
+        double ops_per_cpu_s;
         double mb_per_s;
+        // 延迟单位为ms
         double lat_p50;
         double lat_p90;
         double lat_p99;
-        std::vector<double> latencies;
-        std::vector<std::vector<double>> trace_latencies;
+        double lat_p999;
+        double lat_p9999;
+        double lat_max;
+        // 只统计上传回调中UploadSource::feed填充SDK缓冲区的CPU周期/字节, 不包括请求的其余部分;
+        // 只有使用UploadSource时统计
+        double feed_cycles_per_byte;
+        // closed, constant或poisson; 开环时lat_*从计划发起的时间算起(修正了coordinated omission),
+        // svc_*从实际发起的时间算起, 闭环时两者相同
+        std::string arrival;
+        double target_ops_per_s;
+        double svc_p50;
+        double svc_p99;
+        double svc_p999;
+        double svc_max;
+        // 失败(重试后仍失败)的请求数, 不计入延迟和吞吐
+        std::size_t errors;
+        // 后端内部的重试, 为运行期间整个客户端的合计(包括预热阶段), 重试的耗时包含在对应请求的延迟中
+        std::size_t retries;
+        std::size_t retry_gave_up;
+        std::size_t retry_budget_exhausted;
+        double retry_backoff_s;
+        // 后端发出的对冲请求数和对冲请求先完成的次数, 同样为整个客户端的合计; hedges / total_ops即为额外的负载
+        std::size_t hedges;
+        std::size_t hedge_wins;
+        // 请求发出前在客户端限流器中等待的次数和总时间(包含在延迟中), 与服务端延迟区分
+        std::size_t limiter_waits;
+        double limiter_wait_s;
+        // 所有线程合并后的延迟直方图(ns)
+        Histogram latency;
+        // 每个线程的延迟直方图, Histogram::encode()编码
+        std::vector<std::string> thread_histograms;
     };
 
+    // thread_histograms为每个线程记录的延迟(ns), 合并后计算百分位;
+    // service_histograms为开环时从实际发起算起的延迟, 为空时与thread_histograms相同;
+    // retry、hedge和rate_limit为运行前后ObjectStore::retry_stats()、hedge_stats()和rate_limit_stats()之差
     DataFrameRow append_row(
         std::string type,
         std::size_t threads,
         std::size_t object_size,
         std::size_t loop_count,
         double seconds,
-        const std::vector<double> &latencies,
-        const std::vector<std::vector<double>> & trace_latencies
+        double cpu_seconds,
+        const std::vector<Histogram> &thread_histograms,
+        double feed_cycles_per_byte = 0.0,
+        const std::vector<Histogram> &service_histograms = {},
+        const std::string &arrival = "closed",
+        double target_ops_per_s = 0.0,
+        std::size_t errors = 0,
+        const ObjectStore::RetryStats &retry = {},
+        const ObjectStore::HedgeStats &hedge = {},
+        const ObjectStore::RateLimitStats &rate_limit = {}
     ) {
-        std::size_t total_ops = latencies.size();
+        Histogram latency;
+        std::vector<std::string> encoded;
+        encoded.reserve(thread_histograms.size());
+        for (const auto &histogram : thread_histograms) {
+            latency.merge(histogram);
+            encoded.push_back(histogram.encode());
+        }
+        Histogram service;
+        for (const auto &histogram : service_histograms) {
+            service.merge(histogram);
+        }
+        if (service_histograms.empty()) {
+            service = latency;
+        }
+        std::size_t total_ops = latency.count();
         DataFrameRow row{
             .type = type,
             .threads = threads,
@@ -46,39 +119,197 @@ class Tracer {
             .total_ops = total_ops,
             .loop_count = loop_count,
             .seconds = seconds,
+            .cpu_seconds = cpu_seconds,
             .ops_per_s = total_ops / seconds,
+            .ops_per_cpu_s = cpu_seconds > 0 ? total_ops / cpu_seconds : 0.0,
             .mb_per_s = (total_ops * object_size) / (1024.0 * 1024.0) / seconds,
-            .lat_p50 = get_percentile(latencies, 0.50),
-            .lat_p90 = get_percentile(latencies, 0.90),
-            .lat_p99 = get_percentile(latencies, 0.99),
-            .latencies = latencies,
-            .trace_latencies = trace_latencies
+            .lat_p50 = get_percentile(latency, 0.50),
+            .lat_p90 = get_percentile(latency, 0.90),
+            .lat_p99 = get_percentile(latency, 0.99),
+            .lat_p999 = get_percentile(latency, 0.999),
+            .lat_p9999 = get_percentile(latency, 0.9999),
+            .lat_max = latency.max() / 1e6,
+            .feed_cycles_per_byte = feed_cycles_per_byte,
+            .arrival = arrival,
+            .target_ops_per_s = target_ops_per_s,
+            .svc_p50 = get_percentile(service, 0.50),
+            .svc_p99 = get_percentile(service, 0.99),
+            .svc_p999 = get_percentile(service, 0.999),
+            .svc_max = service.max() / 1e6,
+            .errors = errors,
+            .retries = retry.retries,
+            .retry_gave_up = retry.gave_up,
+            .retry_budget_exhausted = retry.budget_exhausted,
+            .retry_backoff_s = retry.backoff_seconds,
+            .hedges = hedge.hedges,
+            .hedge_wins = hedge.hedge_wins,
+            .limiter_waits = rate_limit.waits,
+            .limiter_wait_s = rate_limit.wait_seconds,
+            .latency = latency,
+            .thread_histograms = std::move(encoded)
         };
         std::unique_lock<std::mutex> lock(mutex_);
         rows_.push_back(row);
         return row;
     }
 
+    // latency_histogram和thread_histograms(以'|'分隔)为Histogram::encode()的编码
     std::string to_csv() {
         std::unique_lock<std::mutex> lock(mutex_);
         std::string buffer;
-        buffer += "type,threads,object_size,total_ops,loop_count,seconds,ops_per_s,mb_per_s,lat_p50,lat_p90,lat_p99,latencies,trace_latencies\n";
+        buffer += "type,threads,object_size,total_ops,loop_count,seconds,cpu_seconds,ops_per_s,ops_per_cpu_s,mb_per_s,lat_p50,lat_p90,lat_p99,lat_p999,lat_p9999,lat_max,feed_cycles_per_byte,arrival,target_ops_per_s,svc_p50,svc_p99,svc_p999,svc_max,errors,retries,retry_gave_up,retry_budget_exhausted,retry_backoff_s,hedges,hedge_wins,limiter_waits,limiter_wait_s,latency_histogram,thread_histograms\n";
         for (const auto &row : rows_) {
             buffer += fmt::format(
-                "{},{},{},{},{},{:.6f},{:.2f},{:.2f},{:.2f},{:.2f},{:.2f},\"{}\",\"{}\"\n",
+                "{},{},{},{},{},{:.6f},{:.6f},{:.2f},{:.2f},{:.2f},{:.3f},{:.3f},{:.3f},{:.3f},{:.3f},{:.3f},{:.4f},{},{:.2f},{:.3f},{:.3f},{:.3f},{:.3f},{},{},{},{},{:.3f},{},{},{},{:.3f},{},{}\n",
                 row.type,
                 row.threads,
                 row.object_size,
                 row.total_ops,
                 row.loop_count,
                 row.seconds,
+                row.cpu_seconds,
                 row.ops_per_s,
+                row.ops_per_cpu_s,
                 row.mb_per_s,
                 row.lat_p50,
                 row.lat_p90,
                 row.lat_p99,
-                row.latencies,
-                row.trace_latencies
+                row.lat_p999,
+                row.lat_p9999,
+                row.lat_max,
+                row.feed_cycles_per_byte,
+                row.arrival,
+                row.target_ops_per_s,
+                row.svc_p50,
+                row.svc_p99,
+                row.svc_p999,
+                row.svc_max,
+                row.errors,
+                row.retries,
+                row.retry_gave_up,
+                row.retry_budget_exhausted,
+                row.retry_backoff_s,
+                row.hedges,
+                row.hedge_wins,
+                row.limiter_waits,
+                row.limiter_wait_s,
+                row.latency.encode(),
+                fmt::join(row.thread_histograms, "|")
+            );
+        }
+        return buffer;
+    }
+
+    // 按秒(从第一个线程启动开始)分桶的延迟直方图
+    using Series = HistogramSeries;
+
+    struct SeriesRow {
+        std::string type;
+        std::size_t threads;
+        std::size_t object_size;
+        std::size_t second;
+        // ramp_up, warmup或run
+        std::string phase;
+        std::size_t ops;
+        double mb_per_s;
+        // 延迟单位为ms
+        double lat_p50;
+        double lat_p99;
+        double lat_max;
+    };
+
+    // ramp_up_end和warmup_end为两个阶段结束的时间(秒), 用于标记每个窗口所处的阶段; 空的窗口也输出, 便于发现停顿;
+    // series的每个窗口为window_seconds秒, second列为窗口开始的时间
+    void append_series(const std::string &type, std::size_t threads, std::size_t object_size, const Series &series, double ramp_up_end, double warmup_end, std::size_t window_seconds = 1) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (std::size_t window = 0; window < series.windows().size(); ++window) {
+            const Histogram &latency = series.windows()[window];
+            const std::size_t second = window * window_seconds;
+            series_rows_.push_back({
+                .type = type,
+                .threads = threads,
+                .object_size = object_size,
+                .second = second,
+                .phase = second < ramp_up_end ? "ramp_up" : second < warmup_end ? "warmup" : "run",
+                .ops = latency.count(),
+                .mb_per_s = (latency.count() * object_size) / (1024.0 * 1024.0) / window_seconds,
+                .lat_p50 = get_percentile(latency, 0.50),
+                .lat_p99 = get_percentile(latency, 0.99),
+                .lat_max = latency.max() / 1e6,
+            });
+        }
+    }
+
+    std::string series_to_csv() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        std::string buffer;
+        buffer += "type,threads,object_size,second,phase,ops,mb_per_s,lat_p50,lat_p99,lat_max\n";
+        for (const auto &row : series_rows_) {
+            buffer += fmt::format(
+                "{},{},{},{},{},{},{:.2f},{:.3f},{:.3f},{:.3f}\n",
+                row.type,
+                row.threads,
+                row.object_size,
+                row.second,
+                row.phase,
+                row.ops,
+                row.mb_per_s,
+                row.lat_p50,
+                row.lat_p99,
+                row.lat_max
+            );
+        }
+        return buffer;
+    }
+
+    // tune_concurrency对每个object_size推荐的并发
+    struct ConcurrencyRow {
+        std::string type;
+        std::size_t object_size;
+        std::size_t concurrency;
+        double ops_per_s;
+        double mb_per_s;
+        double lat_p99;
+        // 为false时直到TUNE_MAX_CONCURRENCY吞吐仍在增长, 推荐值只是测试过的上限
+        bool knee;
+        // 测试过的并发及其吞吐, 以'|'分隔的"并发:ops_per_s:p99"
+        std::string steps;
+    };
+
+    void append_concurrency(const std::string &type, std::size_t object_size, const KneeFinder &finder) {
+        std::vector<std::string> steps;
+        for (const auto &step : finder.steps()) {
+            steps.push_back(fmt::format("{}:{:.2f}:{:.3f}", step.concurrency, step.ops_per_s, step.lat_p99));
+        }
+        const auto &best = finder.best();
+        std::unique_lock<std::mutex> lock(mutex_);
+        concurrency_rows_.push_back({
+            .type = type,
+            .object_size = object_size,
+            .concurrency = best.concurrency,
+            .ops_per_s = best.ops_per_s,
+            .mb_per_s = best.ops_per_s * object_size / (1024.0 * 1024.0),
+            .lat_p99 = best.lat_p99,
+            .knee = finder.reached_knee(),
+            .steps = fmt::format("{}", fmt::join(steps, "|")),
+        });
+    }
+
+    std::string concurrency_to_csv() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        std::string buffer;
+        buffer += "type,object_size,concurrency,ops_per_s,mb_per_s,lat_p99,knee,steps\n";
+        for (const auto &row : concurrency_rows_) {
+            buffer += fmt::format(
+                "{},{},{},{:.2f},{:.2f},{:.3f},{},{}\n",
+                row.type,
+                row.object_size,
+                row.concurrency,
+                row.ops_per_s,
+                row.mb_per_s,
+                row.lat_p99,
+                row.knee ? 1 : 0,
+                row.steps
             );
         }
         return buffer;
@@ -88,53 +319,311 @@ class Tracer {
         std::ofstream ofs(filename);
         ofs << to_csv();
         ofs.close();
+
+        std::ofstream series_ofs(series_filename);
+        series_ofs << series_to_csv();
+        series_ofs.close();
+
+        if (!concurrency_rows_.empty()) {
+            std::ofstream concurrency_ofs(concurrency_filename);
+            concurrency_ofs << concurrency_to_csv();
+            concurrency_ofs.close();
+        }
+    }
+
+    // 单位ms
+    static double get_percentile(const Histogram &latency, double p) {
+        return latency.value_at_quantile(p) / 1e6;
     }
 
-    double get_percentile(std::vector<double> latencies, double p) {
-        if (latencies.empty())
-            return 0.0;
-        std::sort(latencies.begin(), latencies.end());
-        size_t idx = static_cast<size_t>(latencies.size() * p);
-        if (idx >= latencies.size())
-            idx = latencies.size() - 1;
-        return latencies[idx];
+    static uint64_t to_ns(std::chrono::high_resolution_clock::duration duration) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
     }
 
   private:
     std::vector<DataFrameRow> rows_;
+    std::vector<SeriesRow> series_rows_;
+    std::vector<ConcurrencyRow> concurrency_rows_;
     std::mutex mutex_;
 
     std::string filename;
+    std::string series_filename;
+    std::string concurrency_filename;
+};
+
+// 开环压测中一个线程的请求计划: 依次给出每个请求应当发起的时间, 与实际发起的时间无关,
+// 后端卡顿时计划不会随之推迟, 落后的请求在延迟中体现出排队时间
+class ArrivalSchedule {
+  public:
+    using Clock = std::chrono::high_resolution_clock;
+
+    // rate为该线程的请求速率(ops/s), seed区分各线程的泊松过程
+    ArrivalSchedule(std::string_view arrival, double rate, Clock::time_point start, uint64_t seed)
+        : poisson_(arrival == "poisson"), rng_(seed), interval_(rate > 0 ? 1.0 / rate : 0.0), exponential_(rate > 0 ? rate : 1.0), next_(start) {
+        LOG_ASSERT(arrival == "constant" || arrival == "poisson", "unknown arrival: {}", arrival);
+        LOG_ASSERT(rate > 0, "BENCH_RATE must be positive for open-loop arrival: {}", arrival);
+    }
+
+    // 返回下一个请求的计划发起时间
+    Clock::time_point next() {
+        Clock::time_point intended = next_;
+        double gap = poisson_ ? exponential_(rng_) : interval_;
+        next_ += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(gap));
+        return intended;
+    }
+
+  private:
+    bool poisson_;
+    std::mt19937_64 rng_;
+    double interval_;
+    std::exponential_distribution<double> exponential_;
+    Clock::time_point next_;
 };
 
 class OBSBenchmark : public benchmark::Fixture {
   public:
     void SetUp(const ::benchmark::State &state) override {
-        obs_client = HuaweiCloudObs::get_instance();
+        obs_client = get_object_store();
     }
 
     void TearDown(const ::benchmark::State &state) override {}
 
+    // list_objects_parallel的合成桶在各参数组合之间共用, 所有测试结束后清理
+    static void cleanup(const ObjectStore &store) {
+        if (list_bench_prepared) {
+            store.delete_prefix(LIST_BENCH_PREFIX);
+            list_bench_prepared = false;
+        }
+    }
+
   protected:
-    const HuaweiCloudObs * obs_client;
+    const ObjectStore * obs_client;
     static inline Tracer tracer;
 
-    static inline std::size_t LOOP_MIN = 10;
+    // async_put_object一次性提交所有请求, 不支持按时间运行; BENCH_NUMBER_IOS为0时使用该次数
+    static inline std::size_t LOOP_COUNT = 10;
 
-    static inline std::size_t LOOP_MAX = 1000;
+    // get_range使用的共享对象大小为object_size的倍数
+    static inline std::size_t GET_RANGE_OBJECT_FACTOR = 4;
 
-    static inline std::size_t LOOP_COUNT = 10;
+    // parallel_get的分段大小和每个对象的并发数
+    static inline std::size_t PARALLEL_GET_PART_SIZE = 8 << 20;
+
+    static inline std::size_t PARALLEL_GET_CONCURRENCY = 8;
+
+    // list_objects_parallel测试使用的合成桶: LIST_BENCH_PREFIX下LIST_BENCH_KEY_COUNT个十六进制散列key
+    static inline std::string LIST_BENCH_PREFIX = "list_objects_parallel/";
+
+    static inline std::size_t LIST_BENCH_KEY_COUNT = 10000;
+
+    static inline bool list_bench_prepared = false;
 
     std::size_t get_loop_count(std::size_t threads, std::size_t object_size) const {
-        // const int64_t N = LOOP_MIN;
-        // const int64_t total_size_to_write = 16LL * N * (1LL << 30);
-        // const int64_t loop_max = LOOP_MAX;
-        // int64_t loop_count = total_size_to_write / (threads * object_size);
-        // loop_count = std::min(loop_count, loop_max);
-        // if (loop_count == 0) loop_count = 1;
-        // return loop_count;
-        // 计算分布, 使用固定的操作数
-        return LOOP_COUNT;
+        return CONFIG::BENCH_NUMBER_IOS ? CONFIG::BENCH_NUMBER_IOS : LOOP_COUNT;
+    }
+
+    // 启动num_threads个线程, 每个线程循环执行op(thread_idx, loop_idx); 重试由ObjectStore按CONFIG::RETRY_*处理,
+    // op抛出ObjectStore::Error时计入errors后继续, 重试次数和退避时间写入tracer;
+    // 线程在CONFIG::BENCH_RAMP_UP内错开启动, 再经过CONFIG::BENCH_WARMUP后开始测量,
+    // 每个线程测量CONFIG::BENCH_NUMBER_IOS次或运行到CONFIG::BENCH_RUNTIME为止(先到者为准);
+    // 测量阶段的延迟以type写入tracer, 整个运行过程的每秒吞吐和延迟写入tracer的时间序列;
+    // CONFIG::BENCH_ARRIVAL为开环时, 每个线程按ArrivalSchedule发起请求, 延迟从计划发起的时间算起;
+    // 返回写入tracer的行, 没有完成任何请求的type不写入
+    template <typename Op>
+    std::vector<Tracer::DataFrameRow> run_threads(const std::string &type, std::size_t num_threads, std::size_t object_size, Op &&op, const UploadSource *source = nullptr) const {
+        return run_threads(std::vector<std::string>{type}, std::vector<std::size_t>{object_size}, num_threads, std::forward<Op>(op), source);
+    }
+
+    // 混合负载: op返回本次执行的操作在types中的下标, 每种操作的延迟分别统计, 以types[k]和object_sizes[k]各写一行
+    template <typename Op>
+    std::vector<Tracer::DataFrameRow> run_threads(const std::vector<std::string> &types, const std::vector<std::size_t> &object_sizes, std::size_t num_threads, Op &&op, const UploadSource *source = nullptr) const {
+        using Clock = std::chrono::high_resolution_clock;
+        const std::size_t number_ios = CONFIG::BENCH_NUMBER_IOS;
+        LOG_ASSERT(number_ios > 0 || CONFIG::BENCH_RUNTIME > 0, "BENCH_NUMBER_IOS and BENCH_RUNTIME cannot both be 0");
+        const auto seconds = [](double s) { return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(s)); };
+        const auto ramp_up = seconds(CONFIG::BENCH_RAMP_UP);
+        const auto warmup = seconds(CONFIG::BENCH_WARMUP);
+        const bool open_loop = CONFIG::BENCH_ARRIVAL != "closed";
+        const double thread_rate = CONFIG::BENCH_RATE / num_threads;
+        const std::size_t type_count = types.size();
+
+        // 每个线程只写自己的直方图([type][thread]), 结束之后由append_row合并
+        std::vector<std::vector<Histogram>> thread_histograms(type_count, std::vector<Histogram>(num_threads));
+        // 开环时从实际发起算起的延迟, 与thread_histograms对比即为排队的影响
+        std::vector<std::vector<Histogram>> service_histograms(type_count, std::vector<Histogram>(open_loop ? num_threads : 0));
+        std::vector<Tracer::Series> series(type_count);
+
+        // 在所有工作线程就绪后、放行前确定
+        Clock::time_point start_time, measure_start, deadline;
+        // CPU时间从测量开始时统计, 由第一个进入测量阶段的线程记录
+        std::atomic<bool> cpu_started = false;
+        std::clock_t start_cpu = 0;
+        // 测量阶段失败的请求, 无法得知失败时的操作类型, 每一行都写整次运行的合计
+        std::atomic<std::size_t> errors = 0;
+        ObjectStore::RetryStats start_retry;
+        ObjectStore::HedgeStats start_hedge;
+        ObjectStore::RateLimitStats start_rate_limit;
+
+        worker_pool().run(num_threads, [&](std::size_t i) {
+            const auto thread_start = start_time + ramp_up * i / num_threads;
+            std::this_thread::sleep_until(thread_start);
+            std::optional<ArrivalSchedule> schedule;
+            if (open_loop) {
+                schedule.emplace(CONFIG::BENCH_ARRIVAL, thread_rate, thread_start, i);
+            }
+            std::vector<Histogram> second_histograms(type_count);
+            std::size_t second = 0;
+            std::size_t measured = 0;
+            for (std::size_t j = 0; number_ios == 0 || measured < number_ios; ++j) {
+                Clock::time_point intended;
+                if (schedule) {
+                    // 落后于计划时立即发起, 不跳过也不推迟之后的计划
+                    intended = schedule->next();
+                    std::this_thread::sleep_until(intended);
+                }
+                auto now = Clock::now();
+                if (now >= deadline) {
+                    break;
+                }
+                if (now >= measure_start && !cpu_started.load(std::memory_order_relaxed) && !cpu_started.exchange(true)) {
+                    start_cpu = std::clock();
+                }
+                try {
+                    auto t1 = Clock::now();
+
+                    std::size_t k = 0;
+                    if constexpr (std::is_void_v<std::invoke_result_t<Op &, std::size_t, std::size_t>>) {
+                        op(i, j);
+                    } else {
+                        k = op(i, j);
+                    }
+
+                    auto t2 = Clock::now();
+                    uint64_t latency = Tracer::to_ns(t2 - (schedule ? intended : t1));
+                    if (t2 >= measure_start) {
+                        thread_histograms[k][i].record(latency);
+                        if (schedule) {
+                            service_histograms[k][i].record(Tracer::to_ns(t2 - t1));
+                        }
+                        ++measured;
+                    }
+                    std::size_t now_second = std::chrono::duration_cast<std::chrono::seconds>(t2 - start_time).count();
+                    if (now_second != second) {
+                        for (std::size_t t = 0; t < type_count; ++t) {
+                            series[t].merge(second, second_histograms[t]);
+                            second_histograms[t].reset();
+                        }
+                        second = now_second;
+                    }
+                    second_histograms[k].record(latency);
+                } catch (const ObjectStore::Error &e) {
+                    LOG_WARN("Exception: {}", e.what());
+                    if (Clock::now() >= measure_start) {
+                        errors.fetch_add(1, std::memory_order_relaxed);
+                        ++measured;
+                    }
+                }
+            }
+            for (std::size_t t = 0; t < type_count; ++t) {
+                series[t].merge(second, second_histograms[t]);
+            }
+        }, [&]() {
+            start_retry = obs_client->retry_stats();
+            start_hedge = obs_client->hedge_stats();
+            start_rate_limit = obs_client->rate_limit_stats();
+            start_time = Clock::now();
+            measure_start = start_time + ramp_up + warmup;
+            deadline = CONFIG::BENCH_RUNTIME > 0 ? measure_start + seconds(CONFIG::BENCH_RUNTIME) : Clock::time_point::max();
+        });
+
+        auto end_time = Clock::now();
+        double duration_sec = std::chrono::duration<double>(end_time - measure_start).count();
+        double cpu_sec = static_cast<double>(std::clock() - start_cpu) / CLOCKS_PER_SEC;
+        ObjectStore::RetryStats retry = obs_client->retry_stats() - start_retry;
+        ObjectStore::HedgeStats hedge = obs_client->hedge_stats() - start_hedge;
+        ObjectStore::RateLimitStats rate_limit = obs_client->rate_limit_stats() - start_rate_limit;
+        std::vector<Tracer::DataFrameRow> rows;
+        for (std::size_t k = 0; k < type_count; ++k) {
+            // feed_cycles包括预热阶段的请求
+            std::size_t fed_ops = 0;
+            for (const auto &histogram : series[k].windows()) {
+                fed_ops += histogram.count();
+            }
+            // 所有请求都失败时仍写出第一行, 以便看到errors
+            if (fed_ops == 0 && (k > 0 || errors == 0)) {
+                continue;
+            }
+            rows.push_back(tracer.append_row(
+                types[k],
+                num_threads,
+                object_sizes[k],
+                number_ios,
+                duration_sec,
+                cpu_sec,
+                thread_histograms[k],
+                source && fed_ops ? static_cast<double>(source->feed_cycles()) / (fed_ops * object_sizes[k]) : 0.0,
+                service_histograms[k],
+                std::string(CONFIG::BENCH_ARRIVAL),
+                open_loop ? CONFIG::BENCH_RATE : 0.0,
+                errors,
+                retry,
+                hedge,
+                rate_limit
+            ));
+            tracer.append_series(types[k], num_threads, object_sizes[k], series[k], CONFIG::BENCH_RAMP_UP, CONFIG::BENCH_RAMP_UP + CONFIG::BENCH_WARMUP);
+        }
+        tracer.save_csv();
+        return rows;
+    }
+
+    // 每个线程的key前缀, 第j次请求的key为key_prefixes[i] + j
+    static std::vector<std::string> make_key_prefixes(const std::string &prefix, std::size_t num_threads) {
+        std::vector<std::string> key_prefixes(num_threads);
+        for (std::size_t i = 0; i < num_threads; ++i) {
+            key_prefixes[i] = fmt::format("{}threadidx{}_loopcnt", prefix, i);
+        }
+        return key_prefixes;
+    }
+
+    // 从source上传, 与put_object对比上传回调中每字节消耗的CPU周期
+    void run_put_object_source(benchmark::State &state, const std::string &type, UploadSource &source) const {
+        const auto object_size = state.range(0);
+        const auto num_threads = state.range(1);
+        // 每个<thread_index, loop_index>一个唯一的key, 运行次数事先未知, 只预先生成每个线程的前缀
+        std::string prefix = fmt::format("{}_size{}_nthread{}_", type, object_size, num_threads);
+        std::vector<std::string> key_prefixes = make_key_prefixes(prefix, num_threads);
+
+        source.reset_feed_cycles();
+        run_threads(type, num_threads, object_size, [&](std::size_t i, std::size_t j) {
+            obs_client->put_object(key_prefixes[i] + std::to_string(j), source);
+        }, &source);
+
+#ifndef DEBUG
+        obs_client->delete_prefix(prefix);
+#endif
+    }
+
+    // 并发上传读测试所需的对象, 不计入测试时间
+    void prepare_objects(const std::vector<std::string> &keys, const std::string &data) const {
+        worker_pool().run(keys.size(), [&](std::size_t i) {
+            obs_client->put_object(keys[i], data);
+        });
+    }
+
+    // 所有测试共用的常驻工作线程, 第i个线程总是执行run_threads中thread_idx为i的请求;
+    // 每个线程的接收buffer等状态应在该线程上首次写入(见alloc_buffers), 绑定CPU时分配在本地NUMA节点
+    static WorkerPool &worker_pool() {
+        static WorkerPool pool(CONFIG::BENCH_CPU_AFFINITY);
+        return pool;
+    }
+
+    // 每个工作线程分配并写入自己的buffer
+    static std::vector<std::string> alloc_buffers(std::size_t num_threads, std::size_t size) {
+        std::vector<std::string> buffers(num_threads);
+        worker_pool().run(num_threads, [&](std::size_t i) {
+            buffers[i].assign(size, '\0');
+        });
+        return buffers;
     }
 };
 
@@ -145,6 +634,54 @@ std::string generate_data(size_t size) {
 }
 
 BENCHMARK_DEFINE_F(OBSBenchmark, put_object)(benchmark::State &state) {
+    // 只执行一次
+    for (auto _ : state) {
+        const auto object_size = state.range(0);
+        const auto num_threads = state.range(1);
+        std::string data = generate_data(object_size);
+
+        std::string type = "put_object";
+        // 每个<thread_index, loop_index>一个唯一的key, 运行次数事先未知, 只预先生成每个线程的前缀
+        std::string prefix = fmt::format("{}_size{}_nthread{}_", type, object_size, num_threads);
+        std::vector<std::string> key_prefixes = make_key_prefixes(prefix, num_threads);
+
+        // 固定单次PUT, 分段上传见put_object_multipart
+        run_threads(type, num_threads, object_size, [&](std::size_t i, std::size_t j) {
+            obs_client->put_object_single(key_prefixes[i] + std::to_string(j), data);
+        });
+
+#ifndef DEBUG
+        obs_client->delete_prefix(prefix);
+#endif
+    }
+}
+
+// 与put_object相同的<object_size, threads>组合, 每个对象按CONFIG::MULTIPART_PART_SIZE分段并发上传
+BENCHMARK_DEFINE_F(OBSBenchmark, put_object_multipart)(benchmark::State &state) {
+    // 只执行一次
+    for (auto _ : state) {
+        const auto object_size = state.range(0);
+        const auto num_threads = state.range(1);
+        std::string data = generate_data(object_size);
+
+        std::string type = "put_object_multipart";
+        // 每个<thread_index, loop_index>一个唯一的key, 运行次数事先未知, 只预先生成每个线程的前缀
+        std::string prefix = fmt::format("{}_size{}_nthread{}_", type, object_size, num_threads);
+        std::vector<std::string> key_prefixes = make_key_prefixes(prefix, num_threads);
+
+        run_threads(type, num_threads, object_size, [&](std::size_t i, std::size_t j) {
+            obs_client->put_object_multipart(key_prefixes[i] + std::to_string(j), data, CONFIG::MULTIPART_PART_SIZE, CONFIG::MULTIPART_CONCURRENCY);
+        });
+
+#ifndef DEBUG
+        obs_client->delete_prefix(prefix);
+#endif
+    }
+}
+
+// 与put_object相同的请求数, 由当前线程一次性提交num_threads * loop_count个async_put_object,
+// 在CONFIG::ASYNC_THREADS个工作线程上执行; 与put_object对比ops_per_cpu_s
+BENCHMARK_DEFINE_F(OBSBenchmark, async_put_object)(benchmark::State &state) {
     // 只执行一次
     for (auto _ : state) {
         const auto object_size = state.range(0);
@@ -153,7 +690,7 @@ BENCHMARK_DEFINE_F(OBSBenchmark, put_object)(benchmark::State &state) {
 
         const auto loop_count = get_loop_count(num_threads, object_size);
 
-        std::string type = "put_object";
+        std::string type = "async_put_object";
         // 为每个<thread_index, loop_index>创建一个唯一的 key
         std::vector<std::vector<std::string>> keys(num_threads, std::vector<std::string>(loop_count));
         for (int i = 0; i < num_threads; ++i) {
@@ -162,61 +699,68 @@ BENCHMARK_DEFINE_F(OBSBenchmark, put_object)(benchmark::State &state) {
             }
         }
 
-        std::vector<std::thread> threads;
-        threads.reserve(num_threads);
-
-        std::vector<double> group_latencies;
-        std::vector<std::vector<double>> trace_latencies(num_threads);
-        std::mutex lat_mutex;
+        // 每个请求的延迟(从提交到完成)和是否失败写入各自的位置, 不需要加锁
+        std::vector<std::vector<uint64_t>> trace_latencies(num_threads, std::vector<uint64_t>(loop_count));
+        std::vector<std::vector<char>> failed(num_threads, std::vector<char>(loop_count));
+        std::vector<std::future<void>> futures;
+        futures.reserve(num_threads * loop_count);
 
+        auto start_retry = obs_client->retry_stats();
         auto start_time = std::chrono::high_resolution_clock::now();
+        auto start_cpu = std::clock();
 
-        for (int i = 0; i < num_threads; ++i) {
-            threads.emplace_back([&, i, loop_count]() {
-                std::vector<double> thread_local_latencies;
-                thread_local_latencies.reserve(loop_count);
-                for (int j = 0; j < loop_count; ++j) {
-                    for (std::size_t retry_count = 0; retry_count < 3; ++retry_count) {
-                        try {
-                            auto t1 = std::chrono::high_resolution_clock::now();
-
-                            obs_client->put_object(keys[i][j], data);
-                            // std::this_thread::sleep_for(std::chrono::milliseconds(1 + j));
-
-                            auto t2 = std::chrono::high_resolution_clock::now();
-                            double lat_ms = std::chrono::duration<double, std::milli>(t2 - t1).count();
-                            thread_local_latencies.push_back(lat_ms);
-                            break;
-                        } catch (const std::exception &e) {
-                            LOG_WARN("Exception: {} retry_count: {}", e.what(), retry_count);
-                            if (retry_count == 2) {
-                                throw;
-                            }
-                        }
-                    }
-                }
-                std::lock_guard<std::mutex> lock(lat_mutex);
-                group_latencies.insert(group_latencies.end(), thread_local_latencies.begin(), thread_local_latencies.end());
-                trace_latencies[i] = std::move(thread_local_latencies);
-            });
+        for (int j = 0; j < loop_count; ++j) {
+            for (int i = 0; i < num_threads; ++i) {
+                auto t1 = std::chrono::high_resolution_clock::now();
+                futures.push_back(obs_client->async_put_object(keys[i][j], data, [&, i, j, t1](std::exception_ptr error) {
+                    auto t2 = std::chrono::high_resolution_clock::now();
+                    trace_latencies[i][j] = Tracer::to_ns(t2 - t1);
+                    failed[i][j] = error != nullptr;
+                }));
+            }
         }
-
-        for (auto &t : threads) {
-            t.join();
+        // 先等待所有请求完成, 回调不再写trace_latencies之后才取结果; 失败的请求只计入errors
+        for (auto &future : futures) {
+            future.wait();
+        }
+        std::size_t errors = 0;
+        for (auto &future : futures) {
+            try {
+                future.get();
+            } catch (const ObjectStore::Error &) {
+                ++errors;
+            }
         }
 
         auto end_time = std::chrono::high_resolution_clock::now();
         double duration_sec = std::chrono::duration<double>(end_time - start_time).count();
+        double cpu_sec = static_cast<double>(std::clock() - start_cpu) / CLOCKS_PER_SEC;
+
+        std::vector<Histogram> thread_histograms(num_threads);
+        for (int i = 0; i < num_threads; ++i) {
+            for (int j = 0; j < loop_count; ++j) {
+                if (!failed[i][j]) {
+                    thread_histograms[i].record(trace_latencies[i][j]);
+                }
+            }
+        }
         tracer.append_row(
             type,
             num_threads,
             object_size,
             loop_count,
             duration_sec,
-            group_latencies,
-            trace_latencies
+            cpu_sec,
+            thread_histograms,
+            0.0,
+            {},
+            "closed",
+            0.0,
+            errors,
+            obs_client->retry_stats() - start_retry
         );
         tracer.save_csv();
+        state.counters["errors"] = errors;
 
 #ifndef DEBUG
         std::vector<std::string> group_keys;
@@ -228,6 +772,56 @@ BENCHMARK_DEFINE_F(OBSBenchmark, put_object)(benchmark::State &state) {
     }
 }
 
+// 与put_object相同的数据, 经UploadSource拷贝一次到SDK缓冲区
+BENCHMARK_DEFINE_F(OBSBenchmark, put_object_buffer_source)(benchmark::State &state) {
+    // 只执行一次
+    for (auto _ : state) {
+        std::string data = generate_data(state.range(0));
+        BufferSource source(data);
+        run_put_object_source(state, "put_object_buffer_source", source);
+    }
+}
+
+// 数据事先准备在BufferPool预分配的buffer中, 经PooledBufferSource上传
+BENCHMARK_DEFINE_F(OBSBenchmark, put_object_pool_source)(benchmark::State &state) {
+    // 只执行一次
+    for (auto _ : state) {
+        const std::size_t object_size = state.range(0);
+        BufferPool pool(1, object_size);
+        BufferPool::Buffer buffer = pool.try_acquire();
+        std::string data = generate_data(object_size);
+        memcpy(buffer.data(), data.data(), object_size);
+        PooledBufferSource source(std::move(buffer), object_size);
+        run_put_object_source(state, "put_object_pool_source", source);
+    }
+}
+
+// 从mmap的临时文件上传
+BENCHMARK_DEFINE_F(OBSBenchmark, put_object_mmap_source)(benchmark::State &state) {
+    // 只执行一次
+    for (auto _ : state) {
+        std::string path = (std::filesystem::temp_directory_path() / fmt::format("hw_obs_bench_size{}", state.range(0))).string();
+        {
+            std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+            ofs << generate_data(state.range(0));
+        }
+        {
+            MappedFileSource source(path);
+            run_put_object_source(state, "put_object_mmap_source", source);
+        }
+        std::filesystem::remove(path);
+    }
+}
+
+// 数据直接生成在SDK缓冲区中, 没有源buffer的拷贝
+BENCHMARK_DEFINE_F(OBSBenchmark, put_object_generator_source)(benchmark::State &state) {
+    // 只执行一次
+    for (auto _ : state) {
+        GeneratorSource source = GeneratorSource::filled(state.range(0), 'a');
+        run_put_object_source(state, "put_object_generator_source", source);
+    }
+}
+
 BENCHMARK_DEFINE_F(OBSBenchmark, append_object)(benchmark::State &state) {
     // 只执行一次
     for (auto _ : state) {
@@ -235,8 +829,6 @@ BENCHMARK_DEFINE_F(OBSBenchmark, append_object)(benchmark::State &state) {
         const auto num_threads = state.range(1);
         std::string data = generate_data(object_size);
 
-        const auto loop_count = get_loop_count(num_threads, object_size);
-
         std::string type = "append_object";
         // 为每个thread创建一个唯一的 key
         std::vector<std::string> keys(num_threads);
@@ -244,86 +836,494 @@ BENCHMARK_DEFINE_F(OBSBenchmark, append_object)(benchmark::State &state) {
             keys[i] = fmt::format("{}_size{}_nthread{}_threadidx{}", type, object_size, num_threads, i);
         }
 
-        std::vector<std::thread> threads;
-        threads.reserve(num_threads);
+        // 每个线程追加写自己的key, next_start_pos在重试之间保持
+        std::vector<std::size_t> next_start_pos(num_threads, 0);
+        run_threads(type, num_threads, object_size, [&](std::size_t i, std::size_t j) {
+            next_start_pos[i] = obs_client->append_object(keys[i], data, next_start_pos[i]);
+        });
 
-        std::vector<double> group_latencies;
-        std::vector<std::vector<double>> trace_latencies(num_threads);
-        std::mutex lat_mutex;
+#ifndef DEBUG
+        obs_client->delete_objects(keys);
+#endif
+    }
+}
 
-        auto start_time = std::chrono::high_resolution_clock::now();
+// 所有线程的记录经AppendWriter合并后追加到同一个key, 每个线程等待自己的记录写入后再写下一条,
+// 延迟即为记录的提交延迟; 与append_object(每个线程一个key, 每条记录一次请求)对比
+BENCHMARK_DEFINE_F(OBSBenchmark, append_writer)(benchmark::State &state) {
+    for (auto _ : state) {
+        const auto object_size = state.range(0);
+        const auto num_threads = state.range(1);
+        std::string data = generate_data(object_size);
 
+        std::string type = "append_writer";
+        std::string key = fmt::format("{}_size{}_nthread{}", type, object_size, num_threads);
+        AppendWriter writer(*obs_client, key);
+        run_threads(type, num_threads, object_size, [&](std::size_t i, std::size_t j) {
+            writer.append(data).get();
+        });
+        writer.close();
+
+        auto stats = writer.stats();
+        state.counters["flushes"] = stats.flushes;
+        state.counters["records_per_flush"] = stats.flushes ? static_cast<double>(stats.records) / stats.flushes : 0.0;
+#ifndef DEBUG
+        obs_client->delete_object(key);
+#endif
+    }
+}
+
+// 每个线程同步提交WAL记录(等待组提交完成再写下一条), 不同线程数下的吞吐和提交延迟(lat_*);
+// 之后回放写入的所有段, replay_mb_per_s为恢复时的读取速度
+BENCHMARK_DEFINE_F(OBSBenchmark, wal)(benchmark::State &state) {
+    for (auto _ : state) {
+        const auto object_size = state.range(0);
+        const auto num_threads = state.range(1);
+        std::string data = generate_data(object_size);
+
+        std::string type = "wal_commit";
+        std::string prefix = fmt::format("{}_size{}_nthread{}/", type, object_size, num_threads);
+        WalWriter wal(*obs_client, prefix);
+        run_threads(type, num_threads, object_size, [&](std::size_t i, std::size_t j) {
+            wal.append(data).end.get();
+        });
+        wal.close();
+
+        auto t1 = std::chrono::steady_clock::now();
+        auto result = WalReader(*obs_client, prefix).replay([](uint64_t segment, std::string_view payload) {});
+        double replay_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t1).count();
+        state.counters["segments"] = wal.stats().segments;
+        state.counters["replay_records"] = result.records;
+        state.counters["replay_mb_per_s"] = result.bytes / (1024.0 * 1024.0) / replay_seconds;
+#ifndef DEBUG
+        obs_client->delete_prefix(prefix);
+#endif
+    }
+}
+
+// 流式写入约64MB的SST(数据块CONFIG::SST_BLOCK_BYTES, 段大小CONFIG::MULTIPART_PART_SIZE), 再由各线程随机点查已有的key;
+// lat_*为点查延迟, gets_per_lookup为每次点查的GET次数(应为1), open_gets为打开时的GET次数(不含HEAD)
+BENCHMARK_DEFINE_F(OBSBenchmark, sst)(benchmark::State &state) {
+    for (auto _ : state) {
+        const auto value_size = state.range(0);
+        const auto num_threads = state.range(1);
+        const std::size_t entries = std::max<std::size_t>(1, (64 << 20) / value_size);
+        std::string value = generate_data(value_size);
+
+        std::string key = fmt::format("sst_size{}_nthread{}", value_size, num_threads);
+        auto t1 = std::chrono::steady_clock::now();
+        SstWriter writer(*obs_client, key);
+        for (std::size_t i = 0; i < entries; ++i) {
+            writer.add(fmt::format("key{:012}", i), value, i + 1);
+        }
+        auto result = writer.finish();
+        double write_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t1).count();
+
+        SstReader reader(*obs_client, key, result.size);
+        std::vector<std::mt19937_64> rngs(num_threads);
+        for (std::size_t i = 0; i < rngs.size(); ++i) {
+            rngs[i].seed(i);
+        }
+        std::atomic<std::size_t> lookups = 0;
+        run_threads("sst_get", num_threads, value_size, [&](std::size_t i, std::size_t j) {
+            if (!reader.get(fmt::format("key{:012}", rngs[i]() % entries))) {
+                throw ObjectStore::Error(fmt::format("Error in sst benchmark, key: {}, lookup missed", key));
+            }
+            lookups.fetch_add(1, std::memory_order_relaxed);
+        });
+
+        auto stats = reader.stats();
+        state.counters["sst_mb"] = result.size / (1024.0 * 1024.0);
+        state.counters["write_mb_per_s"] = result.size / (1024.0 * 1024.0) / write_seconds;
+        state.counters["parts"] = result.parts;
+        state.counters["index_kb"] = result.index_bytes / 1024.0;
+        state.counters["filter_kb"] = result.filter_bytes / 1024.0;
+        state.counters["open_gets"] = stats.open_reads;
+        state.counters["gets_per_lookup"] = lookups ? static_cast<double>(stats.block_reads) / lookups : 0.0;
+#ifndef DEBUG
+        obs_client->delete_object(key);
+#endif
+    }
+}
+
+BENCHMARK_DEFINE_F(OBSBenchmark, get_object)(benchmark::State &state) {
+    // 只执行一次
+    for (auto _ : state) {
+        const auto object_size = state.range(0);
+        const auto num_threads = state.range(1);
+        std::string data = generate_data(object_size);
+
+        std::string type = "get_object";
+        // 为每个thread创建一个唯一的 key, 每个线程重复读取自己的key
+        std::vector<std::string> keys(num_threads);
         for (int i = 0; i < num_threads; ++i) {
-            threads.emplace_back([&, i, loop_count]() {
-                std::vector<double> thread_local_latencies;
-                thread_local_latencies.reserve(loop_count);
-                std::size_t next_start_pos = 0;
-                for (int j = 0; j < loop_count; ++j) {
-                    for (std::size_t retry_count = 0; retry_count < 3; ++retry_count) {
-                        try {
-                            auto t1 = std::chrono::high_resolution_clock::now();
-
-                            next_start_pos = obs_client->append_object(keys[i], data, next_start_pos);
-                            // std::this_thread::sleep_for(std::chrono::milliseconds(1 + j));
-
-                            auto t2 = std::chrono::high_resolution_clock::now();
-                            double lat_ms = std::chrono::duration<double, std::milli>(t2 - t1).count();
-                            thread_local_latencies.push_back(lat_ms);
-                            break;
-                        } catch (const std::exception &e) {
-                            LOG_WARN("Exception: {} retry_count: {}", e.what(), retry_count);
-                            if (retry_count == 2) {
-                                throw;
-                            }
-                        }
-                    }
-                }
-                std::lock_guard<std::mutex> lock(lat_mutex);
-                group_latencies.insert(group_latencies.end(), thread_local_latencies.begin(), thread_local_latencies.end());
-                trace_latencies[i] = std::move(thread_local_latencies);
-            });
+            keys[i] = fmt::format("{}_size{}_nthread{}_threadidx{}", type, object_size, num_threads, i);
+        }
+        prepare_objects(keys, data);
+
+        // 每个线程独立的接收buffer, 提前分配避免首次访问计入测试时间
+        std::vector<std::string> buffers = alloc_buffers(num_threads, object_size);
+
+        run_threads(type, num_threads, object_size, [&](std::size_t i, std::size_t j) {
+            std::size_t read = obs_client->get_object(keys[i], buffers[i].data(), buffers[i].size());
+            LOG_ASSERT(read == static_cast<std::size_t>(object_size), "read: {}, expected: {}", read, object_size);
+        });
+
+#ifndef DEBUG
+        obs_client->delete_objects(keys);
+#endif
+    }
+}
+
+BENCHMARK_DEFINE_F(OBSBenchmark, get_range)(benchmark::State &state) {
+    // 只执行一次
+    for (auto _ : state) {
+        const auto object_size = state.range(0);
+        const auto num_threads = state.range(1);
+
+        std::string type = "get_range";
+        // 所有线程从同一个大小为GET_RANGE_OBJECT_FACTOR * object_size的对象中读取object_size大小的范围
+        std::vector<std::string> keys = {fmt::format("{}_size{}_nthread{}", type, object_size, num_threads)};
+        prepare_objects(keys, generate_data(GET_RANGE_OBJECT_FACTOR * object_size));
+
+        std::vector<std::string> buffers = alloc_buffers(num_threads, object_size);
+
+        run_threads(type, num_threads, object_size, [&](std::size_t i, std::size_t j) {
+            std::size_t offset = ((i + j) % GET_RANGE_OBJECT_FACTOR) * object_size;
+            std::size_t read = obs_client->get_range(keys[0], offset, object_size, buffers[i].data());
+            LOG_ASSERT(read == static_cast<std::size_t>(object_size), "read: {}, expected: {}", read, object_size);
+        });
+
+#ifndef DEBUG
+        obs_client->delete_objects(keys);
+#endif
+    }
+}
+
+// 与get_object相同的<object_size, threads>组合, 每次读取按PARALLEL_GET_PART_SIZE分段并发
+BENCHMARK_DEFINE_F(OBSBenchmark, parallel_get)(benchmark::State &state) {
+    // 只执行一次
+    for (auto _ : state) {
+        const auto object_size = state.range(0);
+        const auto num_threads = state.range(1);
+        std::string data = generate_data(object_size);
+
+        std::string type = "parallel_get";
+        std::vector<std::string> keys(num_threads);
+        for (int i = 0; i < num_threads; ++i) {
+            keys[i] = fmt::format("{}_size{}_nthread{}_threadidx{}", type, object_size, num_threads, i);
+        }
+        prepare_objects(keys, data);
+
+        std::vector<std::string> buffers = alloc_buffers(num_threads, object_size);
+
+        run_threads(type, num_threads, object_size, [&](std::size_t i, std::size_t j) {
+            std::size_t read = obs_client->parallel_get(keys[i], buffers[i].data(), buffers[i].size(), PARALLEL_GET_PART_SIZE, PARALLEL_GET_CONCURRENCY);
+            LOG_ASSERT(read == static_cast<std::size_t>(object_size), "read: {}, expected: {}", read, object_size);
+        });
+
+#ifndef DEBUG
+        obs_client->delete_objects(keys);
+#endif
+    }
+}
+
+// YCSB风格的混合负载: 先由各线程写入CONFIG::YCSB_RECORD_COUNT个对象(不计时), 再按CONFIG::YCSB_OPS的比例执行,
+// 每种操作在tracer中各占一行(ycsb_get, ycsb_put, ...), 只统计成功的请求; 失败的请求计入errors列(所有操作的合计),
+// 每种操作失败的请求数记在ycsb_<op>_errors计数器中
+BENCHMARK_DEFINE_F(OBSBenchmark, ycsb)(benchmark::State &state) {
+    // 只执行一次
+    for (auto _ : state) {
+        const auto num_threads = state.range(0);
+
+        Workload workload(*obs_client, Workload::Spec::from_config(), fmt::format("ycsb_nthread{}_", num_threads));
+        const uint64_t record_count = workload.spec().record_count;
+
+        // 线程状态(包括接收buffer)在各自的工作线程上创建
+        std::vector<Workload::ThreadState> states(num_threads);
+        worker_pool().run(num_threads, [&](std::size_t i) {
+            states[i] = workload.make_thread_state(i);
+            for (uint64_t index = i; index < record_count; index += num_threads) {
+                workload.load(index, states[i]);
+            }
+        });
+
+        std::vector<std::string> types;
+        std::vector<std::size_t> object_sizes;
+        const std::size_t mean_size = workload.spec().value_size.mean();
+        for (std::size_t op = 0; op < Workload::OP_COUNT; ++op) {
+            types.push_back(fmt::format("ycsb_{}", Workload::OP_NAMES[op]));
+            // list和delete不传输对象内容
+            object_sizes.push_back(op == Workload::LIST || op == Workload::DELETE ? 0 : mean_size);
+        }
+
+        run_threads(types, object_sizes, num_threads, [&](std::size_t i, std::size_t j) {
+            return static_cast<std::size_t>(workload.execute(states[i]));
+        });
+
+        for (std::size_t op = 0; op < Workload::OP_COUNT; ++op) {
+            state.counters[fmt::format("ycsb_{}_errors", Workload::OP_NAMES[op])] = workload.errors(static_cast<Workload::Op>(op));
         }
 
-        for (auto &t : threads) {
-            t.join();
+#ifndef DEBUG
+        obs_client->delete_prefix(workload.prefix());
+#endif
+    }
+}
+
+// 按CONFIG::REPLAY_SPEED回放CONFIG::REPLAY_TRACE中的请求, range(0)个线程执行;
+// 每种操作在tracer中各占一行(replay_get, replay_put, ...), object_size为该操作成功请求的平均大小,
+// 失败的请求只计入errors; 时间序列按CONFIG::REPLAY_WINDOW秒的窗口统计
+BENCHMARK_DEFINE_F(OBSBenchmark, replay)(benchmark::State &state) {
+    // 只执行一次
+    for (auto _ : state) {
+        if (CONFIG::REPLAY_TRACE.empty()) {
+            state.SkipWithError("CONFIG_REPLAY_TRACE is not set");
+            break;
+        }
+        std::ifstream trace{std::string(CONFIG::REPLAY_TRACE)};
+        if (!trace) {
+            state.SkipWithError("cannot open CONFIG_REPLAY_TRACE");
+            break;
+        }
+        const auto num_threads = state.range(0);
+        const std::string prefix = fmt::format("replay_nthread{}_", num_threads);
+
+        TraceReplayer replayer(*obs_client, TraceReplayer::Options{
+            .speed = CONFIG::REPLAY_SPEED,
+            .key_prefix = prefix,
+            .fill_missing = CONFIG::REPLAY_FILL_MISSING != 0,
+            .window_seconds = std::max<std::size_t>(1, CONFIG::REPLAY_WINDOW),
+        });
+        auto start_retry = obs_client->retry_stats();
+        auto result = replayer.replay(trace, worker_pool(), num_threads);
+        auto retry = obs_client->retry_stats() - start_retry;
+
+        for (std::size_t op = 0; op < TraceRecord::OP_COUNT; ++op) {
+            uint64_t ops = 0;
+            for (const auto &histogram : result.latency[op]) {
+                ops += histogram.count();
+            }
+            // 只有失败请求的操作也输出一行, 以便看到errors
+            if (ops == 0 && result.errors[op] == 0) {
+                continue;
+            }
+            std::string type = fmt::format("replay_{}", TraceRecord::OP_NAMES[op]);
+            std::size_t object_size = ops > 0 ? result.bytes[op] / ops : 0;
+            tracer.append_row(
+                type,
+                num_threads,
+                object_size,
+                0,
+                result.seconds,
+                result.cpu_seconds,
+                result.latency[op],
+                0.0,
+                result.service[op],
+                "replay",
+                CONFIG::REPLAY_SPEED,
+                result.errors[op],
+                retry
+            );
+            tracer.append_series(type, num_threads, object_size, result.series[op], 0, 0, std::max<std::size_t>(1, CONFIG::REPLAY_WINDOW));
+            state.counters[fmt::format("{}_errors", type)] = result.errors[op];
         }
+        tracer.save_csv();
+        state.counters["records"] = result.records;
+        state.counters["skipped_lines"] = result.skipped_lines;
+
+#ifndef DEBUG
+        obs_client->delete_prefix(prefix);
+#endif
+    }
+}
+
+// 在合成桶上按线程数测量list_objects_parallel的keys/s, range(1)为1时按key顺序输出
+BENCHMARK_DEFINE_F(OBSBenchmark, list_objects_parallel)(benchmark::State &state) {
+    // 合成桶只创建一次, 由cleanup在所有测试结束后清理
+    static std::once_flag prepare_once;
+    std::call_once(prepare_once, [&]() {
+        std::vector<std::future<void>> futures;
+        futures.reserve(LIST_BENCH_KEY_COUNT);
+        for (std::size_t i = 0; i < LIST_BENCH_KEY_COUNT; ++i) {
+            std::string key = fmt::format("{}{:016x}", LIST_BENCH_PREFIX, std::hash<std::size_t>{}(i) * 0x9E3779B97F4A7C15ULL);
+            futures.push_back(obs_client->async_put_object(std::move(key), "x"));
+        }
+        list_bench_prepared = true;
+        for (auto &future : futures) {
+            future.get();
+        }
+    });
+
+    // 只执行一次
+    for (auto _ : state) {
+        const auto num_threads = state.range(0);
+        const bool ordered = state.range(1);
+
+        std::string type = ordered ? "list_objects_parallel_ordered" : "list_objects_parallel";
+        auto boundaries = ObjectStore::make_shard_boundaries(LIST_BENCH_PREFIX, "0123456789abcdef");
+
+        // 每页的延迟为与上一页之间的间隔
+        std::vector<Histogram> page_latencies(1);
+        std::size_t key_count = 0;
+
+        auto start_retry = obs_client->retry_stats();
+        auto start_time = std::chrono::high_resolution_clock::now();
+        auto start_cpu = std::clock();
+        auto last_page_time = start_time;
+
+        obs_client->list_objects_parallel([&](std::vector<std::string> &page) {
+            auto now = std::chrono::high_resolution_clock::now();
+            page_latencies[0].record(Tracer::to_ns(now - last_page_time));
+            last_page_time = now;
+            key_count += page.size();
+            return true;
+        }, boundaries, num_threads, ordered, LIST_BENCH_PREFIX);
 
         auto end_time = std::chrono::high_resolution_clock::now();
         double duration_sec = std::chrono::duration<double>(end_time - start_time).count();
+        double cpu_sec = static_cast<double>(std::clock() - start_cpu) / CLOCKS_PER_SEC;
+
+        LOG_ASSERT(key_count == LIST_BENCH_KEY_COUNT, "listed: {}, expected: {}", key_count, LIST_BENCH_KEY_COUNT);
+        state.counters["keys_per_s"] = key_count / duration_sec;
+
+        // 每页作为一次操作
         tracer.append_row(
             type,
             num_threads,
-            object_size,
-            loop_count,
+            0,
+            1,
             duration_sec,
-            group_latencies,
-            trace_latencies
+            cpu_sec,
+            page_latencies,
+            0.0,
+            {},
+            "closed",
+            0.0,
+            0,
+            obs_client->retry_stats() - start_retry
         );
         tracer.save_csv();
+    }
+}
+
+// 对每个object_size从1开始按CONFIG::TUNE_STEP_FACTOR增加并发做put_object, 每一步按BENCH_*运行,
+// 吞吐不再明显增长(或p99明显变差)时停止, 推荐的并发写入concurrency.csv, 每一步的结果同样写入results.csv
+BENCHMARK_DEFINE_F(OBSBenchmark, tune_concurrency)(benchmark::State &state) {
+    for (auto _ : state) {
+        const auto object_size = state.range(0);
+        std::string data = generate_data(object_size);
+        std::string type = "tune_put_object";
+        LOG_ASSERT(CONFIG::BENCH_ARRIVAL == "closed", "tune_concurrency requires closed-loop arrival");
+        LOG_ASSERT(CONFIG::TUNE_STEP_FACTOR > 1, "TUNE_STEP_FACTOR must be greater than 1: {}", CONFIG::TUNE_STEP_FACTOR);
+
+        KneeFinder finder(CONFIG::TUNE_MIN_GAIN, CONFIG::TUNE_MAX_P99_GROWTH, CONFIG::TUNE_PATIENCE);
+        for (std::size_t num_threads = 1; num_threads <= CONFIG::TUNE_MAX_CONCURRENCY;) {
+            std::string prefix = fmt::format("{}_size{}_nthread{}_", type, object_size, num_threads);
+            std::vector<std::string> key_prefixes = make_key_prefixes(prefix, num_threads);
+            auto rows = run_threads(type, num_threads, object_size, [&](std::size_t i, std::size_t j) {
+                obs_client->put_object_single(key_prefixes[i] + std::to_string(j), data);
+            });
+#ifndef DEBUG
+            obs_client->delete_prefix(prefix);
+#endif
+            if (rows.empty() || !finder.observe({num_threads, rows.front().ops_per_s, rows.front().lat_p99})) {
+                break;
+            }
+            num_threads = std::max(num_threads + 1, static_cast<std::size_t>(num_threads * CONFIG::TUNE_STEP_FACTOR));
+        }
+        if (finder.steps().empty()) {
+            state.SkipWithError("no request completed");
+            break;
+        }
+
+        tracer.append_concurrency(type, object_size, finder);
+        tracer.save_csv();
+        state.counters["concurrency"] = finder.best().concurrency;
+        state.counters["ops_per_s"] = finder.best().ops_per_s;
+        state.counters["lat_p99_ms"] = finder.best().lat_p99;
+    }
+}
+
+// 同样的GET/小PUT负载分别关闭和打开对冲(state.range(2)), 比较lat_p99/lat_p999和hedges(额外负载)
+BENCHMARK_DEFINE_F(OBSBenchmark, hedge)(benchmark::State &state) {
+    for (auto _ : state) {
+        const auto object_size = state.range(0);
+        const auto num_threads = state.range(1);
+        const bool hedge = state.range(2);
+        std::string data = generate_data(object_size);
+        // 抛出异常时也恢复CONFIG::HEDGE_ENABLE, 不影响之后的测试
+        struct HedgeEnableGuard {
+            const std::size_t saved = CONFIG::HEDGE_ENABLE;
+            ~HedgeEnableGuard() { CONFIG::HEDGE_ENABLE = saved; }
+        } guard;
+        CONFIG::HEDGE_ENABLE = hedge;
+        auto start_hedge = obs_client->hedge_stats();
+
+        std::string get_type = fmt::format("get_object_hedge_{}", hedge ? "on" : "off");
+        std::vector<std::string> keys(num_threads);
+        for (int i = 0; i < num_threads; ++i) {
+            keys[i] = fmt::format("{}_size{}_nthread{}_threadidx{}", get_type, object_size, num_threads, i);
+        }
+        prepare_objects(keys, data);
+        std::vector<std::string> buffers = alloc_buffers(num_threads, object_size);
+        run_threads(get_type, num_threads, object_size, [&](std::size_t i, std::size_t j) {
+            std::size_t read = obs_client->get_object(keys[i], buffers[i].data(), buffers[i].size());
+            LOG_ASSERT(read == static_cast<std::size_t>(object_size), "read: {}, expected: {}", read, object_size);
+        });
 
+        // 每个<thread_index, loop_index>一个唯一的key, 可以用put_object_unique对冲
+        std::string put_type = fmt::format("put_object_hedge_{}", hedge ? "on" : "off");
+        std::string prefix = fmt::format("{}_size{}_nthread{}_", put_type, object_size, num_threads);
+        std::vector<std::string> key_prefixes = make_key_prefixes(prefix, num_threads);
+        run_threads(put_type, num_threads, object_size, [&](std::size_t i, std::size_t j) {
+            obs_client->put_object_unique(key_prefixes[i] + std::to_string(j), data);
+        });
+
+        auto stats = obs_client->hedge_stats() - start_hedge;
 #ifndef DEBUG
         obs_client->delete_objects(keys);
+        obs_client->delete_prefix(prefix);
 #endif
+        state.counters["hedges"] = stats.hedges;
+        state.counters["hedge_wins"] = stats.hedge_wins;
+        state.counters["extra_load"] = stats.requests ? static_cast<double>(stats.hedges) / stats.requests : 0.0;
     }
 }
 
-// loop_min=N               最少循环次数
-// loop_max=1000            最大循环次数
-// size=128*128*N=16N GB    最大写入大小
 // threads=1-128            并发(2x)
 // object_size=1KB-128MB    访问粒度(2x)
-// 比如, threads=128, object_size=128MB时:
-// put_object(content=data[size=128MB])             N次
-// append_object(append_content=data[size=128MB])   N次
-// 测试组<threads, object_size>之间尽可能维持写入总量16N GB不变,
-// 但是如果参数过小
-// <threads=1, object_size=1KB>时候每个线程会执行约1.6亿次
-// 因此仿照fio的number_ios / runtime 控制最大循环次数 / 最大运行时间
-//
-// 或者每个测试组<threads, object_size>执行固定次数?
+// 测试组<threads, object_size>之间写入总量相差很大,
+// <threads=1, object_size=1KB>时候要维持同样的写入量每个线程需要执行约1.6亿次,
+// 因此仿照fio的number_ios / runtime / ramp_time控制运行方式:
+// CONFIG_BENCH_NUMBER_IOS=N    每个线程测量N次(默认10), 0表示不限
+// CONFIG_BENCH_RUNTIME=T       测量阶段最多运行T秒, 与NUMBER_IOS先到者为准
+// CONFIG_BENCH_RAMP_UP=R       线程在R秒内错开启动
+// CONFIG_BENCH_WARMUP=W        全部启动后再运行W秒才开始测量
+// 比如按时间运行: CONFIG_BENCH_NUMBER_IOS=0 CONFIG_BENCH_RUNTIME=60 CONFIG_BENCH_RAMP_UP=5 CONFIG_BENCH_WARMUP=10
+// 默认为闭环(每个线程等上一个请求完成), 后端卡顿时发起的请求随之变少, 延迟被低估(coordinated omission);
+// CONFIG_BENCH_ARRIVAL=constant|poisson CONFIG_BENCH_RATE=Q 为开环, 所有线程合计每秒按计划发起Q个请求,
+// lat_*从计划发起的时间算起, svc_*从实际发起的时间算起, 两者的差距即为排队时间
+// results.csv为测量阶段的汇总, timeseries.csv为每个测试组从启动开始每秒的ops/MB/延迟, 用于观察限流出现的时间和稳态
+// 失败的请求由HuaweiCloudObs按CONFIG_RETRY_*退避重试, results.csv的errors/retries/retry_backoff_s等列记录重试的影响
+// CONFIG_RATE_LIMIT_OPS/MBPS(以及按key前缀的CONFIG_RATE_LIMIT_PREFIX_*)为客户端限流, limiter_wait_s为请求在客户端排队的总时间
 //
 // 比较的是什么:
 // put_object(content=data[size])和append_object(append_content=data[size])
+// put_object(content=data[size])和put_object_multipart(content=data[size]): 单次PUT与分段并发上传
+// put_object和async_put_object: 每个请求一个线程与少量工作线程执行同样多的请求, 比较单位CPU时间的吞吐
+// put_object_{buffer,pool,mmap,generator}_source: 上传回调中有/无拷贝时填充每字节的CPU周期(feed_cycles_per_byte, 不含请求的其余开销),
+//     整个上传路径的开销见ops_per_cpu_s
+// append_object和append_writer(小记录): 每条记录一次请求与多个线程的记录合并为一次追加(CONFIG_APPEND_FLUSH_*)
+// wal: 线程数增加时组提交的吞吐和提交延迟(CONFIG_WAL_SEGMENT_BYTES, CONFIG_APPEND_FLUSH_*), 以及回放的速度
+// sst: 流式分段写入SST的速度, 以及打开后每次点查只需一次get_range时的点查延迟(CONFIG_SST_*);
+//      过滤器的误判率和查询吞吐见filter_bench
+// get_object(size)和get_range(offset, len=size)作为对应的读路径
+// get_object(size)和parallel_get(size, part_size, concurrency): 单连接与分段并发读
+// ycsb: 按CONFIG_YCSB_*配置的操作比例、key热度和对象大小分布混合执行, 每种操作单独统计
+// tune_concurrency: 每个object_size吞吐不再增长时的并发, 可作为CustomArguments的线程数和AimdLimiter的初始值
+// hedge: 同样的GET/PUT关闭和打开CONFIG_HEDGE_ENABLE时的尾延迟和额外请求, 配合obs_server的CONFIG_SERVER_LATENCY=pareto:...制造长尾
+// replay: 按原始时间间隔(或CONFIG_REPLAY_SPEED倍速)回放CONFIG_REPLAY_TRACE中的访问日志, 延迟从计划时间算起
 
 static void CustomArguments(benchmark::internal::Benchmark* b) {
     b->RangeMultiplier(2)
@@ -341,17 +1341,143 @@ static void CustomArguments(benchmark::internal::Benchmark* b) {
     ->Unit(benchmark::kMillisecond);
 }
 
+static void AppendArguments(benchmark::internal::Benchmark* b) {
+    b->RangeMultiplier(4)
+    ->Ranges({
+        {1 << 10, 64 << 10},  // 1KB to 64KB
+        {64, 64}              // 64 threads
+    })
+    ->Iterations(1)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+}
+
+static void WalArguments(benchmark::internal::Benchmark* b) {
+    b->RangeMultiplier(4)
+    ->Ranges({
+        {1 << 10, 16 << 10},  // 1KB to 16KB
+        {1, 64}               // 1 to 64 threads
+    })
+    ->Iterations(1)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+}
+
+static void SstArguments(benchmark::internal::Benchmark* b) {
+    b->ArgsProduct({
+        {100, 1 << 10, 16 << 10},  // value大小
+        {1, 16}
+    })
+    ->Iterations(1)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+}
+
+static void ThreadArguments(benchmark::internal::Benchmark* b) {
+    b->RangeMultiplier(4)
+    ->Range(1, 64)  // 1 to 64 threads
+    ->Iterations(1)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+}
+
+static void TuneArguments(benchmark::internal::Benchmark* b) {
+    b->RangeMultiplier(4)
+    ->Range(1 << 12, 128 << 20)  // 4KB to 128MB
+    ->Iterations(1)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+}
+
+static void HedgeArguments(benchmark::internal::Benchmark* b) {
+    b->ArgsProduct({
+        {64 << 10, 1 << 20},  // 64KB, 1MB
+        {16},
+        {0, 1}                // 关闭 / 打开对冲
+    })
+    ->Iterations(1)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+}
+
+static void ListArguments(benchmark::internal::Benchmark* b) {
+    b->RangeMultiplier(2)
+    ->Ranges({
+        {1, 32},  // 1 to 32 threads
+        {0, 1}    // unordered / ordered
+    })
+    ->Iterations(1)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+}
+
 BENCHMARK_REGISTER_F(OBSBenchmark, put_object)
     ->Apply(CustomArguments);
 
+BENCHMARK_REGISTER_F(OBSBenchmark, put_object_multipart)
+    ->Apply(CustomArguments);
+
+BENCHMARK_REGISTER_F(OBSBenchmark, async_put_object)
+    ->Apply(CustomArguments);
+
+BENCHMARK_REGISTER_F(OBSBenchmark, put_object_buffer_source)
+    ->Apply(CustomArguments);
+
+BENCHMARK_REGISTER_F(OBSBenchmark, put_object_pool_source)
+    ->Apply(CustomArguments);
+
+BENCHMARK_REGISTER_F(OBSBenchmark, put_object_mmap_source)
+    ->Apply(CustomArguments);
+
+BENCHMARK_REGISTER_F(OBSBenchmark, put_object_generator_source)
+    ->Apply(CustomArguments);
+
 BENCHMARK_REGISTER_F(OBSBenchmark, append_object)
+    ->Apply(CustomArguments)
+    ->Apply(AppendArguments);
+
+BENCHMARK_REGISTER_F(OBSBenchmark, append_writer)
+    ->Apply(AppendArguments);
+
+BENCHMARK_REGISTER_F(OBSBenchmark, wal)
+    ->Apply(WalArguments);
+
+BENCHMARK_REGISTER_F(OBSBenchmark, sst)
+    ->Apply(SstArguments);
+
+BENCHMARK_REGISTER_F(OBSBenchmark, get_object)
+    ->Apply(CustomArguments);
+
+BENCHMARK_REGISTER_F(OBSBenchmark, get_range)
     ->Apply(CustomArguments);
 
+BENCHMARK_REGISTER_F(OBSBenchmark, parallel_get)
+    ->Apply(CustomArguments);
+
+BENCHMARK_REGISTER_F(OBSBenchmark, list_objects_parallel)
+    ->Apply(ListArguments);
+
+BENCHMARK_REGISTER_F(OBSBenchmark, ycsb)
+    ->Apply(ThreadArguments);
+
+BENCHMARK_REGISTER_F(OBSBenchmark, replay)
+    ->Apply(ThreadArguments);
+
+BENCHMARK_REGISTER_F(OBSBenchmark, tune_concurrency)
+    ->Apply(TuneArguments);
+
+BENCHMARK_REGISTER_F(OBSBenchmark, hedge)
+    ->Apply(HedgeArguments);
+
 int main(int argc, char **argv) {
     init_logger();
+    init_all_config();
     ::benchmark::Initialize(&argc, argv);
     if (::benchmark::ReportUnrecognizedArguments(argc, argv))
         return 1;
-    HuaweiCloudObs::get_instance()->delete_all();
+    get_object_store()->delete_all();
     ::benchmark::RunSpecifiedBenchmarks();
+#ifndef DEBUG
+    OBSBenchmark::cleanup(*get_object_store());
+#endif
 }
\ No newline at end of file
@@ -1,12 +1,29 @@
-#include "huawei_obs.h"
+#include "append_writer.h"
+#include "bloom_filter.h"
+#include "concurrency_limiter.h"
+#include "hedging.h"
+#include "histogram.h"
+#include "memtable.h"
+#include "obs_server.h"
+#include "rate_limiter.h"
+#include "retry_policy.h"
+#include "sst.h"
+#include "trace_replay.h"
+#include "wal.h"
+#include "worker_pool.h"
+#include "workload.h"
+#include "object_store_factory.h"
 #include "log.h"
+#include <filesystem>
 #include <gtest/gtest.h>
 #include <string>
 #include <random>
+#include <sstream>
+#include <set>
 
 class HuaweiCloudObsTest : public ::testing::Test {
 protected:
-    HuaweiCloudObs * obs_client;
+    ObjectStore * obs_client;
 
     // 生成随机 Key 以避免测试冲突
     std::string generate_random_key(const std::string& prefix) {
@@ -29,7 +46,7 @@ protected:
     }
 
     void SetUp() override {
-        obs_client = HuaweiCloudObs::get_instance();
+        obs_client = get_object_store();
     }
 };
 
@@ -75,12 +92,1059 @@ TEST_F(HuaweiCloudObsTest, PutLargeObject) {
     EXPECT_NO_THROW(obs_client->delete_objects({key}));
 }
 
+// 测试 Get Object / Get Range 功能
+TEST_F(HuaweiCloudObsTest, GetObjectSuccess) {
+    std::string key = generate_random_key("unittest_get");
+    std::string data = "Hello OBS, this is a get test.";
+    EXPECT_NO_THROW(obs_client->put_object(key, data));
+
+    std::string buffer(data.size(), '\0');
+    EXPECT_EQ(obs_client->get_object(key, buffer.data(), buffer.size()), data.size());
+    EXPECT_EQ(buffer, data);
+
+    // 读取 "OBS"
+    std::string range(3, '\0');
+    EXPECT_EQ(obs_client->get_range(key, 6, 3, range.data()), 3);
+    EXPECT_EQ(range, data.substr(6, 3));
+
+    // buffer 不足时抛出异常
+    std::string small(4, '\0');
+    EXPECT_THROW(obs_client->get_object(key, small.data(), small.size()), std::exception);
+
+    EXPECT_NO_THROW(obs_client->delete_object(key));
+}
+
+TEST_F(HuaweiCloudObsTest, ParallelGet) {
+    std::string key = generate_random_key("unittest_parallel_get");
+    std::string data = generate_data(1024 * 1024 + 17);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<char>('a' + i % 26);
+    }
+    EXPECT_NO_THROW(obs_client->put_object(key, data));
+    EXPECT_EQ(obs_client->head_object(key), data.size());
+
+    std::string buffer(data.size(), '\0');
+    EXPECT_EQ(obs_client->parallel_get(key, buffer.data(), buffer.size(), 100 * 1024, 4), data.size());
+    EXPECT_EQ(buffer, data);
+
+    EXPECT_NO_THROW(obs_client->delete_object(key));
+}
+
+TEST_F(HuaweiCloudObsTest, PutObjectMultipart) {
+    std::string key = generate_random_key("unittest_multipart");
+    std::string data = generate_data(1024 * 1024 + 17);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<char>('a' + i % 26);
+    }
+    // 最后一段小于part_size
+    EXPECT_NO_THROW(obs_client->put_object_multipart(key, data, 256 * 1024, 4));
+
+    std::string buffer(data.size(), '\0');
+    EXPECT_EQ(obs_client->get_object(key, buffer.data(), buffer.size()), data.size());
+    EXPECT_EQ(buffer, data);
+
+    EXPECT_NO_THROW(obs_client->delete_object(key));
+}
+
+TEST_F(HuaweiCloudObsTest, AsyncPutGetDelete) {
+    std::string key = generate_random_key("unittest_async");
+    std::string data = "Hello OBS, this is an async test.";
+
+    std::atomic<int> completed = 0;
+    auto on_complete = [&](std::exception_ptr error) {
+        EXPECT_EQ(error, nullptr);
+        ++completed;
+    };
+    EXPECT_NO_THROW(obs_client->async_put_object(key, data, on_complete).get());
+
+    std::string buffer(data.size(), '\0');
+    EXPECT_EQ(obs_client->async_get_object(key, buffer.data(), buffer.size(), on_complete).get(), data.size());
+    EXPECT_EQ(buffer, data);
+
+    EXPECT_NO_THROW(obs_client->async_delete_object(key, on_complete).get());
+    EXPECT_EQ(completed, 3);
+
+    // 失败时future抛出异常
+    EXPECT_THROW(obs_client->async_get_object(key, buffer.data(), buffer.size()).get(), std::exception);
+}
+
+TEST_F(HuaweiCloudObsTest, PutObjectFromSource) {
+    std::string key = generate_random_key("unittest_source");
+    std::string data = generate_data(256 * 1024 + 3);
+
+    GeneratorSource source = GeneratorSource::filled(data.size(), 'a');
+    EXPECT_NO_THROW(obs_client->put_object(key, source));
+    EXPECT_GT(source.feed_cycles(), 0);
+
+    std::string buffer(data.size(), '\0');
+    EXPECT_EQ(obs_client->get_object(key, buffer.data(), buffer.size()), data.size());
+    EXPECT_EQ(buffer, data);
+
+    // 借出的buffer随PooledBufferSource归还
+    BufferPool pool(1, data.size());
+    {
+        BufferPool::Buffer pooled = pool.try_acquire();
+        ASSERT_TRUE(pooled);
+        EXPECT_FALSE(pool.try_acquire());
+        memcpy(pooled.data(), data.data(), data.size());
+        PooledBufferSource pooled_source(std::move(pooled), data.size());
+        EXPECT_NO_THROW(obs_client->put_object(key, pooled_source));
+    }
+    EXPECT_TRUE(pool.try_acquire());
+    EXPECT_EQ(obs_client->get_object(key, buffer.data(), buffer.size()), data.size());
+    EXPECT_EQ(buffer, data);
+
+    EXPECT_NO_THROW(obs_client->delete_object(key));
+}
+
+TEST_F(HuaweiCloudObsTest, ListPagesAndDeletePrefix) {
+    std::string prefix = generate_random_key("unittest_list") + "/";
+    std::vector<std::string> keys;
+    for (int i = 0; i < 5; ++i) {
+        keys.push_back(fmt::format("{}{}", prefix, i));
+        EXPECT_NO_THROW(obs_client->put_object(keys.back(), "x"));
+    }
+
+    std::vector<std::string> listed;
+    obs_client->list_objects_pages([&](std::vector<std::string> &page) {
+        listed.insert(listed.end(), page.begin(), page.end());
+        return true;
+    }, "", prefix, "");
+    EXPECT_EQ(listed, keys);
+
+    // start_key 不包含在结果中
+    EXPECT_EQ(obs_client->list_objects(keys[2], prefix, ""), std::vector<std::string>(keys.begin() + 3, keys.end()));
+
+    EXPECT_EQ(obs_client->delete_prefix(prefix), keys.size());
+    EXPECT_TRUE(obs_client->list_objects("", prefix, "").empty());
+}
+
+TEST_F(HuaweiCloudObsTest, ListObjectsParallel) {
+    std::string prefix = generate_random_key("unittest_list_parallel") + "/";
+    std::vector<std::string> keys;
+    for (const char *name : {"0", "0a", "1", "5x", "9", "a", "zz"}) {
+        keys.push_back(prefix + name);
+        EXPECT_NO_THROW(obs_client->put_object(keys.back(), "x"));
+    }
+    auto boundaries = ObjectStore::make_shard_boundaries(prefix, "19a");
+
+    for (bool ordered : {false, true}) {
+        std::vector<std::string> listed;
+        obs_client->list_objects_parallel([&](std::vector<std::string> &page) {
+            listed.insert(listed.end(), page.begin(), page.end());
+            return true;
+        }, boundaries, 3, ordered, prefix);
+        if (!ordered) {
+            std::sort(listed.begin(), listed.end());
+        }
+        EXPECT_EQ(listed, keys);
+    }
+
+    EXPECT_EQ(obs_client->delete_prefix(prefix), keys.size());
+
+    // prefix为空时分片0从""开始, 不漏掉小于等于"\t"的key
+    MemoryObjectStore store;
+    std::vector<std::string> all_keys = {std::string("\x01"), "\t", "\ta", "b", "m", "z"};
+    for (const auto &key : all_keys) {
+        store.put_object(key, "x");
+    }
+    std::vector<std::string> listed;
+    store.list_objects_parallel([&](std::vector<std::string> &page) {
+        listed.insert(listed.end(), page.begin(), page.end());
+        return true;
+    }, {"m"}, 2, true);
+    EXPECT_EQ(listed, all_keys);
+}
+
+TEST_F(HuaweiCloudObsTest, DeleteObjectsPipelined) {
+    // 记录每批的大小和同时在途的批数, failing_key删除失败
+    class CountingStore : public MemoryObjectStore {
+      public:
+        void batch_delete_objects(const std::string *keys, std::size_t count, std::vector<DeleteFailure> &failures) const override {
+            std::size_t running = ++in_flight;
+            std::size_t peak = peak_in_flight.load();
+            while (running > peak && !peak_in_flight.compare_exchange_weak(peak, running)) {
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            for (std::size_t i = 0; i < count; ++i) {
+                if (keys[i] == failing_key) {
+                    failures.push_back({keys[i], "AccessDenied", "Access Denied"});
+                } else {
+                    delete_object(keys[i]);
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                batch_sizes.push_back(count);
+            }
+            --in_flight;
+        }
+
+        std::string failing_key;
+        mutable std::atomic<std::size_t> in_flight = 0;
+        mutable std::atomic<std::size_t> peak_in_flight = 0;
+        mutable std::mutex mutex;
+        mutable std::vector<std::size_t> batch_sizes;
+    } store;
+
+    // 超过in_flight个满批, 最后一批不满
+    const std::size_t in_flight = 2;
+    const std::size_t batch = 1000;
+    std::string prefix = "unittest_delete/";
+    std::vector<std::string> keys;
+    for (std::size_t i = 0; i < batch * in_flight * 2 + 500; ++i) {
+        keys.push_back(fmt::format("{}{:05}", prefix, i));
+        store.put_object(keys.back(), "x");
+    }
+    store.failing_key = keys[batch * 3 + 7];
+
+    auto failures = store.delete_objects(keys, in_flight);
+    ASSERT_EQ(failures.size(), 1);
+    EXPECT_EQ(failures[0].key, store.failing_key);
+    EXPECT_EQ(failures[0].code, "AccessDenied");
+    EXPECT_EQ(store.list_objects("", prefix, ""), std::vector<std::string>{store.failing_key});
+
+    std::sort(store.batch_sizes.begin(), store.batch_sizes.end());
+    EXPECT_EQ(store.batch_sizes, (std::vector<std::size_t>{500, batch, batch, batch, batch}));
+    EXPECT_EQ(store.peak_in_flight.load(), in_flight);
+
+    // 真实后端: 逐个key删除成功
+    prefix = generate_random_key("unittest_delete") + "/";
+    keys.clear();
+    for (int i = 0; i < 5; ++i) {
+        keys.push_back(fmt::format("{}{}", prefix, i));
+        EXPECT_NO_THROW(obs_client->put_object(keys.back(), "x"));
+    }
+    EXPECT_TRUE(obs_client->delete_objects(keys, 2).empty());
+    EXPECT_TRUE(obs_client->list_objects("", prefix, "").empty());
+}
+
 TEST_F(HuaweiCloudObsTest, Throw) {
     std::string key = generate_random_key("unittest_throw");
     std::string data = "Hello OBS, this is a put test.";
     EXPECT_THROW(obs_client->append_object(key, data, 1000), std::exception);
 }
 
+// 本地后端不依赖CONFIG::OBJECT_STORE, 直接构造
+TEST_F(HuaweiCloudObsTest, LocalObjectStores) {
+    MemoryObjectStore memory_store;
+    FsObjectStore fs_store(std::filesystem::temp_directory_path() / generate_random_key("unittest_fs_store"));
+    for (ObjectStore *store : std::initializer_list<ObjectStore *>{&memory_store, &fs_store}) {
+        std::string prefix = "dir/";
+        EXPECT_NO_THROW(store->put_object(prefix + "b", "hello"));
+        EXPECT_EQ(store->append_object(prefix + "a", "12", 0), 2);
+        EXPECT_EQ(store->append_object(prefix + "a", "345", 2), 5);
+        EXPECT_THROW(store->append_object(prefix + "a", "x", 1), ObjectStore::Error);
+        EXPECT_NO_THROW(store->put_object(prefix + "sub/c", "x"));
+        // 编码后超过NAME_MAX的key
+        std::string long_key = prefix + "long" + std::string(300, 'x') + std::string(100, '#');
+        EXPECT_NO_THROW(store->put_object(long_key, "long"));
+        EXPECT_EQ(store->append_object(long_key + "!", "12", 0), 2);
+        EXPECT_EQ(store->head_object(long_key), 4);
+
+        std::string buffer(5, '\0');
+        EXPECT_EQ(store->get_range(prefix + "a", 1, 10, buffer.data()), 4);
+        EXPECT_EQ(buffer.substr(0, 4), "2345");
+        try {
+            store->head_object("missing");
+            ADD_FAILURE();
+        } catch (const ObjectStore::Error &e) {
+            EXPECT_EQ(e.status, OBS_STATUS_NoSuchKey);
+        }
+
+        EXPECT_EQ(store->list_objects("", prefix), (std::vector<std::string>{prefix + "a", prefix + "b", long_key, long_key + "!"}));
+        EXPECT_EQ(store->list_objects("", prefix, ""), (std::vector<std::string>{prefix + "a", prefix + "b", long_key, long_key + "!", prefix + "sub/c"}));
+        EXPECT_EQ(store->get_approximate_object_count(), 5);
+        EXPECT_EQ(store->delete_prefix(prefix), 5);
+        EXPECT_EQ(store->get_approximate_object_count(), 0);
+
+        // 跨多页列举(每页最多1000个key)
+        std::vector<std::string> page_keys;
+        for (int i = 0; i < 2001; ++i) {
+            page_keys.push_back(fmt::format("pages/{:05}", i));
+            store->put_object(page_keys.back(), "x");
+        }
+        EXPECT_EQ(store->list_objects("", "pages/"), page_keys);
+        EXPECT_EQ(store->delete_prefix("pages/"), page_keys.size());
+    }
+}
+
+// 不经过SDK, 直接用socket发送HTTP请求验证obs_server
+TEST_F(HuaweiCloudObsTest, ObsServerRoundTrip) {
+    EXPECT_THROW(LatencyModel::parse("exp:0"), std::invalid_argument);
+    EXPECT_THROW(LatencyModel::parse("pareto:1000:0"), std::invalid_argument);
+    EXPECT_TRUE(LatencyModel::parse("exp:1000").enabled());
+
+    ObsServer server({.latency = "fixed:1000"});
+    uint16_t port = server.start();
+
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(port)};
+    ::inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    ASSERT_EQ(::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)), 0);
+    auto request = [&](const std::string &text) {
+        ::send(fd, text.data(), text.size(), 0);
+        std::string response;
+        char buffer[4096];
+        // 响应都很短, 以响应头加Content-Length判断结束
+        while (true) {
+            ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+            if (n <= 0) {
+                break;
+            }
+            response.append(buffer, n);
+            std::size_t header_end = response.find("\r\n\r\n");
+            std::size_t length_pos = response.find("Content-Length: ");
+            if (header_end != std::string::npos && length_pos < header_end &&
+                response.size() >= header_end + 4 + std::stoull(response.substr(length_pos + 16))) {
+                break;
+            }
+        }
+        return response;
+    };
+
+    auto t1 = std::chrono::steady_clock::now();
+    EXPECT_EQ(request("PUT /bucket/a%2Fb HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello").substr(0, 12), "HTTP/1.1 200");
+    EXPECT_GE(std::chrono::steady_clock::now() - t1, std::chrono::milliseconds(1));
+    std::string range = request("GET /bucket/a/b HTTP/1.1\r\nRange: bytes=1-3\r\n\r\n");
+    EXPECT_EQ(range.substr(0, 12), "HTTP/1.1 206");
+    EXPECT_EQ(range.substr(range.size() - 3), "ell");
+    EXPECT_EQ(request("POST /bucket/a/b?append&position=4 HTTP/1.1\r\nContent-Length: 1\r\n\r\nx").substr(0, 12), "HTTP/1.1 409");
+    EXPECT_NE(request("GET /bucket/?prefix=a%2F&max-keys=10 HTTP/1.1\r\n\r\n").find("<Key>a/b</Key>"), std::string::npos);
+    EXPECT_EQ(request("GET /bucket/missing HTTP/1.1\r\n\r\n").substr(0, 12), "HTTP/1.1 404");
+    ::close(fd);
+
+    EXPECT_EQ(server.store().head_object("a/b"), 5);
+    server.stop();
+}
+
+// HuaweiCloudObs经SDK访问本地的ObsServer; 注入的503 SlowDown在重试用尽后以OBS_STATUS_SlowDown抛给调用方
+TEST_F(HuaweiCloudObsTest, ObsServerSdkRoundTrip) {
+    ObsServer server({});
+    ObsServer failing_server({.error_rate = 1});
+    std::string endpoint = fmt::format("127.0.0.1:{}", server.start());
+    std::string failing_endpoint = fmt::format("127.0.0.1:{}", failing_server.start());
+
+    // 构造时读取CONFIG, 之后恢复
+    auto saved = std::make_tuple(CONFIG::PROTOCOL, CONFIG::URI_STYLE, CONFIG::ACCESS_KEY_ID, CONFIG::SECRET_ACCESS_KEY, CONFIG::RETRY_THROTTLE_DELAY_MS);
+    CONFIG::PROTOCOL = "http";
+    CONFIG::URI_STYLE = "path";
+    CONFIG::ACCESS_KEY_ID = "ak";
+    CONFIG::SECRET_ACCESS_KEY = "sk";
+    CONFIG::RETRY_THROTTLE_DELAY_MS = 1;
+    auto client = std::make_unique<HuaweiCloudObs>(endpoint);
+    auto failing_client = std::make_unique<HuaweiCloudObs>(failing_endpoint);
+    std::tie(CONFIG::PROTOCOL, CONFIG::URI_STYLE, CONFIG::ACCESS_KEY_ID, CONFIG::SECRET_ACCESS_KEY, CONFIG::RETRY_THROTTLE_DELAY_MS) = saved;
+
+    std::string key = "dir/sdk_round_trip";
+    std::string data(100000, '\0');
+    for (std::size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<char>('a' + i % 26);
+    }
+    EXPECT_NO_THROW(client->put_object(key, data));
+    EXPECT_EQ(server.store().head_object(key), data.size());
+    EXPECT_EQ(client->head_object(key), data.size());
+    std::string buffer(data.size(), '\0');
+    EXPECT_EQ(client->get_object(key, buffer.data(), buffer.size()), data.size());
+    EXPECT_EQ(buffer, data);
+    EXPECT_EQ(client->get_range(key, 26, 3, buffer.data()), 3);
+    EXPECT_EQ(buffer.substr(0, 3), "abc");
+    EXPECT_EQ(client->list_objects("", "dir/", ""), std::vector<std::string>{key});
+    EXPECT_NO_THROW(client->delete_object(key));
+    EXPECT_TRUE(client->list_objects("", "dir/", "").empty());
+
+    // 打开对冲时只有put_object_unique经过Hedger, put_object_single从不对冲
+    const std::size_t saved_hedge_enable = CONFIG::HEDGE_ENABLE;
+    CONFIG::HEDGE_ENABLE = 1;
+    EXPECT_NO_THROW(client->put_object_single(key, "single"));
+    EXPECT_EQ(client->hedge_stats().requests, 0);
+    EXPECT_NO_THROW(client->put_object_unique("dir/unique", "unique"));
+    EXPECT_EQ(client->hedge_stats().requests, 1);
+    CONFIG::HEDGE_ENABLE = saved_hedge_enable;
+    EXPECT_EQ(server.store().head_object(key), 6);
+    EXPECT_EQ(server.store().head_object("dir/unique"), 6);
+
+    try {
+        failing_client->put_object(key, "x");
+        ADD_FAILURE();
+    } catch (const ObjectStore::Error &e) {
+        EXPECT_EQ(e.status, OBS_STATUS_SlowDown);
+    }
+    EXPECT_EQ(failing_client->retry_stats().attempts, CONFIG::RETRY_MAX_ATTEMPTS);
+    EXPECT_THROW(failing_server.store().head_object(key), ObjectStore::Error);
+
+    client.reset();
+    failing_client.reset();
+    server.stop();
+    failing_server.stop();
+}
+
+TEST(Histogram, QuantileMergeEncode) {
+    Histogram a, b;
+    for (uint64_t v = 1; v <= 100000; ++v) {
+        (v % 2 ? a : b).record(v * 1000);
+    }
+    Histogram merged = a;
+    merged.merge(b);
+    EXPECT_EQ(merged.count(), 100000);
+    EXPECT_EQ(merged.min(), 1000);
+    EXPECT_EQ(merged.max(), 100000000);
+    for (double q : {0.5, 0.9, 0.99, 0.999, 0.9999}) {
+        double expected = q * 100000 * 1000;
+        EXPECT_NEAR(merged.value_at_quantile(q), expected, expected / 64) << q;
+    }
+    EXPECT_EQ(merged.value_at_quantile(1.0), merged.max());
+
+    Histogram decoded = Histogram::decode(merged.encode());
+    EXPECT_EQ(decoded.encode(), merged.encode());
+    EXPECT_EQ(decoded.value_at_quantile(0.99), merged.value_at_quantile(0.99));
+    EXPECT_EQ(merged.encode().find(','), std::string::npos);
+}
+
+TEST(WorkerPool, BarrierStartAndReuse) {
+    WorkerPool pool("compact");
+    for (std::size_t n : {4, 8, 2}) {
+        std::vector<std::thread::id> ids(n);
+        std::atomic<std::size_t> started = 0;
+        bool released = false;
+        pool.run(n, [&](std::size_t i) {
+            // 放行之前on_start已经执行, 且所有线程都已就绪
+            EXPECT_TRUE(released);
+            ids[i] = std::this_thread::get_id();
+            ++started;
+        }, [&]() { released = true; });
+        EXPECT_EQ(started, n);
+        EXPECT_EQ(std::set<std::thread::id>(ids.begin(), ids.end()).size(), n);
+    }
+    EXPECT_EQ(pool.size(), 8);
+    EXPECT_THROW(pool.run(3, [](std::size_t i) {
+        if (i == 1) {
+            throw std::runtime_error("worker failed");
+        }
+    }), std::runtime_error);
+    EXPECT_EQ(WorkerPool::parse_cpu_list("0-2,5\n"), (std::vector<int>{0, 1, 2, 5}));
+}
+
+TEST(Workload, MixedOpsOnMemoryStore) {
+    auto ratios = Workload::Spec::parse_ops("get=2,append=1,delete=1");
+    EXPECT_DOUBLE_EQ(ratios[Workload::GET], 0.5);
+    EXPECT_DOUBLE_EQ(ratios[Workload::PUT], 0);
+
+    std::mt19937_64 rng(1);
+    ZipfianGenerator zipfian(1000, 0.99);
+    std::vector<std::size_t> hits(1000);
+    for (int i = 0; i < 100000; ++i) {
+        ++hits[zipfian.next(rng)];
+    }
+    EXPECT_GT(hits[0], hits[1]);
+    EXPECT_GT(hits[1], hits[100] * 10);
+
+    MemoryObjectStore store;
+    Workload workload(store, Workload::Spec{
+        .ratios = Workload::Spec::parse_ops("get=0.4,put=0.2,insert=0.1,append=0.1,list=0.1,delete=0.1"),
+        .record_count = 100,
+        .key_distribution = "latest",
+        .zipf_theta = 0.99,
+        .value_size = SizeDistribution::parse("uniform:1:64"),
+        .append_key_count = 4,
+    }, "ycsb_");
+    auto state = workload.make_thread_state(1);
+    for (uint64_t i = 0; i < 100; ++i) {
+        workload.load(i, state);
+    }
+    // 失败的操作(如get已经delete的key)抛出异常, 只计入errors
+    std::array<std::size_t, Workload::OP_COUNT> counts = {};
+    std::size_t failed = 0;
+    for (int i = 0; i < 2000; ++i) {
+        try {
+            ++counts[workload.execute(state)];
+        } catch (const ObjectStore::Error &) {
+            ++failed;
+        }
+    }
+    std::size_t errors = 0;
+    for (std::size_t op = 0; op < Workload::OP_COUNT; ++op) {
+        EXPECT_GT(counts[op], 0) << Workload::OP_NAMES[op];
+        errors += workload.errors(static_cast<Workload::Op>(op));
+    }
+    EXPECT_GT(workload.errors(Workload::GET), 0);
+    EXPECT_EQ(errors, failed);
+    // 单线程下追加不会发生位置冲突
+    EXPECT_EQ(workload.errors(Workload::APPEND), 0);
+    EXPECT_EQ(workload.errors(Workload::PUT), 0);
+}
+
+TEST(TraceReplay, ParseAndReplay) {
+    TraceRecord record;
+    ASSERT_TRUE(TraceRecord::parse(R"({"ts": 1.5, "op": "get_range", "key": "a\"b", "size": 10, "offset": 3, "status": 200})", record));
+    EXPECT_EQ(record.op, TraceRecord::GET_RANGE);
+    EXPECT_EQ(record.key, "a\"b");
+    EXPECT_EQ(record.size, 10);
+    EXPECT_EQ(record.offset, 3);
+    EXPECT_FALSE(TraceRecord::parse(R"({"ts": 1, "op": "copy", "key": "a"})", record));
+    EXPECT_FALSE(TraceRecord::parse(R"({"op": "get", "key": "a"})", record));
+    ASSERT_TRUE(TraceRecord::parse(R"({"ts": 1, "op": "get", "key": "a\u0041"})", record));
+    EXPECT_EQ(record.key, "aA");
+    EXPECT_FALSE(TraceRecord::parse(R"({"ts": 1, "op": "get", "key": "a\uZZZZ"})", record));
+
+    std::stringstream trace;
+    trace << R"({"ts": 100.0, "op": "put", "key": "k1", "size": 8})" << "\n"
+          << R"({"ts": 100.1, "op": "get", "key": "k1", "size": 8})" << "\n"
+          << "not json\n"
+          << R"({"ts": 100.15, "op": "get", "key": "bad\u00g1"})" << "\n"
+          << R"({"ts": 100.2, "op": "get", "key": "k2", "size": 4})" << "\n"
+          << R"({"ts": 100.3, "op": "head", "key": "k2"})" << "\n"
+          << R"({"ts": 100.4, "op": "append", "key": "log", "size": 5})" << "\n";
+    MemoryObjectStore store;
+    WorkerPool pool;
+    TraceReplayer replayer(store, TraceReplayer::Options{.speed = 10, .key_prefix = "replay_"});
+    auto t1 = std::chrono::steady_clock::now();
+    auto result = replayer.replay(trace, pool, 2);
+    // 原始跨度0.4秒, 10倍速
+    EXPECT_GE(std::chrono::steady_clock::now() - t1, std::chrono::milliseconds(40));
+    EXPECT_EQ(result.records, 5);
+    EXPECT_EQ(result.skipped_lines, 2);
+    // k2不存在, 第一次读取失败后补写, 之后的head命中
+    EXPECT_EQ(result.errors[TraceRecord::GET], 1);
+    EXPECT_EQ(result.errors[TraceRecord::HEAD], 0);
+    EXPECT_EQ(store.head_object("replay_k1"), 8);
+    EXPECT_EQ(store.head_object("replay_log"), 5);
+    // 失败的get不计入延迟和字节数
+    EXPECT_EQ(result.latency[TraceRecord::GET][0].count() + result.latency[TraceRecord::GET][1].count(), 1);
+    EXPECT_EQ(result.service[TraceRecord::GET][0].count() + result.service[TraceRecord::GET][1].count(), 1);
+    EXPECT_EQ(result.bytes[TraceRecord::GET], 8);
+
+    // 尽快回放时没有计划时间, 延迟从实际发起算起, 不包括回放开始后等待的时间
+    std::stringstream fast_trace;
+    for (int i = 0; i < 200; ++i) {
+        fast_trace << fmt::format(R"({{"ts": {}, "op": "get", "key": "fast{}", "size": 16}})", i, i % 20) << "\n";
+    }
+    TraceReplayer fast_replayer(store, TraceReplayer::Options{.speed = 0, .key_prefix = "replay_"});
+    auto fast = fast_replayer.replay(fast_trace, pool, 1);
+    EXPECT_EQ(fast.records, 200);
+    EXPECT_GE(fast.errors[TraceRecord::GET], 1);
+    EXPECT_EQ(fast.latency[TraceRecord::GET][0].encode(), fast.service[TraceRecord::GET][0].encode());
+    for (int i = 0; i < 20; ++i) {
+        EXPECT_EQ(store.head_object(fmt::format("replay_fast{}", i)), 16);
+    }
+}
+
+TEST(AppendWriter, CoalesceRecordsFromManyThreads) {
+    MemoryObjectStore store;
+    // 每个批次至少64字节, 或等待1ms
+    AppendWriter writer(store, "append_writer_log", 0, AppendWriter::Options{.flush_bytes = 64, .flush_interval = std::chrono::milliseconds(1), .max_buffered_bytes = 256});
+    constexpr int THREADS = 8, RECORDS = 100;
+    std::vector<std::thread> threads;
+    std::vector<std::size_t> ends(THREADS * RECORDS);
+    for (int t = 0; t < THREADS; ++t) {
+        threads.emplace_back([&, t]() {
+            std::vector<std::future<std::size_t>> futures;
+            for (int i = 0; i < RECORDS; ++i) {
+                futures.push_back(writer.append(fmt::format("{}:{:03};", t, i)));
+            }
+            for (int i = 0; i < RECORDS; ++i) {
+                ends[t * RECORDS + i] = futures[i].get();
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    writer.flush();
+
+    // 每条记录6字节, 结束位置各不相同, 同一线程的记录按顺序写入
+    const std::size_t total = THREADS * RECORDS * 6;
+    EXPECT_EQ(writer.position(), total);
+    EXPECT_EQ(std::set<std::size_t>(ends.begin(), ends.end()).size(), ends.size());
+    std::string object(total, '\0');
+    EXPECT_EQ(store.get_object("append_writer_log", object.data(), object.size()), total);
+    for (int t = 0; t < THREADS; ++t) {
+        for (int i = 0; i < RECORDS; ++i) {
+            std::size_t end = ends[t * RECORDS + i];
+            EXPECT_EQ(object.substr(end - 6, 6), fmt::format("{}:{:03};", t, i));
+            if (i > 0) {
+                EXPECT_GT(end, ends[t * RECORDS + i - 1]);
+            }
+        }
+    }
+    auto stats = writer.stats();
+    EXPECT_EQ(stats.records, THREADS * RECORDS);
+    EXPECT_EQ(stats.bytes, total);
+    EXPECT_LT(stats.flushes, THREADS * RECORDS);
+
+    // 位置冲突(对象已被其他写入者追加)时, 之后的记录都失败
+    AppendWriter stale(store, "append_writer_log", 0, AppendWriter::Options{.flush_bytes = 1});
+    EXPECT_THROW(stale.append("x").get(), ObjectStore::Error);
+    EXPECT_THROW(stale.append("y").get(), ObjectStore::Error);
+    EXPECT_THROW(stale.flush(), ObjectStore::Error);
+
+    writer.close();
+    EXPECT_THROW(writer.append("z"), ObjectStore::Error);
+}
+
+TEST(Wal, GroupCommitRollAndReplay) {
+    // CRC-32C的标准测试向量
+    EXPECT_EQ(crc32c("123456789", 9), 0xE3069283u);
+
+    MemoryObjectStore store;
+    const std::string prefix = "wal_test/";
+    constexpr int THREADS = 4, RECORDS = 200;
+    {
+        WalWriter wal(store, prefix, WalWriter::Options{
+            .segment_bytes = 1024,
+            .append = {.flush_bytes = 256, .flush_interval = std::chrono::milliseconds(1), .max_buffered_bytes = 4096},
+        });
+        std::vector<std::thread> threads;
+        for (int t = 0; t < THREADS; ++t) {
+            threads.emplace_back([&, t]() {
+                for (int i = 0; i < RECORDS; ++i) {
+                    wal.append(fmt::format("{}:{}", t, i)).end.get();
+                }
+            });
+        }
+        for (auto &t : threads) {
+            t.join();
+        }
+        EXPECT_GT(wal.stats().segments, 1);
+    }
+
+    // 每个线程的记录按提交顺序回放, 读取块小于记录时跨块拼接
+    auto replay = [&](std::size_t read_bytes) {
+        std::vector<int> next(THREADS, 0);
+        std::size_t out_of_order = 0;
+        auto result = WalReader(store, prefix, {.read_bytes = read_bytes}).replay([&](uint64_t segment, std::string_view payload) {
+            int t = payload[0] - '0';
+            if (payload.substr(2) != std::to_string(next[t]++)) {
+                ++out_of_order;
+            }
+        });
+        EXPECT_EQ(out_of_order, 0);
+        return result;
+    };
+    for (std::size_t read_bytes : {8, 100, 1 << 20}) {
+        auto result = replay(read_bytes);
+        EXPECT_EQ(result.records, THREADS * RECORDS);
+        EXPECT_FALSE(result.torn_tail);
+    }
+
+    // 最后一段尾部残缺时停在残缺处; 重新打开后写入新的段
+    auto segments = WalFormat::list_segments(store, prefix);
+    std::string last = WalFormat::segment_key(prefix, segments.back());
+    store.append_object(last, std::string("\x10\0\0\0garbage", 11), store.head_object(last));
+    auto torn = replay(64);
+    EXPECT_EQ(torn.records, THREADS * RECORDS);
+    EXPECT_TRUE(torn.torn_tail);
+    EXPECT_EQ(torn.torn_segments, 1);
+    {
+        WalWriter wal(store, prefix);
+        EXPECT_EQ(wal.segment(), segments.back() + 1);
+        for (int i = 0; i < RECORDS; ++i) {
+            wal.append(fmt::format("0:{}", RECORDS + i));
+        }
+    }
+
+    // 残缺的段不再是最后一段: 跳过它的尾部, 继续回放之后的段; 校验失败的记录恰好在段末尾时同样视为残缺
+    for (std::size_t read_bytes : {8, 100, 1 << 20}) {
+        auto reopened = replay(read_bytes);
+        EXPECT_EQ(reopened.records, THREADS * RECORDS + RECORDS);
+        EXPECT_FALSE(reopened.torn_tail);
+        EXPECT_EQ(reopened.torn_segments, 1);
+    }
+    std::string corrupt_tail;
+    WalFormat::encode("x", corrupt_tail);
+    corrupt_tail.back() ^= 1;
+    std::string second_last = WalFormat::segment_key(prefix, segments[segments.size() - 2]);
+    store.append_object(second_last, corrupt_tail, store.head_object(second_last));
+    auto corrupt = replay(100);
+    EXPECT_EQ(corrupt.records, THREADS * RECORDS + RECORDS);
+    EXPECT_EQ(corrupt.torn_segments, 2);
+
+    // 段中间的记录损坏(之后还有数据)时抛出异常
+    std::string first = WalFormat::segment_key(prefix, segments.front());
+    std::string data(store.head_object(first), '\0');
+    store.get_object(first, data.data(), data.size());
+    data[WalFormat::HEADER_SIZE] ^= 1;
+    store.put_object(first, data);
+    EXPECT_THROW(WalReader(store, prefix).replay([](uint64_t, std::string_view) {}), ObjectStore::Error);
+}
+
+TEST(MemTable, ConcurrentInsertAndRotate) {
+    MemTable table(4096);
+    constexpr int THREADS = 8, KEYS = 1000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; ++t) {
+        threads.emplace_back([&, t]() {
+            // 每个线程写同一批key的一个版本, seq越大越新
+            for (int i = 0; i < KEYS; ++i) {
+                table.add(t * KEYS + i + 1, fmt::format("key{:05}", i), fmt::format("v{}", t));
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(table.count(), THREADS * KEYS);
+
+    // 按key升序, 同一key按seq降序
+    std::size_t entries = 0;
+    std::string prev_key;
+    uint64_t prev_seq = 0;
+    MemTable::Iterator it(table);
+    for (it.seek_to_first(); it.valid(); it.next(), ++entries) {
+        auto entry = it.entry();
+        if (entries > 0) {
+            EXPECT_TRUE(prev_key < entry.key || (prev_key == entry.key && prev_seq > entry.seq));
+        }
+        prev_key = entry.key;
+        prev_seq = entry.seq;
+    }
+    EXPECT_EQ(entries, THREADS * KEYS);
+    auto entry = table.get("key00042");
+    ASSERT_TRUE(entry.has_value());
+    EXPECT_EQ(entry->seq, (THREADS - 1) * KEYS + 43);
+    EXPECT_EQ(entry->value, fmt::format("v{}", THREADS - 1));
+    EXPECT_FALSE(table.get("key99999").has_value());
+
+    // 每个MemTable约16KB就冻结, flush按冻结的顺序进行
+    std::mutex mutex;
+    std::vector<uint64_t> flushed_seqs;
+    std::size_t flushed_entries = 0;
+    {
+        MemTableList list([&](const MemTable &frozen) {
+            std::lock_guard<std::mutex> lock(mutex);
+            MemTable::Iterator it(frozen);
+            uint64_t max_seq = 0;
+            for (it.seek_to_first(); it.valid(); it.next(), ++flushed_entries) {
+                max_seq = std::max(max_seq, it.entry().seq);
+            }
+            flushed_seqs.push_back(max_seq);
+        }, MemTableList::Options{.write_buffer_bytes = 16 << 10, .max_immutable = 1, .arena_block_bytes = 4096});
+        for (int i = 0; i < 2000; ++i) {
+            list.add(fmt::format("key{:05}", i % 500), std::string(32, 'a' + i % 26));
+        }
+        list.add("key00007", "", MemTable::DELETE);
+        auto record = list.get("key00499");
+        ASSERT_TRUE(record.has_value());
+        EXPECT_EQ(record->value, std::string(32, 'a' + 1999 % 26));
+        EXPECT_EQ(list.get("key00007")->type, MemTable::DELETE);
+        EXPECT_GT(list.stats().rotations, 1);
+        list.close();
+        EXPECT_FALSE(list.get("key00007").has_value());
+    }
+    EXPECT_EQ(flushed_entries, 2001);
+    EXPECT_TRUE(std::is_sorted(flushed_seqs.begin(), flushed_seqs.end()));
+}
+
+TEST(Sst, StreamedWriteAndPointReads) {
+    MemoryObjectStore store;
+    // 1KB的数据块, 8KB一段, 让写入走分段上传; 不生成过滤器, 不存在的key同样读一个数据块
+    SstWriter writer(store, "sst/000001", SstWriter::Options{.block_bytes = 1 << 10, .part_bytes = 8 << 10, .bloom_bits_per_key = 0});
+    constexpr int KEYS = 2000;
+    for (int i = 0; i < KEYS; ++i) {
+        std::string key = fmt::format("key{:06}", i * 2);
+        // 每个key两个版本, 新版本在前
+        writer.add(key, fmt::format("new{}", i), 2 * i + 2, i % 10 == 0 ? MemTable::DELETE : MemTable::PUT);
+        writer.add(key, fmt::format("old{}", i), 2 * i + 1);
+    }
+    EXPECT_THROW(writer.add("key000000", "", 1), ObjectStore::Error);
+    auto result = writer.finish();
+    EXPECT_EQ(result.entries, 2 * KEYS);
+    EXPECT_GT(result.parts, 1);
+    EXPECT_EQ(store.head_object("sst/000001"), result.size);
+
+    // 尾部足够大时打开只读一次, 每次点查读一个数据块
+    SstReader reader(store, "sst/000001", result.size, SstReader::Options{.tail_read_bytes = 64 << 10});
+    EXPECT_EQ(reader.stats().open_reads, 1);
+    EXPECT_EQ(reader.entries(), 2 * KEYS);
+    EXPECT_EQ(reader.data_blocks(), result.data_blocks);
+    for (int i = 0; i < KEYS; i += 7) {
+        auto record = reader.get(fmt::format("key{:06}", i * 2));
+        ASSERT_TRUE(record.has_value());
+        EXPECT_EQ(record->value, fmt::format("new{}", i));
+        EXPECT_EQ(record->seq, 2 * i + 2);
+        EXPECT_EQ(record->type, i % 10 == 0 ? MemTable::DELETE : MemTable::PUT);
+        EXPECT_FALSE(reader.get(fmt::format("key{:06}", i * 2 + 1)).has_value());
+    }
+    EXPECT_FALSE(reader.get("zzz").has_value());
+    EXPECT_EQ(reader.stats().block_reads, 2 * ((KEYS + 6) / 7));
+
+    // 尾部放不下索引块时补读一次; 从MemTable写入时每个key只保留最新版本
+    MemTable table;
+    for (int i = 0; i < 100; ++i) {
+        table.add(i + 1, fmt::format("k{:03}", i % 50), fmt::format("v{}", i));
+    }
+    auto small = SstWriter::write(store, "sst/000002", table, SstWriter::Options{.block_bytes = 64, .part_bytes = 1 << 20});
+    EXPECT_EQ(small.entries, 50);
+    EXPECT_EQ(small.parts, 0);
+    SstReader small_reader(store, "sst/000002", 0, SstReader::Options{.tail_read_bytes = SstFormat::FOOTER_SIZE});
+    EXPECT_EQ(small_reader.stats().open_reads, 2);
+    EXPECT_EQ(small_reader.get("k007")->value, "v57");
+
+    // 数据块损坏时校验失败
+    std::string object(small.size, '\0');
+    store.get_object("sst/000002", object.data(), object.size());
+    object[10] ^= 1;
+    store.put_object("sst/000002", object);
+    SstReader corrupt_reader(store, "sst/000002");
+    EXPECT_THROW(corrupt_reader.get("k000"), ObjectStore::Error);
+}
+
+TEST(BloomFilter, BatchProbeAndSstNegativeLookups) {
+    std::vector<uint64_t> hashes;
+    for (int i = 0; i < 10000; ++i) {
+        hashes.push_back(BloomFilter::hash(fmt::format("key{:06}", i)));
+    }
+    BloomFilter filter(BloomFilter::build(hashes, 10));
+    EXPECT_EQ(filter.bits(), (10000 * 10 + 255) / 256 * 256);
+
+    // 已加入的key一定命中, 批量(AVX2)与逐个查询的结果相同, 10位/key时误判率约1%
+    constexpr int PROBES = 100000;
+    for (int i = 0; i < PROBES; ++i) {
+        hashes.push_back(BloomFilter::hash(fmt::format("absent{:06}", i)));
+    }
+    std::unique_ptr<bool[]> batch(new bool[hashes.size()]);
+    filter.may_contain(hashes.data(), hashes.size(), batch.get());
+    std::size_t false_positives = 0;
+    for (std::size_t i = 0; i < hashes.size(); ++i) {
+        ASSERT_EQ(batch[i], filter.may_contain(hashes[i]));
+        if (i < 10000) {
+            EXPECT_TRUE(batch[i]);
+        } else {
+            false_positives += batch[i];
+        }
+    }
+    EXPECT_LT(false_positives, PROBES * 0.02);
+    EXPECT_FALSE(BloomFilter::valid("abc"));
+    EXPECT_THROW(BloomFilter(std::string_view("abc")), std::invalid_argument);
+
+    // SST的过滤器块: 不存在的key大多不读数据块, multi_get每个数据块只读一次
+    MemoryObjectStore store;
+    SstWriter writer(store, "sst/bloom", SstWriter::Options{.block_bytes = 1 << 10, .part_bytes = 1 << 20, .bloom_bits_per_key = 10});
+    for (int i = 0; i < 1000; ++i) {
+        writer.add(fmt::format("key{:06}", i), fmt::format("value{}", i), i + 1);
+    }
+    auto result = writer.finish();
+    SstReader reader(store, "sst/bloom");
+    EXPECT_GE(reader.filter_bits(), 1000 * 10);
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_FALSE(reader.get(fmt::format("key{:06}x", i)).has_value());
+    }
+    EXPECT_GT(reader.stats().filter_skips, 950);
+    EXPECT_EQ(reader.get("key000123")->value, "value123");
+
+    // 存在的key跳过部分数据块; 不存在的key只取与存在的key落在同一数据块中的, 误判也不会多读数据块,
+    // 读取的数据块数恰好等于存在的key所在的不同数据块数
+    std::vector<std::string> keys;
+    std::set<std::size_t> present_blocks;
+    std::size_t absent_count = 0;
+    for (int i = 0; i < 1000; i += 37) {
+        keys.push_back(fmt::format("key{:06}", i));
+        present_blocks.insert(reader.block_of(keys.back()));
+        std::string absent = fmt::format("key{:06}x", i);
+        if (reader.block_of(absent) == reader.block_of(keys.back())) {
+            keys.push_back(absent);
+            ++absent_count;
+        }
+    }
+    std::vector<std::string_view> key_views(keys.begin(), keys.end());
+    auto before = reader.stats();
+    auto records = reader.multi_get(key_views);
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        if (keys[i].back() != 'x') {
+            ASSERT_TRUE(records[i].has_value());
+            EXPECT_EQ(records[i]->value, "value" + std::to_string(std::stoi(keys[i].substr(3))));
+        } else {
+            EXPECT_FALSE(records[i].has_value());
+        }
+    }
+    EXPECT_GT(present_blocks.size(), 1);
+    EXPECT_LT(present_blocks.size(), result.data_blocks);
+    EXPECT_EQ(reader.stats().block_reads - before.block_reads, present_blocks.size());
+    EXPECT_GE(reader.stats().filter_skips - before.filter_skips, absent_count - 2);
+}
+
+TEST(ConcurrencyLimiter, KneeAndAimd) {
+    // 并发4之后吞吐不再明显增长
+    KneeFinder finder(0.1, 3, 1);
+    EXPECT_TRUE(finder.observe({1, 100, 10}));
+    EXPECT_TRUE(finder.observe({2, 190, 10}));
+    EXPECT_TRUE(finder.observe({4, 350, 12}));
+    EXPECT_TRUE(finder.observe({8, 370, 20}));
+    EXPECT_FALSE(finder.observe({16, 372, 40}));
+    EXPECT_EQ(finder.best().concurrency, 4);
+    EXPECT_TRUE(finder.reached_knee());
+
+    AimdLimiter limiter({.initial_limit = 4, .min_limit = 1, .max_limit = 8, .backoff_ratio = 0.5});
+    std::vector<AimdLimiter::Clock::time_point> started;
+    for (int i = 0; i < 4; ++i) {
+        started.push_back(limiter.acquire());
+    }
+    EXPECT_EQ(limiter.in_flight(), 4);
+    // 同一批请求都被限流只减一次
+    for (auto t : started) {
+        limiter.release(t, true);
+    }
+    EXPECT_EQ(limiter.limit(), 2);
+    EXPECT_EQ(limiter.decreases(), 1);
+
+    // 调用方只有一个并发, limit不会无限增长
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(limiter.call([]() { return 1; }), 1);
+    }
+    EXPECT_GT(limiter.limit(), 2);
+    EXPECT_LT(limiter.limit(), 3);
+
+    double before = limiter.limit();
+    EXPECT_THROW(limiter.call([]() { throw ObjectStore::Error("slow down", OBS_STATUS_SlowDown); }), ObjectStore::Error);
+    EXPECT_DOUBLE_EQ(limiter.limit(), std::max(1.0, before * 0.5));
+    // 其他错误不视为过载
+    before = limiter.limit();
+    EXPECT_THROW(limiter.call([]() { throw ObjectStore::Error("not found", OBS_STATUS_NoSuchKey); }), ObjectStore::Error);
+    EXPECT_GE(limiter.limit(), before);
+    EXPECT_EQ(limiter.in_flight(), 0);
+}
+
+TEST(Retrier, ClassifyBackoffAndBudget) {
+    EXPECT_TRUE(Retrier::is_retryable(OBS_STATUS_SlowDown));
+    EXPECT_TRUE(Retrier::is_retryable(OBS_STATUS_ConnectionFailed));
+    EXPECT_TRUE(Retrier::is_retryable(OBS_STATUS_RequestTimeout));
+    EXPECT_FALSE(Retrier::is_retryable(OBS_STATUS_NoSuchKey));
+    EXPECT_FALSE(Retrier::is_retryable(OBS_STATUS_AccessDenied));
+    EXPECT_FALSE(Retrier::is_retryable(OBS_STATUS_AbortedByCallback));
+
+    RetryPolicy policy{
+        .max_attempts = 4,
+        .base_delay = std::chrono::microseconds(10),
+        .throttle_base_delay = std::chrono::microseconds(100),
+        .max_delay = std::chrono::microseconds(50),
+    };
+    for (std::size_t retry = 1; retry < 10; ++retry) {
+        EXPECT_LE(policy.backoff(retry, false), std::min<std::chrono::nanoseconds>(policy.max_delay, policy.base_delay * (1 << (retry - 1))));
+        EXPECT_LE(policy.backoff(retry, true), policy.max_delay);
+    }
+
+    // 预算为2个令牌, 每个成功的请求存入0.5个
+    Retrier retrier(policy, 0.5, 2);
+    int calls = 0;
+    EXPECT_EQ(retrier.run([&]() {
+        if (++calls < 3) {
+            throw ObjectStore::Error("slow down", OBS_STATUS_SlowDown);
+        }
+        return calls;
+    }), 3);
+    auto stats = retrier.stats();
+    EXPECT_EQ(stats.attempts, 3);
+    EXPECT_EQ(stats.retries, 2);
+    EXPECT_DOUBLE_EQ(retrier.budget().tokens(), 0.5);
+
+    // 不可重试的错误只执行一次
+    calls = 0;
+    EXPECT_THROW(retrier.run([&]() { ++calls; throw ObjectStore::Error("no such key", OBS_STATUS_NoSuchKey); }), ObjectStore::Error);
+    EXPECT_EQ(calls, 1);
+
+    // 预算不足一个令牌时不再重试
+    calls = 0;
+    EXPECT_THROW(retrier.run([&]() { ++calls; throw ObjectStore::Error("connection failed", OBS_STATUS_ConnectionFailed); }), ObjectStore::Error);
+    EXPECT_EQ(calls, 1);
+    EXPECT_EQ(retrier.stats().budget_exhausted, 1);
+
+    // 成功的请求补充预算, 达到最大次数后放弃
+    for (int i = 0; i < 10; ++i) {
+        retrier.run([]() {});
+    }
+    EXPECT_DOUBLE_EQ(retrier.budget().tokens(), 2);
+    calls = 0;
+    EXPECT_THROW(retrier.run([&]() { ++calls; throw ObjectStore::Error("timeout", OBS_STATUS_RequestTimeout); }), ObjectStore::Error);
+    EXPECT_EQ(calls, 3);
+    EXPECT_EQ(retrier.stats().budget_exhausted, 2);
+
+    Retrier generous(policy, 1, 100);
+    calls = 0;
+    EXPECT_THROW(generous.run([&]() { ++calls; throw ObjectStore::Error("timeout", OBS_STATUS_RequestTimeout); }), ObjectStore::Error);
+    EXPECT_EQ(calls, policy.max_attempts);
+    EXPECT_EQ(generous.stats().gave_up, 1);
+}
+
+TEST(RateLimiter, TokenBucketAndPrefixes) {
+    using namespace std::chrono;
+    // 每秒1000个令牌, 突发10个: 前10个不等待, 之后每个令牌排队1ms
+    TokenBucket bucket;
+    bucket.configure(1000, 10);
+    auto now = TokenBucket::Clock::now();
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ(bucket.reserve(1, now).count(), 0);
+    }
+    EXPECT_EQ(bucket.reserve(1, now), milliseconds(1));
+    EXPECT_EQ(bucket.reserve(5, now), milliseconds(6));
+    // 不取令牌的请求也要等到预支的令牌恢复; 退还的令牌可以被之后的请求使用
+    EXPECT_EQ(bucket.reserve(0, now), milliseconds(6));
+    bucket.refund(2);
+    EXPECT_EQ(bucket.reserve(0, now), milliseconds(4));
+    // 空闲之后恢复突发
+    EXPECT_EQ(bucket.reserve(1, now + seconds(1)).count(), 0);
+
+    TokenBucket unlimited;
+    EXPECT_TRUE(unlimited.unlimited());
+    EXPECT_EQ(unlimited.reserve(1e9, now).count(), 0);
+
+    // 整个桶不限, 每个前缀(前4个字符)每秒100个请求, 不同前缀互不影响
+    RateLimiter limiter({.prefix_length = 4, .prefix_ops_per_s = 100, .prefix_slots = 64, .burst_seconds = 0});
+    EXPECT_FALSE(limiter.unlimited());
+    auto start = TokenBucket::Clock::now();
+    for (int i = 0; i < 5; ++i) {
+        limiter.acquire(fmt::format("aaaa{}", i), 0);
+    }
+    limiter.acquire("bbbb", 0);
+    auto elapsed = TokenBucket::Clock::now() - start;
+    EXPECT_GE(elapsed, milliseconds(40));
+    EXPECT_LT(elapsed, milliseconds(500));
+    auto stats = limiter.stats();
+    EXPECT_EQ(stats.requests, 6);
+    EXPECT_EQ(stats.waits, 4);
+    EXPECT_GT(stats.wait_seconds, 0.03);
+
+    EXPECT_TRUE(RateLimiter(RateLimiter::Options{}).unlimited());
+}
+
+TEST(Hedger, HedgeSlowPrimaryWithinBudget) {
+    // 64个1ms的样本之后分位数可用
+    LatencyTracker tracker;
+    EXPECT_EQ(tracker.quantile_ns(4096), 0);
+    for (std::size_t i = 0; i < LatencyTracker::MIN_SAMPLES; ++i) {
+        tracker.record(4096, 1000000, 0.95);
+    }
+    EXPECT_GT(tracker.quantile_ns(4096), 0);
+    EXPECT_EQ(tracker.quantile_ns(1 << 20), 0);
+
+    // 主请求卡住直到输掉, 对冲请求立即返回; 提交在胜出后执行一次
+    auto slow_primary = [](HedgeRace &race, std::size_t attempt) -> int {
+        if (attempt == 0) {
+            for (int i = 0; i < 200 && !race.lost(attempt); ++i) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            return 0;
+        }
+        return 1;
+    };
+    Hedger hedger(0, 1, 4);
+    int committed = -1;
+    EXPECT_EQ(hedger.run<int>(tracker, 4096, slow_primary, [&](std::size_t attempt, int &result) { committed = result; }), 1);
+    EXPECT_EQ(committed, 1);
+    auto stats = hedger.stats();
+    EXPECT_EQ(stats.requests, 1);
+    EXPECT_EQ(stats.hedges, 1);
+    EXPECT_EQ(stats.hedge_wins, 1);
+
+    // 预算用完(ratio为0)后等待主请求
+    EXPECT_EQ(hedger.run<int>(tracker, 4096, slow_primary), 0);
+    EXPECT_EQ(hedger.stats().hedges, 1);
+    EXPECT_EQ(hedger.stats().budget_denied, 1);
+
+    // 样本不足的大小不对冲; 主请求失败且没有对冲时抛出主请求的错误
+    EXPECT_THROW(hedger.run<int>(tracker, 1 << 20, [](HedgeRace &, std::size_t) -> int { throw ObjectStore::Error("no such key", OBS_STATUS_NoSuchKey); }), ObjectStore::Error);
+    EXPECT_EQ(hedger.stats().requests, 3);
+}
+
 // ./hw_obs_test --gtest_filter=HuaweiCloudObsTest.DeleteAll
 TEST_F(HuaweiCloudObsTest, DeleteAll) {
     obs_client->delete_all();
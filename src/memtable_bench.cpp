@@ -0,0 +1,134 @@
+#include "config.h"
+#include "log.h"
+#include "memtable.h"
+#include <atomic>
+#include <benchmark/benchmark.h>
+#include <cstddef>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+// MemTable的多线程插入/查找吞吐, 不访问OBS
+// ./memtable_bench --benchmark_filter=insert
+// range(0)为value大小, key为16字节的随机十进制数; 多线程的测试组共用同一个MemTable(由0号线程创建)
+
+static constexpr std::size_t KEY_SPACE = 1 << 20;
+static constexpr std::size_t PRELOAD_KEYS = 1 << 18;
+
+static std::string make_key(uint64_t n) {
+    return fmt::format("{:016}", n);
+}
+
+static std::unique_ptr<MemTable> table;
+static std::unique_ptr<MemTableList> table_list;
+static std::atomic<uint64_t> next_seq = 0;
+
+// 并发插入随机key
+static void insert(benchmark::State &state) {
+    if (state.thread_index() == 0) {
+        table = std::make_unique<MemTable>();
+    }
+    const std::string value(state.range(0), 'v');
+    std::mt19937_64 rng(state.thread_index());
+    for (auto _ : state) {
+        table->add(next_seq.fetch_add(1, std::memory_order_relaxed) + 1, make_key(rng() % KEY_SPACE), value);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * (16 + value.size()));
+    if (state.thread_index() == 0) {
+        state.counters["arena_mb"] = table->memory_usage() / 1048576.0;
+        table.reset();
+    }
+}
+
+// 预先插入PRELOAD_KEYS个key后并发查找, 一半命中
+static void get(benchmark::State &state) {
+    if (state.thread_index() == 0) {
+        table = std::make_unique<MemTable>();
+        const std::string value(state.range(0), 'v');
+        for (uint64_t i = 0; i < PRELOAD_KEYS; ++i) {
+            table->add(i + 1, make_key(i * 2), value);
+        }
+    }
+    std::mt19937_64 rng(state.thread_index());
+    std::size_t hits = 0;
+    for (auto _ : state) {
+        hits += table->get(make_key(rng() % (PRELOAD_KEYS * 2))).has_value();
+    }
+    benchmark::DoNotOptimize(hits);
+    state.SetItemsProcessed(state.iterations());
+    if (state.thread_index() == 0) {
+        table.reset();
+    }
+}
+
+// 一半插入一半查找, 查找与插入并发
+static void mixed(benchmark::State &state) {
+    if (state.thread_index() == 0) {
+        table = std::make_unique<MemTable>();
+    }
+    const std::string value(state.range(0), 'v');
+    std::mt19937_64 rng(state.thread_index());
+    std::size_t hits = 0;
+    for (auto _ : state) {
+        uint64_t r = rng();
+        if (r & 1) {
+            table->add(next_seq.fetch_add(1, std::memory_order_relaxed) + 1, make_key((r >> 1) % KEY_SPACE), value);
+        } else {
+            hits += table->get(make_key((r >> 1) % KEY_SPACE)).has_value();
+        }
+    }
+    benchmark::DoNotOptimize(hits);
+    state.SetItemsProcessed(state.iterations());
+    if (state.thread_index() == 0) {
+        table.reset();
+    }
+}
+
+// 经MemTableList插入, 按CONFIG::MEMTABLE_BYTES冻结, flush线程只遍历一遍不可变的MemTable(模拟写SST);
+// stall_s为写入等待flush的总时间
+static void insert_rotate(benchmark::State &state) {
+    if (state.thread_index() == 0) {
+        table_list = std::make_unique<MemTableList>([](const MemTable &frozen) {
+            std::size_t bytes = 0;
+            MemTable::Iterator it(frozen);
+            for (it.seek_to_first(); it.valid(); it.next()) {
+                bytes += it.entry().key.size() + it.entry().value.size();
+            }
+            benchmark::DoNotOptimize(bytes);
+        });
+    }
+    const std::string value(state.range(0), 'v');
+    std::mt19937_64 rng(state.thread_index());
+    for (auto _ : state) {
+        table_list->add(make_key(rng() % KEY_SPACE), value);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * (16 + value.size()));
+    if (state.thread_index() == 0) {
+        table_list->close();
+        auto stats = table_list->stats();
+        state.counters["rotations"] = stats.rotations;
+        state.counters["stall_s"] = stats.stall_seconds;
+        table_list.reset();
+    }
+}
+
+static void MemTableArguments(benchmark::internal::Benchmark *b) {
+    b->Arg(100)->Arg(1024)->ThreadRange(1, 64)->UseRealTime();
+}
+
+BENCHMARK(insert)->Apply(MemTableArguments);
+BENCHMARK(get)->Apply(MemTableArguments);
+BENCHMARK(mixed)->Apply(MemTableArguments);
+BENCHMARK(insert_rotate)->Apply(MemTableArguments);
+
+int main(int argc, char **argv) {
+    init_logger();
+    init_all_config();
+    ::benchmark::Initialize(&argc, argv);
+    if (::benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    ::benchmark::RunSpecifiedBenchmarks();
+}
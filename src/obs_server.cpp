@@ -0,0 +1,29 @@
+#include "config.h"
+#include "log.h"
+#include "obs_server.h"
+#include <csignal>
+
+// 本地的OBS替身, 监听CONFIG::ENDPOINT, 例如:
+// CONFIG_ENDPOINT=127.0.0.1:9000 CONFIG_SERVER_LATENCY=lognormal:2000:0.8 CONFIG_SERVER_ERROR_RATE=0.01 ./obs_server
+// 客户端使用相同的CONFIG_ENDPOINT, 并设置CONFIG_PROTOCOL=http CONFIG_URI_STYLE=path和任意非空的AK/SK
+int main(int argc, char **argv) {
+    init_logger();
+    init_all_config();
+
+    // 在启动其他线程之前屏蔽信号, 由主线程sigwait
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    ObsServer server(ObsServer::Options::from_config());
+    uint16_t port = server.start();
+    LOG_PRINT("obs_server listening on port {}", port);
+
+    int signal = 0;
+    sigwait(&signals, &signal);
+    LOG_PRINT("obs_server stopping, objects: {}", server.store().get_approximate_object_count());
+    server.stop();
+    return 0;
+}